@@ -0,0 +1,489 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <xmmintrin.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "animation.hpp"
+#include "cpu_profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "job_system.hpp"
+#include "model.hpp"
+#include "compressed_clip.hpp"
+
+// Below this many characters animating them is cheaper than handing them out as jobs
+const size_t PARALLEL_CHARACTER_THRESHOLD = 64;
+
+// the keys around time and how far it is from the first to the second, clamped to the first and last key
+struct KeyPair {
+    unsigned int first, second;
+    float fraction;
+};
+
+static KeyPair findKeys(const std::vector<float> &times, float time) {
+    unsigned int next = (unsigned int) (std::upper_bound(times.begin(), times.end(), time) - times.begin());
+    if (next == 0)
+        return {0, 0, 0.0f};
+    if (next == times.size())
+        return {next - 1, next - 1, 0.0f};
+    float span = times[next] - times[next - 1];
+    return {next - 1, next, span > 0.0f ? (time - times[next - 1]) / span : 0.0f};
+}
+
+void ClearKeyBlock(KeyBlock &block, size_t lanes) {
+    for (size_t lane = lanes; lane < 4; lane++) {
+        for (int key = 0; key < 2; key++) {
+            for (int c = 0; c < 3; c++) {
+                block.position[key][c][lane] = 0.0f;
+                block.scale[key][c][lane] = 1.0f;
+            }
+            for (int c = 0; c < 4; c++)
+                block.rotation[key][c][lane] = c == 3 ? 1.0f : 0.0f;
+        }
+        block.positionT[lane] = block.rotationT[lane] = block.scaleT[lane] = 0.0f;
+    }
+}
+
+void BlendKeys(const KeyBlock &block, size_t lanes, const unsigned int *nodes, Transform *pose) {
+    alignas(16) float outPosition[3][4], outScale[3][4], outRotation[4][4];
+    __m128 tp = _mm_load_ps(block.positionT), ts = _mm_load_ps(block.scaleT), tr = _mm_load_ps(block.rotationT);
+    for (int c = 0; c < 3; c++) {
+        __m128 a = _mm_load_ps(block.position[0][c]), b = _mm_load_ps(block.position[1][c]);
+        _mm_store_ps(outPosition[c], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), tp)));
+        a = _mm_load_ps(block.scale[0][c]);
+        b = _mm_load_ps(block.scale[1][c]);
+        _mm_store_ps(outScale[c], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), ts)));
+    }
+
+    // q and -q are the same rotation, the second key is flipped when that makes the arc between them shorter
+    __m128 a[4], b[4];
+    __m128 dot = _mm_setzero_ps();
+    for (int c = 0; c < 4; c++) {
+        a[c] = _mm_load_ps(block.rotation[0][c]);
+        b[c] = _mm_load_ps(block.rotation[1][c]);
+        dot = _mm_add_ps(dot, _mm_mul_ps(a[c], b[c]));
+    }
+    __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+    __m128 length = _mm_setzero_ps();
+    __m128 blended[4];
+    for (int c = 0; c < 4; c++) {
+        b[c] = _mm_xor_ps(b[c], flip);
+        blended[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(b[c], a[c]), tr));
+        length = _mm_add_ps(length, _mm_mul_ps(blended[c], blended[c]));
+    }
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+    for (int c = 0; c < 4; c++)
+        _mm_store_ps(outRotation[c], _mm_mul_ps(blended[c], inverse));
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        Transform &transform = pose[nodes[lane]];
+        transform.position = glm::vec3(outPosition[0][lane], outPosition[1][lane], outPosition[2][lane]);
+        transform.scale = glm::vec3(outScale[0][lane], outScale[1][lane], outScale[2][lane]);
+        transform.rotation = glm::quat(outRotation[3][lane], outRotation[0][lane], outRotation[1][lane],
+                                       outRotation[2][lane]);
+    }
+}
+
+Transform SampleChannel(const AnimationChannel &channel, float time) {
+    KeyPair p = findKeys(channel.positionTimes, time);
+    KeyPair r = findKeys(channel.rotationTimes, time);
+    KeyPair s = findKeys(channel.scaleTimes, time);
+    Transform transform;
+    transform.position = glm::mix(channel.positions[p.first], channel.positions[p.second], p.fraction);
+    transform.scale = glm::mix(channel.scales[s.first], channel.scales[s.second], s.fraction);
+    glm::quat a = channel.rotations[r.first], b = channel.rotations[r.second];
+    if (glm::dot(a, b) < 0.0f)
+        b = -b;
+    transform.rotation = glm::normalize(a * (1.0f - r.fraction) + b * r.fraction);
+    return transform;
+}
+
+void SampleClip(const AnimationClip &clip, float time, Transform *pose) {
+    if (clip.duration > 0.0f) {
+        time = std::fmod(time, clip.duration);
+        if (time < 0.0f)
+            time += clip.duration;
+    } else {
+        time = 0.0f;
+    }
+
+    KeyBlock block;
+    const size_t count = clip.channels.size();
+    for (size_t first = 0; first < count; first += 4) {
+        size_t lanes = std::min<size_t>(4, count - first);
+        ClearKeyBlock(block, lanes);
+        unsigned int nodes[4];
+        for (size_t lane = 0; lane < lanes; lane++) {
+            const AnimationChannel &channel = clip.channels[first + lane];
+            nodes[lane] = channel.node;
+            KeyPair p = findKeys(channel.positionTimes, time);
+            KeyPair r = findKeys(channel.rotationTimes, time);
+            KeyPair s = findKeys(channel.scaleTimes, time);
+            block.positionT[lane] = p.fraction;
+            block.rotationT[lane] = r.fraction;
+            block.scaleT[lane] = s.fraction;
+            for (int key = 0; key < 2; key++) {
+                const glm::vec3 &pk = channel.positions[key ? p.second : p.first];
+                const glm::quat &rk = channel.rotations[key ? r.second : r.first];
+                const glm::vec3 &sk = channel.scales[key ? s.second : s.first];
+                for (int c = 0; c < 3; c++) {
+                    block.position[key][c][lane] = pk[c];
+                    block.scale[key][c][lane] = sk[c];
+                }
+                block.rotation[key][0][lane] = rk.x;
+                block.rotation[key][1][lane] = rk.y;
+                block.rotation[key][2][lane] = rk.z;
+                block.rotation[key][3][lane] = rk.w;
+            }
+        }
+        BlendKeys(block, lanes, nodes, pose);
+    }
+}
+
+// out = a * b, a column of out at a time as the columns of a weighted by one column of b. out may be b
+static void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out) {
+    __m128 columns[4] = {_mm_loadu_ps(&a[0][0]), _mm_loadu_ps(&a[1][0]), _mm_loadu_ps(&a[2][0]),
+                         _mm_loadu_ps(&a[3][0])};
+    __m128 result[4];
+    for (int c = 0; c < 4; c++) {
+        result[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(b[c][0])),
+                                          _mm_mul_ps(columns[1], _mm_set1_ps(b[c][1]))),
+                               _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(b[c][2])),
+                                          _mm_mul_ps(columns[3], _mm_set1_ps(b[c][3]))));
+    }
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(&out[c][0], result[c]);
+}
+
+void ComputePalette(const Skeleton &skeleton, const Transform *pose, glm::mat4 *world, glm::mat4 *palette) {
+    size_t count = skeleton.parents.size();
+    ComposeTransforms(pose, count, world);
+    // parents come first, so theirs are final by the time a child reads them
+    for (size_t i = 0; i < count; i++) {
+        int parent = skeleton.parents[i];
+        if (parent >= 0)
+            multiply(world[parent], world[i], world[i]);
+    }
+    for (size_t b = 0; b < skeleton.boneNodes.size(); b++)
+        multiply(world[skeleton.boneNodes[b]], skeleton.boneOffsets[b], palette[b]);
+}
+
+void SkinVertices(const Vertex *vertices, const SkinWeights *skin, size_t count, const glm::mat4 *palette,
+                  Vertex *out) {
+    const __m128 toWeight = _mm_set1_ps(1.0f / 255.0f);
+    for (size_t v = 0; v < count; v++) {
+        const SkinWeights &weights = skin[v];
+        __m128 columns[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (int k = 0; k < 4; k++) {
+            if (!weights.weights[k])
+                continue;
+            __m128 weight = _mm_mul_ps(_mm_set1_ps((float) weights.weights[k]), toWeight);
+            const float *m = &palette[weights.bones[k]][0][0];
+            for (int c = 0; c < 4; c++)
+                columns[c] = _mm_add_ps(columns[c], _mm_mul_ps(_mm_loadu_ps(m + 4 * c), weight));
+        }
+
+        const Vertex &vertex = vertices[v];
+        __m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(vertex.Position.x)),
+                                                _mm_mul_ps(columns[1], _mm_set1_ps(vertex.Position.y))),
+                                     _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(vertex.Position.z)), columns[3]));
+        __m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(vertex.Normal.x)),
+                                              _mm_mul_ps(columns[1], _mm_set1_ps(vertex.Normal.y))),
+                                   _mm_mul_ps(columns[2], _mm_set1_ps(vertex.Normal.z)));
+        alignas(16) float p[4], n[4];
+        _mm_store_ps(p, position);
+        _mm_store_ps(n, normal);
+
+        out[v].Position = glm::vec3(p[0], p[1], p[2]);
+        glm::vec3 skinnedNormal(n[0], n[1], n[2]);
+        float length = glm::length(skinnedNormal);
+        out[v].Normal = length > 0.0f ? skinnedNormal / length : vertex.Normal;
+        out[v].TexCoords = vertex.TexCoords;
+    }
+}
+
+Characters::Characters(unsigned int window)
+        : paletteBuffer(0), paletteTexture(0), maxPaletteMatrices(0), window(window), nextUpdate(0) {
+}
+
+Characters::~Characters() {
+    if (paletteBuffer) {
+        glDeleteTextures(1, &paletteTexture);
+        glDeleteBuffers(1, &paletteBuffer);
+    }
+}
+
+unsigned int Characters::Add(const Skeleton &skeleton, const AnimationClip *clip, Model *model,
+                             const glm::mat4 &transform, float phase, float speed) {
+    Character character = {&skeleton, clip, nullptr, model, transform, phase, speed, palettes.size()};
+    characters.push_back(character);
+    palettes.resize(palettes.size() + skeleton.boneNodes.size(), glm::mat4(1.0f));
+    return (unsigned int) characters.size() - 1;
+}
+
+unsigned int Characters::Add(const Skeleton &skeleton, const CompressedClip *clip, Model *model,
+                             const glm::mat4 &transform, float phase, float speed) {
+    unsigned int index = Add(skeleton, (const AnimationClip *) nullptr, model, transform, phase, speed);
+    characters[index].compressed = clip;
+    return index;
+}
+
+void Characters::Clear() {
+    characters.clear();
+    palettes.clear();
+}
+
+void Characters::Update(float deltaTime, unsigned int threads) {
+    PROFILE_SCOPE("Characters::Update");
+    auto start = std::chrono::steady_clock::now();
+
+    auto animate = [&](size_t first, size_t last) {
+        // reused by whichever thread runs the range, so a frame allocates nothing once they have grown
+        static thread_local std::vector<Transform> pose;
+        static thread_local std::vector<glm::mat4> world;
+        for (size_t i = first; i < last; i++) {
+            Character &character = characters[i];
+            const Skeleton &skeleton = *character.skeleton;
+            pose.assign(skeleton.bindPose.begin(), skeleton.bindPose.end());
+            world.resize(skeleton.parents.size());
+            if (character.clip || character.compressed) {
+                // kept within the clip so the time doesn't lose precision over a long run
+                float duration = character.clip ? character.clip->duration : character.compressed->Duration();
+                character.time += deltaTime * character.speed;
+                if (duration > 0.0f)
+                    character.time = std::fmod(character.time, duration);
+                if (character.clip)
+                    SampleClip(*character.clip, character.time, pose.data());
+                else
+                    character.compressed->Sample(character.time, pose.data());
+            }
+            ComputePalette(skeleton, pose.data(), world.data(), &palettes[character.palette]);
+        }
+    };
+
+    size_t count = characters.size();
+    JobSystem::Instance().ParallelFor(count, 16, threads, PARALLEL_CHARACTER_THRESHOLD, animate);
+
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RecordSample(updateMilliseconds, nextUpdate, window, milliseconds);
+}
+
+void Characters::Draw(Shader &shader) const {
+    if (characters.empty())
+        return;
+
+    if (!paletteBuffer) {
+        glGenBuffers(1, &paletteBuffer);
+        glGenTextures(1, &paletteTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        GLint texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        maxPaletteMatrices = (size_t) texels / 4;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + BONE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+
+    // as many characters at a time as the buffer texture can address, which is all of them but on old hardware
+    auto end = [&](size_t i) { return characters[i].palette + characters[i].skeleton->boneNodes.size(); };
+    size_t first = 0;
+    while (first < characters.size()) {
+        size_t begin = characters[first].palette, last = first;
+        while (last < characters.size() && end(last) - begin <= maxPaletteMatrices)
+            last++;
+        if (last == first) {
+            std::cout << "ERROR::CHARACTERS::PALETTE_TOO_LARGE " << end(first) - begin << std::endl;
+            first++;
+            continue;
+        }
+
+        // orphaned every time, so a batch never waits for the draws of the one before
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr) ((end(last - 1) - begin) * sizeof(glm::mat4)), &palettes[begin],
+                     GL_STREAM_DRAW);
+        for (size_t i = first; i < last; i++) {
+            if (characters[i].model) {
+                characters[i].model->DrawSkinned(shader, characters[i].transform,
+                                                 (unsigned int) (characters[i].palette - begin));
+            }
+        }
+        first = last;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Characters::Report(std::ostream &out) const {
+    if (updateMilliseconds.empty())
+        return;
+    float milliseconds = average(updateMilliseconds);
+    out << "Characters: " << characters.size() << ", update " << milliseconds << " ms avg, "
+        << percentile(updateMilliseconds, 0.99f) << " ms p99, "
+        << (milliseconds > 0.0f ? (float) characters.size() / milliseconds * 1e-3f : 0.0f) << " M characters/s"
+        << std::endl;
+}
+
+// A root with a spine of eight nodes and four limbs of fourteen hanging off it, 64 bones in all, and a two second clip
+// swinging every bone back and forth with 30 keys a second
+static void syntheticSkeleton(Skeleton &skeleton, AnimationClip &clip) {
+    skeleton.parents = {-1};
+    for (int i = 0; i < 8; i++)
+        skeleton.parents.push_back(i);
+    const int attach[4] = {8, 8, 4, 4};
+    for (int limb = 0; limb < 4; limb++) {
+        for (int i = 0; i < 14; i++)
+            skeleton.parents.push_back(i == 0 ? attach[limb] : (int) skeleton.parents.size() - 1);
+    }
+
+    size_t count = skeleton.parents.size();
+    skeleton.bindPose.assign(count, Transform());
+    for (size_t i = 1; i < count; i++)
+        skeleton.bindPose[i].position = i <= 8 ? glm::vec3(0.0f, 0.25f, 0.0f) : glm::vec3(0.1f, -0.1f, 0.05f);
+
+    // bind pose world matrices, whose inverses are the bone offsets
+    std::vector<glm::mat4> world(count);
+    skeleton.boneNodes.clear();
+    ComputePalette(skeleton, skeleton.bindPose.data(), world.data(), nullptr);
+    for (unsigned int i = 1; i < count; i++) {
+        skeleton.boneNodes.push_back(i);
+        skeleton.boneOffsets.push_back(glm::inverse(world[i]));
+    }
+
+    clip.name = "synthetic";
+    clip.duration = 2.0f;
+    clip.channels.clear();
+    for (unsigned int i = 1; i < count; i++) {
+        AnimationChannel channel;
+        channel.node = i;
+        channel.positionTimes = {0.0f, clip.duration};
+        channel.positions = {skeleton.bindPose[i].position, skeleton.bindPose[i].position * 1.1f};
+        channel.scaleTimes = {0.0f};
+        channel.scales = {glm::vec3(1.0f)};
+        glm::vec3 axis = glm::normalize(glm::vec3(std::sin((float) i), 1.0f, std::cos((float) i * 0.7f)));
+        for (int k = 0; k <= 60; k++) {
+            float time = (float) k / 30.0f;
+            channel.rotationTimes.push_back(time);
+            channel.rotations.push_back(glm::angleAxis(0.6f * std::sin(time * 3.1415927f + (float) i), axis));
+        }
+        clip.channels.push_back(channel);
+    }
+}
+
+void BenchmarkAnimation(std::ostream &out, unsigned int count) {
+    Skeleton skeleton;
+    AnimationClip clip;
+    syntheticSkeleton(skeleton, clip);
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    Characters characters;
+    for (unsigned int i = 0; i < count; i++)
+        characters.Add(skeleton, &clip, nullptr, glm::mat4(1.0f), unit(rng) * clip.duration, 0.8f + unit(rng) * 0.4f);
+
+    const int frames = 20;
+    unsigned int hardware = JobSystem::Instance().Threads();
+    out << count << " characters of " << skeleton.boneNodes.size() << " bones, sampling and palettes:" << std::endl;
+    for (unsigned int threads : {1u, hardware}) {
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+            characters.Update(1.0f / 60.0f, threads);
+        double milliseconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+        out << "  " << threads << " thread" << (threads > 1 ? "s" : "") << ": " << milliseconds << " ms per frame, "
+            << milliseconds * 1e3 / count << " us per character" << std::endl;
+        if (threads == hardware)
+            break;
+    }
+
+    // the same crowd playing the clip compressed
+    CompressedClip compressed;
+    compressed.Compress(clip);
+    Characters compressedCharacters;
+    for (unsigned int i = 0; i < count; i++) {
+        compressedCharacters.Add(skeleton, &compressed, nullptr, glm::mat4(1.0f), unit(rng) * clip.duration,
+                                 0.8f + unit(rng) * 0.4f);
+    }
+    for (unsigned int threads : {1u, hardware}) {
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+            compressedCharacters.Update(1.0f / 60.0f, threads);
+        double milliseconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+        out << "  compressed clip, " << threads << " thread" << (threads > 1 ? "s" : "") << ": " << milliseconds
+            << " ms per frame, " << milliseconds * 1e3 / count << " us per character" << std::endl;
+        if (threads == hardware)
+            break;
+    }
+    CompressedClip::Report(out, clip, compressed, skeleton);
+
+    // the SSE sampling and palette against glm's own blending and matrices
+    float time = 0.77f;
+    std::vector<Transform> pose = skeleton.bindPose;
+    std::vector<glm::mat4> world(pose.size()), palette(skeleton.boneNodes.size());
+    SampleClip(clip, time, pose.data());
+    ComputePalette(skeleton, pose.data(), world.data(), palette.data());
+
+    std::vector<glm::mat4> reference(pose.size());
+    for (size_t i = 0; i < pose.size(); i++) {
+        Transform local = skeleton.bindPose[i];
+        for (const AnimationChannel &channel : clip.channels) {
+            if (channel.node == i)
+                local = SampleChannel(channel, time);
+        }
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), local.position) * glm::mat4_cast(local.rotation) *
+                           glm::scale(glm::mat4(1.0f), local.scale);
+        reference[i] = skeleton.parents[i] < 0 ? matrix : reference[skeleton.parents[i]] * matrix;
+    }
+    float error = 0.0f;
+    for (size_t b = 0; b < palette.size(); b++) {
+        glm::mat4 expected = reference[skeleton.boneNodes[b]] * skeleton.boneOffsets[b];
+        for (int c = 0; c < 4; c++)
+            error = std::max(error, glm::length(palette[b][c] - expected[c]));
+    }
+    out << "  largest palette difference to glm: " << error << std::endl;
+
+    // CPU skinning of a mesh with four random bones per vertex
+    const size_t vertexCount = 65536;
+    std::vector<Vertex> vertices(vertexCount), skinned(vertexCount), expected(vertexCount);
+    std::vector<SkinWeights> skin(vertexCount);
+    std::uniform_int_distribution<int> bone(0, (int) palette.size() - 1);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertices[v].Position = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f - 1.0f;
+        vertices[v].Normal = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f);
+        vertices[v].TexCoords = glm::vec2(unit(rng), unit(rng));
+        int total = 0;
+        for (int k = 0; k < 4; k++) {
+            skin[v].bones[k] = (uint8_t) bone(rng);
+            skin[v].weights[k] = k < 3 ? (uint8_t) (unit(rng) * (float) (255 - total) * 0.6f) : (uint8_t) 0;
+            total += skin[v].weights[k];
+        }
+        skin[v].weights[3] = (uint8_t) (255 - total);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; r++)
+        SkinVertices(vertices.data(), skin.data(), vertexCount, palette.data(), skinned.data());
+    double simd = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 10;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; r++) {
+        for (size_t v = 0; v < vertexCount; v++) {
+            glm::mat4 matrix(0.0f);
+            for (int k = 0; k < 4; k++)
+                matrix += palette[skin[v].bones[k]] * ((float) skin[v].weights[k] / 255.0f);
+            expected[v].Position = glm::vec3(matrix * glm::vec4(vertices[v].Position, 1.0f));
+            expected[v].Normal = glm::normalize(glm::mat3(matrix) * vertices[v].Normal);
+        }
+    }
+    double plain = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 10;
+
+    float skinError = 0.0f;
+    for (size_t v = 0; v < vertexCount; v++)
+        skinError = std::max(skinError, glm::length(skinned[v].Position - expected[v].Position));
+    out << "  CPU skinning of " << vertexCount << " vertices: SSE " << simd << " ms, glm " << plain
+        << " ms, largest difference " << skinError << std::endl;
+}
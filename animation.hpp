@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.hpp"
+#include "transform.hpp"
+
+class CompressedClip;
+class Model;
+
+// Bones a skinned mesh can be bound to, vertices store their bone indices in a byte each
+const unsigned int MAX_BONES = 256;
+
+// The skinning vertex shaders fetch the palettes from a buffer texture on this unit, as "bones"
+const unsigned int BONE_TEXTURE_UNIT = 6;
+
+// The nodes an animation moves and the bones meshes are bound to. Nodes are in the order of the model's, parents
+// before children; a bone is a node with the inverse of its bind pose, taking vertices from mesh space to the node
+struct Skeleton {
+    std::vector<int> parents;
+    // every node's local transform as imported, what a clip leaves alone stays at it
+    std::vector<Transform> bindPose;
+    std::vector<unsigned int> boneNodes;
+    std::vector<glm::mat4> boneOffsets;
+};
+
+// Keys of one node, each kind with its own times in seconds
+struct AnimationChannel {
+    unsigned int node;
+    std::vector<float> positionTimes, rotationTimes, scaleTimes;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration;
+    std::vector<AnimationChannel> channels;
+};
+
+// The keys around a time of four channels side by side, one array per component, and how far the time is from the
+// first key to the second. Shared by everything that samples clips, so they all blend the same way
+struct KeyBlock {
+    alignas(16) float position[2][3][4];
+    alignas(16) float rotation[2][4][4];
+    alignas(16) float scale[2][3][4];
+    alignas(16) float positionT[4];
+    alignas(16) float rotationT[4];
+    alignas(16) float scaleT[4];
+};
+
+// fills the lanes past lanes with identities, so every lane blends to something finite
+void ClearKeyBlock(KeyBlock &block, size_t lanes);
+
+// blends the four lanes with SSE, positions and scales linearly, rotations by normalized lerp along the shorter arc,
+// and writes the first lanes of them to the transforms of nodes in pose
+void BlendKeys(const KeyBlock &block, size_t lanes, const unsigned int *nodes, Transform *pose);
+
+// the transform of one channel at time, clamped to its first and last keys. Plain glm, for offline use
+Transform SampleChannel(const AnimationChannel &channel, float time);
+
+// Overwrites the local transforms of the nodes clip animates with its keys at time, which wraps around the duration.
+// Keys are found by binary search, then four channels at a time go through BlendKeys. pose has one transform per node,
+// usually the bind pose
+void SampleClip(const AnimationClip &clip, float time, Transform *pose);
+
+// Skinning matrices of every bone from the local transforms of every node. world is scratch space of a matrix per
+// node
+void ComputePalette(const Skeleton &skeleton, const Transform *pose, glm::mat4 *world, glm::mat4 *palette);
+
+// The CPU version of the skinning vertex shaders, for checking them and for whatever needs skinned positions on the
+// CPU. Blends the four bone matrices of a vertex with SSE and transforms its position and normal
+void SkinVertices(const Vertex *vertices, const SkinWeights *skin, size_t count, const glm::mat4 *palette,
+                  Vertex *out);
+
+// Animated instances of skinned models. Update samples every character's clip and builds its palette, characters are
+// independent so large crowds are split into jobs. Draw uploads all the palettes into one buffer texture and draws
+// through the skinning path of the bound shader, each character pointed at its own palette in it
+class Characters {
+public:
+    explicit Characters(unsigned int window = 240);
+    ~Characters();
+
+    Characters(const Characters &) = delete;
+    Characters &operator=(const Characters &) = delete;
+
+    // model may be null for characters that are only animated. Without a clip the character holds its bind pose
+    unsigned int Add(const Skeleton &skeleton, const AnimationClip *clip, Model *model, const glm::mat4 &transform,
+                     float phase = 0.0f, float speed = 1.0f);
+    // playing a compressed clip instead
+    unsigned int Add(const Skeleton &skeleton, const CompressedClip *clip, Model *model, const glm::mat4 &transform,
+                     float phase = 0.0f, float speed = 1.0f);
+    void Clear();
+    size_t Count() const { return characters.size(); }
+
+    // threads as for the scene systems, 0 splits large crowds, 1 keeps them on the calling thread
+    void Update(float deltaTime, unsigned int threads = 0);
+
+    const glm::mat4 *Palette(unsigned int character) const { return &palettes[characters[character].palette]; }
+
+    // with the shader in use and its view and projection set
+    void Draw(Shader &shader) const;
+
+    // milliseconds Update took and the characters it animated per second
+    void Report(std::ostream &out) const;
+
+private:
+    struct Character {
+        const Skeleton *skeleton;
+        const AnimationClip *clip;
+        const CompressedClip *compressed;
+        Model *model;
+        glm::mat4 transform;
+        float time, speed;
+        size_t palette;
+    };
+
+    std::vector<Character> characters;
+    std::vector<glm::mat4> palettes;
+
+    // created by the first Draw, animating alone needs no context
+    mutable unsigned int paletteBuffer, paletteTexture;
+    mutable size_t maxPaletteMatrices;
+
+    unsigned int window;
+    std::vector<float> updateMilliseconds;
+    size_t nextUpdate;
+};
+
+// Animates count characters of a synthetic 64 bone skeleton on one thread and on the job system and skins a mesh on
+// the CPU against a plain glm version, printing the timings and the largest difference
+void BenchmarkAnimation(std::ostream &out, unsigned int count);
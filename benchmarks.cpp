@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "animation.hpp"
+#include "cpu_profiler.hpp"
+#include "environment_lighting.hpp"
+#include "job_system.hpp"
+#include "normal_matrix.hpp"
+#include "scene_file.hpp"
+#include "scene_systems.hpp"
+#include "transform.hpp"
+
+// CPU benchmarks of the renderer's systems, and the tool writing the example world. None of them needs a context:
+//   benchmarks transforms N     composes N transforms on the CPU and prints the rates.
+//   benchmarks scene N          does the same for the scene systems, over scenes of up to N renderables.
+//   benchmarks jobs N           times N element workloads on the job system from one thread up to every core.
+//   benchmarks animation N      samples and builds the palettes of N characters of a synthetic skeleton, on one
+//                               thread and on every core, and checks SSE sampling and CPU skinning against glm.
+//   benchmarks environment N    bakes the procedural sky into N sized prefiltered faces on one thread and on every
+//                               core, and prints the time of every stage and how close a white environment comes out
+//                               to white.
+//   benchmarks normals N        computes the normal matrices of N transforms with glm, per object and four at a time
+//                               with SSE, and prints the rates and the largest difference to glm.
+//   benchmarks write-world file N   writes an example world of N cubes for learn_opengl --world.
+int main(int argc, char **argv) {
+    PROFILE_THREAD("main");
+
+    std::string command = argc > 1 ? argv[1] : "";
+    unsigned int count = argc > 2 ? (unsigned int) std::max(1, std::atoi(argv[2])) : 0;
+
+    if (command == "transforms" && count) {
+        BenchmarkTransforms(std::cout, count);
+    } else if (command == "scene" && count) {
+        BenchmarkScene(std::cout, count);
+    } else if (command == "jobs" && count) {
+        BenchmarkJobs(std::cout, count);
+    } else if (command == "animation" && count) {
+        BenchmarkAnimation(std::cout, count);
+    } else if (command == "environment" && count) {
+        BenchmarkEnvironmentBake(std::cout, count);
+    } else if (command == "normals" && count) {
+        BenchmarkNormalMatrices(std::cout, count);
+    } else if (command == "write-world" && argc > 3) {
+        return WriteExampleWorld(argv[2], (unsigned int) std::max(1, std::atoi(argv[3]))) ? 0 : -1;
+    } else {
+        std::cout << "ERROR::BENCHMARKS::UNKNOWN_COMMAND " << command << std::endl;
+        return -1;
+    }
+    return 0;
+}
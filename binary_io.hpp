@@ -0,0 +1,17 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+// Plain values written and read byte for byte as they are in memory, shared by the scene files and the environment
+// cache. Neither is meant to move between machines of different byte order
+
+template <typename T>
+void WriteValue(std::ostream &file, const T &value) {
+    file.write((const char *) &value, sizeof(T));
+}
+
+template <typename T>
+bool ReadValue(std::istream &file, T &value) {
+    return (bool) file.read((char *) &value, sizeof(T));
+}
@@ -28,6 +28,10 @@ glm::mat4 Camera::GetViewMatrix() {
     return lookAt(Position, Position + Front, Up);
 }
 
+glm::mat4 Camera::GetViewMatrix(const glm::vec3 &position) {
+    return lookAt(position, position + Front, Up);
+}
+
 void Camera::ProcessKeyboard(Camera_Movement direction, float deltaTime) {
     float velocity = MovementSpeed * deltaTime;
     if (direction == FORWARD)
@@ -44,6 +48,12 @@ void Camera::ProcessKeyboard(Camera_Movement direction, float deltaTime) {
         Position -= WorldUp * velocity;
 }
 
+void Camera::SetOrientation(float yaw, float pitch) {
+    Yaw = yaw;
+    Pitch = pitch;
+    updateCameraVectors();
+}
+
 void Camera::ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch) {
     xoffset *= MouseSensitivity;
     yoffset *= MouseSensitivity;
@@ -84,6 +94,19 @@ void Camera::updateCameraVectors() {
     Up = glm::normalize(glm::cross(Right, Front));
 }
 
+void FrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    for (int i = 0; i < 3; i++) {
+        planes[i * 2] = rows[3] + rows[i];
+        planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
 glm::mat4 lookAt(glm::vec3 pos, glm::vec3 target, glm::vec3 world_up) {
     // This holds true because [target = pos + front]
     glm::vec3 front = glm::normalize(target - pos);
@@ -46,6 +46,12 @@ public:
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
     glm::mat4 GetViewMatrix();
 
+    // the same view, seen from another position, like one interpolated between simulation steps
+    glm::mat4 GetViewMatrix(const glm::vec3 &position);
+
+    // points the camera along the given Euler angles, in degrees
+    void SetOrientation(float yaw, float pitch);
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime);
 
@@ -59,3 +65,6 @@ private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors();
 };
+
+// world space planes of the frustum of viewProjection, normals pointing inwards: left, right, bottom, top, near, far
+void FrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]);
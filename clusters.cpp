@@ -0,0 +1,239 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+#include "clusters.hpp"
+#include "cpu_profiler.hpp"
+#include "job_system.hpp"
+
+// Below this many lights the binning is cheaper than handing it out as jobs
+const unsigned int PARALLEL_BINNING_THRESHOLD = 256;
+
+// Transforms the light positions into view space four at a time, writing one array per component
+void transformPositions(const std::vector<Light> &lights, const glm::mat4 &m, float *outX, float *outY, float *outZ) {
+    size_t count = lights.size();
+    size_t i = 0;
+
+    // glm is column major, so m[column][row]
+    const __m128 m00 = _mm_set1_ps(m[0][0]), m01 = _mm_set1_ps(m[0][1]), m02 = _mm_set1_ps(m[0][2]);
+    const __m128 m10 = _mm_set1_ps(m[1][0]), m11 = _mm_set1_ps(m[1][1]), m12 = _mm_set1_ps(m[1][2]);
+    const __m128 m20 = _mm_set1_ps(m[2][0]), m21 = _mm_set1_ps(m[2][1]), m22 = _mm_set1_ps(m[2][2]);
+    const __m128 m30 = _mm_set1_ps(m[3][0]), m31 = _mm_set1_ps(m[3][1]), m32 = _mm_set1_ps(m[3][2]);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_set_ps(lights[i + 3].position.x, lights[i + 2].position.x,
+                              lights[i + 1].position.x, lights[i].position.x);
+        __m128 y = _mm_set_ps(lights[i + 3].position.y, lights[i + 2].position.y,
+                              lights[i + 1].position.y, lights[i].position.y);
+        __m128 z = _mm_set_ps(lights[i + 3].position.z, lights[i + 2].position.z,
+                              lights[i + 1].position.z, lights[i].position.z);
+
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_add_ps(_mm_mul_ps(z, m20), m30));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_add_ps(_mm_mul_ps(z, m21), m31));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_add_ps(_mm_mul_ps(z, m22), m32));
+
+        _mm_storeu_ps(outX + i, rx);
+        _mm_storeu_ps(outY + i, ry);
+        _mm_storeu_ps(outZ + i, rz);
+    }
+
+    // leftovers that don't fill a whole register
+    for (; i < count; i++) {
+        glm::vec4 p = m * glm::vec4(lights[i].position, 1.0f);
+        outX[i] = p.x;
+        outY[i] = p.y;
+        outZ[i] = p.z;
+    }
+}
+
+unsigned int createTextureBuffer(unsigned int buffer, GLenum format) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+// Replaces the content of the buffer, orphaning the old storage so that the driver doesn't wait on draws using it
+void uploadTextureBuffer(unsigned int buffer, const void *data, size_t size, size_t minSize) {
+    static const char zeros[16] = {};
+
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (size == 0) {
+        // a texture buffer needs some storage behind it even when there's nothing to read
+        glBufferData(GL_TEXTURE_BUFFER, minSize, zeros, GL_STREAM_DRAW);
+    } else {
+        glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusterGrid::ClusterGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slicesZ,
+                         unsigned int maxLightsPerCluster) : tilesX(tilesX), tilesY(tilesY), slicesZ(slicesZ),
+                                                             maxLightsPerCluster(maxLightsPerCluster),
+                                                             near(0.1f), far(100.0f) {
+    unsigned int clusterCount = tilesX * tilesY * slicesZ;
+    scratch.resize(clusterCount * maxLightsPerCluster);
+    scratchCounts.resize(clusterCount);
+    grid.resize(clusterCount * 2);
+
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+
+    uploadTextureBuffer(lightBuffer, nullptr, 0, 16);
+    uploadTextureBuffer(gridBuffer, nullptr, 0, 8);
+    uploadTextureBuffer(indexBuffer, nullptr, 0, 2);
+
+    lightTexture = createTextureBuffer(lightBuffer, GL_RGBA32F);
+    gridTexture = createTextureBuffer(gridBuffer, GL_RG32UI);
+    indexTexture = createTextureBuffer(indexBuffer, GL_R16UI);
+}
+
+ClusterGrid::~ClusterGrid() {
+    glDeleteTextures(1, &lightTexture);
+    glDeleteTextures(1, &gridTexture);
+    glDeleteTextures(1, &indexTexture);
+
+    glDeleteBuffers(1, &lightBuffer);
+    glDeleteBuffers(1, &gridBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+void ClusterGrid::Update(const std::vector<Light> &lights, const glm::mat4 &view, float fovy, float ratio, float near,
+                         float far) {
+    PROFILE_SCOPE("ClusterGrid::Update");
+    this->near = near;
+    this->far = far;
+
+    size_t lightCount = std::min<size_t>(lights.size(), MAX_CLUSTERED_LIGHTS);
+
+    viewX.resize(lights.size());
+    viewY.resize(lights.size());
+    viewZ.resize(lights.size());
+    transformPositions(lights, view, viewX.data(), viewY.data(), viewZ.data());
+
+    std::fill(scratchCounts.begin(), scratchCounts.end(), 0);
+
+    float tanHalfY = std::tan(glm::radians(fovy) * 0.5f);
+    float tanHalfX = tanHalfY * ratio;
+
+    // every job owns a contiguous range of depth slices, so the clusters they write never overlap
+    if (lightCount >= PARALLEL_BINNING_THRESHOLD) {
+        JobSystem::Instance().ParallelFor(slicesZ, 1, [&](size_t first, size_t last) {
+            binSlices(lights, (unsigned int) first, (unsigned int) last, tanHalfX, tanHalfY);
+        });
+    } else {
+        binSlices(lights, 0, slicesZ, tanHalfX, tanHalfY);
+    }
+
+    // compact the fixed capacity lists into one contiguous index list
+    indices.clear();
+    unsigned int clusterCount = tilesX * tilesY * slicesZ;
+    for (unsigned int c = 0; c < clusterCount; c++) {
+        unsigned int count = scratchCounts[c];
+        grid[c * 2] = (unsigned int) indices.size();
+        grid[c * 2 + 1] = count;
+        const unsigned short *list = &scratch[c * maxLightsPerCluster];
+        indices.insert(indices.end(), list, list + count);
+    }
+
+    // three texels per light: (position, radius), (color, cosInner), (direction, cosOuter)
+    std::vector<glm::vec4> lightData(lightCount * 3);
+    for (size_t i = 0; i < lightCount; i++) {
+        lightData[i * 3] = glm::vec4(lights[i].position, lights[i].radius);
+        lightData[i * 3 + 1] = glm::vec4(lights[i].color, lights[i].cosInner);
+        lightData[i * 3 + 2] = glm::vec4(lights[i].direction, lights[i].cosOuter);
+    }
+
+    uploadTextureBuffer(lightBuffer, lightData.data(), lightData.size() * sizeof(glm::vec4), 16);
+    uploadTextureBuffer(gridBuffer, grid.data(), grid.size() * sizeof(unsigned int), 8);
+    uploadTextureBuffer(indexBuffer, indices.data(), indices.size() * sizeof(unsigned short), 2);
+}
+
+void ClusterGrid::binSlices(const std::vector<Light> &lights, unsigned int firstSlice, unsigned int lastSlice,
+                            float tanHalfX, float tanHalfY) {
+    PROFILE_SCOPE("ClusterGrid::binSlices");
+    size_t lightCount = std::min<size_t>(lights.size(), MAX_CLUSTERED_LIGHTS);
+    float logRatio = std::log(far / near);
+
+    auto sliceOf = [&](float depth) {
+        int slice = (int) std::floor(std::log(depth / near) / logRatio * (float) slicesZ);
+        return (unsigned int) std::clamp(slice, 0, (int) slicesZ - 1);
+    };
+    auto sliceDepth = [&](unsigned int slice) {
+        return near * std::pow(far / near, (float) slice / (float) slicesZ);
+    };
+    auto tileOf = [](float ndc, unsigned int tiles) {
+        int tile = (int) std::floor((ndc * 0.5f + 0.5f) * (float) tiles);
+        return (unsigned int) std::clamp(tile, 0, (int) tiles - 1);
+    };
+
+    for (size_t i = 0; i < lightCount; i++) {
+        float radius = lights[i].radius;
+        // the camera looks down -Z
+        float depth = -viewZ[i];
+
+        float zNear = std::max(depth - radius, near);
+        float zFar = std::min(depth + radius, far);
+        if (zNear > zFar)
+            continue;
+
+        unsigned int sliceA = std::max(sliceOf(zNear), firstSlice);
+        unsigned int sliceB = std::min(sliceOf(zFar), lastSlice - 1);
+
+        for (unsigned int s = sliceA; s <= sliceB; s++) {
+            float d0 = std::max(zNear, sliceDepth(s));
+            float d1 = std::min(zFar, sliceDepth(s + 1));
+
+            // x / depth is monotonic in depth, so looking at the two depth extremes of the sphere's box within the
+            // slice gives a conservative screen rectangle
+            float left = viewX[i] - radius, right = viewX[i] + radius;
+            float bottom = viewY[i] - radius, top = viewY[i] + radius;
+            float x0 = std::min(left / (d0 * tanHalfX), left / (d1 * tanHalfX));
+            float x1 = std::max(right / (d0 * tanHalfX), right / (d1 * tanHalfX));
+            float y0 = std::min(bottom / (d0 * tanHalfY), bottom / (d1 * tanHalfY));
+            float y1 = std::max(top / (d0 * tanHalfY), top / (d1 * tanHalfY));
+
+            if (x1 < -1.0f || x0 > 1.0f || y1 < -1.0f || y0 > 1.0f)
+                continue;
+
+            unsigned int tx0 = tileOf(x0, tilesX), tx1 = tileOf(x1, tilesX);
+            unsigned int ty0 = tileOf(y0, tilesY), ty1 = tileOf(y1, tilesY);
+
+            for (unsigned int ty = ty0; ty <= ty1; ty++) {
+                for (unsigned int tx = tx0; tx <= tx1; tx++) {
+                    unsigned int cluster = (s * tilesY + ty) * tilesX + tx;
+                    unsigned int &count = scratchCounts[cluster];
+                    if (count < maxLightsPerCluster)
+                        scratch[cluster * maxLightsPerCluster + count++] = (unsigned short) i;
+                }
+            }
+        }
+    }
+}
+
+void ClusterGrid::Bind(const Shader &shader, unsigned int firstUnit, float viewportWidth, float viewportHeight) const {
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+    shader.setInt("lightData", (int) firstUnit);
+
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+    shader.setInt("clusterGrid", (int) firstUnit + 1);
+
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    shader.setInt("clusterIndices", (int) firstUnit + 2);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    // slice = log(depth) * scale + bias, the inverse of the exponential split used for binning
+    float logRatio = std::log(far / near);
+    shader.setIVec3("clusterDims", glm::ivec3(tilesX, tilesY, slicesZ));
+    shader.setVec2("clusterTileSize", glm::vec2(viewportWidth / (float) tilesX, viewportHeight / (float) tilesY));
+    shader.setFloat("clusterSliceScale", (float) slicesZ / logRatio);
+    shader.setFloat("clusterSliceBias", -(float) slicesZ * std::log(near) / logRatio);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "shader.hpp"
+
+// A dynamic light with a finite range. Point lights leave cosOuter at -1, spot lights narrow it down to their cone
+struct Light {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float cosInner;
+    glm::vec3 direction;
+    float cosOuter;
+};
+
+// Light count is capped so that per-cluster indices fit in 16 bits
+const unsigned int MAX_CLUSTERED_LIGHTS = 65535;
+
+// Splits the view frustum into a grid of screen tiles and exponential depth slices, then stores for each cluster the
+// list of lights that may touch it. The lists are uploaded into texture buffers so that the fragment shader only has
+// to loop over the lights of the cluster the fragment falls in
+class ClusterGrid {
+public:
+    ClusterGrid(unsigned int tilesX = 16, unsigned int tilesY = 9, unsigned int slicesZ = 24,
+                unsigned int maxLightsPerCluster = 256);
+    ~ClusterGrid();
+
+    ClusterGrid(const ClusterGrid &) = delete;
+    ClusterGrid &operator=(const ClusterGrid &) = delete;
+
+    // assigns the lights to clusters for the given camera and uploads the light data and the per-cluster lists
+    void Update(const std::vector<Light> &lights, const glm::mat4 &view, float fovy, float ratio, float near, float far);
+
+    // binds the three texture buffers starting at the given texture unit and sets the uniforms the shader reads
+    void Bind(const Shader &shader, unsigned int firstUnit, float viewportWidth, float viewportHeight) const;
+
+    // total number of light references stored across all clusters during the last update
+    unsigned int IndexCount() const { return (unsigned int) indices.size(); }
+
+private:
+    unsigned int tilesX, tilesY, slicesZ;
+    unsigned int maxLightsPerCluster;
+    float near, far;
+
+    // light positions in view space, one array per component so the transform can run four lights at a time
+    std::vector<float> viewX, viewY, viewZ;
+
+    // fixed capacity scratch lists written by the binning workers, one slot range per cluster
+    std::vector<unsigned short> scratch;
+    std::vector<unsigned int> scratchCounts;
+
+    // compacted result: (offset, count) per cluster and the flattened light index lists
+    std::vector<unsigned int> grid;
+    std::vector<unsigned short> indices;
+
+    unsigned int lightBuffer, gridBuffer, indexBuffer;
+    unsigned int lightTexture, gridTexture, indexTexture;
+
+    void binSlices(const std::vector<Light> &lights, unsigned int firstSlice, unsigned int lastSlice,
+                   float tanHalfX, float tanHalfY);
+};
@@ -0,0 +1,172 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+
+#include "command_list.hpp"
+#include "cpu_profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "job_system.hpp"
+
+// Below this many draws a partition isn't worth a job of its own
+const size_t DRAWS_PER_PARTITION = 256;
+
+void CommandList::Clear() {
+    commands.clear();
+    data.clear();
+    program = diffuse = specular = ~0u;
+}
+
+void CommandList::BindProgram(unsigned int program) {
+    if (program == this->program)
+        return;
+    this->program = program;
+    diffuse = specular = ~0u;
+    commands.push_back({COMMAND_BIND_PROGRAM, program, 0, 0});
+}
+
+void CommandList::BindMaterial(unsigned int diffuse, unsigned int specular) {
+    if (diffuse == this->diffuse && specular == this->specular)
+        return;
+    this->diffuse = diffuse;
+    this->specular = specular;
+    commands.push_back({COMMAND_BIND_MATERIAL, diffuse, specular, 0});
+}
+
+void CommandList::SetDrawData(const glm::mat4 &model, const glm::mat3 &normalMatrix) {
+    commands.push_back({COMMAND_DRAW_DATA, (uint32_t) data.size(), 0, 0});
+    data.push_back({model, normalMatrix});
+}
+
+void CommandList::DrawIndexed(unsigned int vertexArray, unsigned int count) {
+    commands.push_back({COMMAND_DRAW_INDEXED, vertexArray, count, 0});
+}
+
+CommandRenderer::CommandRenderer(unsigned int window)
+        : enabled(true), listCount(0), window(window), nextRecord(0), nextReplay(0), nextDirect(0), commandCount(0),
+          drawCount(0) {
+}
+
+void CommandRenderer::Record(const std::vector<OpaqueDraw> &draws, const Shader &shader) {
+    PROFILE_SCOPE("CommandRenderer::Record");
+    auto start = std::chrono::steady_clock::now();
+
+    // models shared between partitions have to be settled before the threads read them
+    for (const OpaqueDraw &draw : draws) {
+        if (draw.model->NodesDirty())
+            draw.model->UpdateNodes();
+    }
+
+    JobSystem &jobs = JobSystem::Instance();
+    listCount = std::max<size_t>(1, std::min<size_t>(jobs.Threads() * 4,
+                                                     (draws.size() + DRAWS_PER_PARTITION - 1) / DRAWS_PER_PARTITION));
+    if (lists.size() < listCount)
+        lists.resize(listCount);
+
+    // partition p is the draws [p * n / listCount, (p + 1) * n / listCount), the lists replay in draw order
+    jobs.ParallelFor(listCount, 1, [&](size_t first, size_t last) {
+        PROFILE_SCOPE("record commands");
+        for (size_t p = first; p < last; p++) {
+            CommandList &list = lists[p];
+            list.Clear();
+            list.BindProgram(shader.ID);
+            size_t begin = p * draws.size() / listCount, end = (p + 1) * draws.size() / listCount;
+            for (size_t i = begin; i < end; i++)
+                draws[i].model->Record(list, draws[i].transform);
+        }
+    });
+
+    commandCount = 0;
+    for (size_t p = 0; p < listCount; p++)
+        commandCount += lists[p].Commands().size();
+    drawCount = draws.size();
+
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RecordSample(recordMilliseconds, nextRecord, window, milliseconds);
+}
+
+void CommandRenderer::Replay() {
+    PROFILE_SCOPE("CommandRenderer::Replay");
+    auto start = std::chrono::steady_clock::now();
+
+    // whatever ran before may have bound anything, so nothing is assumed about the state going in
+    unsigned int program = ~0u, diffuse = ~0u, specular = ~0u;
+    Locations current = {-1, -1, -1, -1};
+    for (size_t p = 0; p < listCount; p++) {
+        const CommandList &list = lists[p];
+        const DrawData *data = list.Data().data();
+        for (const Command &command : list.Commands()) {
+            switch (command.type) {
+                case COMMAND_BIND_PROGRAM: {
+                    if (command.a == program)
+                        break;
+                    program = command.a;
+                    glUseProgram(program);
+                    auto found = locations.find(program);
+                    if (found == locations.end()) {
+                        Locations added = {glGetUniformLocation(program, "model"),
+                                           glGetUniformLocation(program, "normalMatrix"),
+                                           glGetUniformLocation(program, "material.texture_diffuse1"),
+                                           glGetUniformLocation(program, "material.texture_specular1")};
+                        found = locations.emplace(program, added).first;
+                        // samplers are program state, and everything else drawing with the program binds the
+                        // material to the same units
+                        glUniform1i(added.diffuse, 0);
+                        glUniform1i(added.specular, 1);
+                    }
+                    current = found->second;
+                    break;
+                }
+                case COMMAND_BIND_MATERIAL:
+                    if (command.a && command.a != diffuse) {
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, command.a);
+                        diffuse = command.a;
+                    }
+                    if (command.b && command.b != specular) {
+                        glActiveTexture(GL_TEXTURE1);
+                        glBindTexture(GL_TEXTURE_2D, command.b);
+                        specular = command.b;
+                    }
+                    break;
+                case COMMAND_DRAW_DATA:
+                    glUniformMatrix4fv(current.model, 1, GL_FALSE, &data[command.a].model[0][0]);
+                    glUniformMatrix3fv(current.normalMatrix, 1, GL_FALSE, &data[command.a].normalMatrix[0][0]);
+                    break;
+                case COMMAND_DRAW_INDEXED:
+                    glBindVertexArray(command.a);
+                    glDrawElements(GL_TRIANGLES, (GLsizei) command.b, GL_UNSIGNED_INT, 0);
+                    break;
+            }
+        }
+    }
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RecordSample(replayMilliseconds, nextReplay, window, milliseconds);
+}
+
+void CommandRenderer::DrawDirect(const std::vector<OpaqueDraw> &draws, Shader &shader) {
+    PROFILE_SCOPE("CommandRenderer::DrawDirect");
+    auto start = std::chrono::steady_clock::now();
+    for (const OpaqueDraw &draw : draws)
+        draw.model->Draw(shader, draw.transform);
+    drawCount = draws.size();
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RecordSample(directMilliseconds, nextDirect, window, milliseconds);
+}
+
+void CommandRenderer::Report(std::ostream &out) const {
+    out << "Opaque draws: " << drawCount << " per frame, " << (enabled ? "command lists" : "direct") << std::endl;
+    if (!recordMilliseconds.empty()) {
+        out << "  command lists: record " << average(recordMilliseconds) << " ms avg, "
+            << percentile(recordMilliseconds, 0.99f) << " ms p99 on " << JobSystem::Instance().Threads()
+            << " threads, replay " << average(replayMilliseconds) << " ms avg, "
+            << percentile(replayMilliseconds, 0.99f) << " ms p99, " << commandCount << " commands in " << listCount
+            << " lists" << std::endl;
+    }
+    if (!directMilliseconds.empty()) {
+        out << "  direct: " << average(directMilliseconds) << " ms avg, " << percentile(directMilliseconds, 0.99f)
+            << " ms p99" << std::endl;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "depth_prepass.hpp"
+#include "shader.hpp"
+
+enum CommandType : uint32_t {
+    COMMAND_BIND_PROGRAM,
+    COMMAND_BIND_MATERIAL,
+    COMMAND_DRAW_DATA,
+    COMMAND_DRAW_INDEXED
+};
+
+// A recorded command, plain data holding only handles so any thread can write it. The arguments by type:
+//   BIND_PROGRAM   a program
+//   BIND_MATERIAL  a diffuse texture, b specular texture, 0 leaves the unit as it is
+//   DRAW_DATA      a offset of the DrawData the following draws use, in the list they were recorded into
+//   DRAW_INDEXED   a vertex array, b index count
+struct Command {
+    CommandType type;
+    uint32_t a, b, c;
+};
+
+// what changes from draw to draw besides the material
+struct DrawData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+// Commands for one partition of a pass, recorded by one thread. Binds repeating the one before are dropped as they
+// are recorded
+class CommandList {
+public:
+    void Clear();
+
+    void BindProgram(unsigned int program);
+    void BindMaterial(unsigned int diffuse, unsigned int specular);
+    void SetDrawData(const glm::mat4 &model, const glm::mat3 &normalMatrix);
+    void DrawIndexed(unsigned int vertexArray, unsigned int count);
+
+    const std::vector<Command> &Commands() const { return commands; }
+    const std::vector<DrawData> &Data() const { return data; }
+
+private:
+    std::vector<Command> commands;
+    std::vector<DrawData> data;
+    // last bound, ~0 for nothing yet
+    uint32_t program = ~0u, diffuse = ~0u, specular = ~0u;
+};
+
+// Records the opaque draws of a frame into command lists on the job system, one list per partition of the draws, and
+// replays them on the GL thread. Recording does everything that needs no context, walking the model nodes and
+// computing the normal matrices; the replay is a loop over the commands with the uniform locations looked up once per
+// program and redundant binds skipped across lists too.
+//
+// The direct path through Model::Draw is kept for comparison, both are timed
+class CommandRenderer {
+public:
+    explicit CommandRenderer(unsigned int window = 240);
+
+    void SetEnabled(bool enabled) { this->enabled = enabled; }
+    bool Enabled() const { return enabled; }
+
+    // any thread that may wait on the job system, the models must not change until the replay
+    void Record(const std::vector<OpaqueDraw> &draws, const Shader &shader);
+    // GL thread, with the shader's other uniforms set
+    void Replay();
+
+    // the path commands replace, draws every model on the calling thread
+    void DrawDirect(const std::vector<OpaqueDraw> &draws, Shader &shader);
+
+    // milliseconds spent recording, replaying and drawing directly, and the commands per frame
+    void Report(std::ostream &out) const;
+
+private:
+    struct Locations {
+        int model, normalMatrix;
+        int diffuse, specular;
+    };
+
+    bool enabled;
+    std::vector<CommandList> lists;
+    size_t listCount;
+    std::unordered_map<unsigned int, Locations> locations;
+
+    unsigned int window;
+    std::vector<float> recordMilliseconds, replayMilliseconds, directMilliseconds;
+    size_t nextRecord, nextReplay, nextDirect;
+    size_t commandCount, drawCount;
+};
@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+
+#include "compressed_clip.hpp"
+
+// the three smallest components of a unit quaternion lie within this of zero
+const float SMALLEST_THREE_RANGE = 0.70710678f;
+
+static size_t evenUp(size_t bytes) {
+    return (bytes + 1) & ~(size_t) 1;
+}
+
+static void encodeRotation(glm::quat q, uint16_t out[3]) {
+    float c[4] = {q.x, q.y, q.z, q.w};
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        largest = std::fabs(c[i]) > std::fabs(c[largest]) ? i : largest;
+    // the dropped component is rebuilt as positive, so the stored ones take the sign that makes it so
+    float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+    int o = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest)
+            continue;
+        float unit = glm::clamp(c[i] * sign / SMALLEST_THREE_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+        out[o++] = (uint16_t) std::lround(unit * 32767.0f);
+    }
+    out[0] |= (uint16_t) ((largest & 1) << 15);
+    out[1] |= (uint16_t) ((largest >> 1) << 15);
+}
+
+// writes the four components stride floats apart, so a sample can decode straight into a KeyBlock lane
+static void decodeRotation(const uint16_t in[3], float *out, size_t stride = 1) {
+    const float scale = 2.0f * SMALLEST_THREE_RANGE / 32767.0f;
+    int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+    float sum = 0.0f;
+    int o = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest)
+            continue;
+        float c = (float) (in[o++] & 0x7fff) * scale - SMALLEST_THREE_RANGE;
+        out[i * stride] = c;
+        sum += c * c;
+    }
+    out[largest * stride] = std::sqrt(std::max(0.0f, 1.0f - sum));
+}
+
+static void encodeVector(const glm::vec3 &v, const float base[4], const float step[3], uint16_t out[3]) {
+    for (int c = 0; c < 3; c++) {
+        float steps = step[c] > 0.0f ? (v[c] - base[c]) / step[c] : 0.0f;
+        out[c] = (uint16_t) glm::clamp(std::lround(steps), 0L, 65535L);
+    }
+}
+
+static void decodeVector(const uint16_t in[3], const float base[4], const float step[3], float *out,
+                         size_t stride = 1) {
+    for (int c = 0; c < 3; c++)
+        out[c * stride] = base[c] + (float) in[c] * step[c];
+}
+
+// raw keys are floats split into 16 bit words, copied since the words are only two byte aligned
+static void encodeRaw(const float *in, size_t components, uint16_t *out) {
+    std::memcpy(out, in, components * sizeof(float));
+}
+
+static void decodeRaw(const uint16_t *in, size_t components, float *out, size_t stride = 1) {
+    for (size_t c = 0; c < components; c++)
+        std::memcpy(&out[c * stride], in + c * 2, sizeof(float));
+}
+
+// words a key of the track takes in a segment's values
+static size_t keyWords(bool rotation, bool raw) {
+    return raw ? (rotation ? 8 : 6) : 3;
+}
+
+// the key before local and the one after it among a track's count key frames, and how far local is between them
+static unsigned int findKey(const uint8_t *keyFrames, unsigned int count, float local, float &t) {
+    unsigned int k = 0;
+    while (k + 2 < count && keyFrames[k + 1] <= local)
+        k++;
+    t = count > 1 ? glm::clamp((local - keyFrames[k]) / (float) (keyFrames[k + 1] - keyFrames[k]), 0.0f, 1.0f)
+                  : 0.0f;
+    return k;
+}
+
+// the angle between two rotations, through atan2 because acos of a dot product near one loses small angles to
+// rounding
+static float rotationError(const glm::quat &a, const glm::quat &b) {
+    glm::quat d = glm::conjugate(a) * b;
+    return 2.0f * std::atan2(glm::length(glm::vec3(d.x, d.y, d.z)), std::fabs(d.w));
+}
+
+static glm::quat nlerp(const glm::quat &a, glm::quat b, float t) {
+    if (glm::dot(a, b) < 0.0f)
+        b = -b;
+    return glm::normalize(a * (1.0f - t) + b * t);
+}
+
+size_t RawClipBytes(const AnimationClip &clip) {
+    size_t bytes = 0;
+    for (const AnimationChannel &channel : clip.channels) {
+        bytes += (channel.positionTimes.size() + channel.rotationTimes.size() + channel.scaleTimes.size()) *
+                 sizeof(float);
+        bytes += channel.positions.size() * sizeof(glm::vec3) + channel.rotations.size() * sizeof(glm::quat) +
+                 channel.scales.size() * sizeof(glm::vec3);
+    }
+    return bytes;
+}
+
+bool CompressedClip::Compress(const AnimationClip &clip, const ClipCompressionSettings &settings) {
+    if (settings.segmentFrames < 1 || settings.segmentFrames > 255 || settings.frameRate <= 0.0f) {
+        std::cout << "ERROR::COMPRESSED_CLIP::BAD_SETTINGS" << std::endl;
+        return false;
+    }
+
+    name = clip.name;
+    duration = std::max(0.0f, clip.duration);
+    frameRate = settings.frameRate;
+    segmentFrames = settings.segmentFrames;
+    frameCount = duration > 0.0f ? (unsigned int) std::ceil(duration * frameRate) + 1 : 1;
+
+    // every channel at every frame, the last frame falls on the end of the clip
+    size_t channels = clip.channels.size();
+    std::vector<Transform> frames(channels * frameCount);
+    for (size_t c = 0; c < channels; c++) {
+        for (unsigned int f = 0; f < frameCount; f++) {
+            float time = frameCount > 1 ? (float) f * duration / (float) (frameCount - 1) : 0.0f;
+            frames[c * frameCount + f] = SampleChannel(clip.channels[c], time);
+        }
+    }
+
+    nodes.clear();
+    tracks.assign(channels * 3, Track());
+    animatedTracks = 0;
+    const float tolerance[3] = {settings.positionTolerance, settings.rotationTolerance, settings.scaleTolerance};
+    for (size_t c = 0; c < channels; c++) {
+        nodes.push_back(clip.channels[c].node);
+        const Transform *channel = &frames[c * frameCount];
+        for (int kind = 0; kind < 3; kind++) {
+            Track &track = tracks[c * 3 + kind];
+            track.constant = true;
+            track.raw = false;
+            glm::vec3 low(0.0f), high(0.0f);
+            for (unsigned int f = 0; f < frameCount; f++) {
+                float error;
+                if (kind == TRACK_ROTATION) {
+                    error = rotationError(channel[f].rotation, channel[0].rotation);
+                } else {
+                    const glm::vec3 &v = kind == TRACK_POSITION ? channel[f].position : channel[f].scale;
+                    const glm::vec3 &first = kind == TRACK_POSITION ? channel[0].position : channel[0].scale;
+                    error = glm::length(v - first);
+                    low = f == 0 ? v : glm::min(low, v);
+                    high = f == 0 ? v : glm::max(high, v);
+                }
+                track.constant = track.constant && error <= tolerance[kind];
+            }
+
+            if (track.constant || kind == TRACK_ROTATION) {
+                const glm::quat &q = channel[0].rotation;
+                const glm::vec3 &v = kind == TRACK_POSITION ? channel[0].position : channel[0].scale;
+                if (kind == TRACK_ROTATION) {
+                    track.base[0] = q.x;
+                    track.base[1] = q.y;
+                    track.base[2] = q.z;
+                    track.base[3] = q.w;
+                } else {
+                    track.base[0] = v.x;
+                    track.base[1] = v.y;
+                    track.base[2] = v.z;
+                    track.base[3] = 0.0f;
+                }
+                track.step[0] = track.step[1] = track.step[2] = 0.0f;
+            } else {
+                for (int i = 0; i < 3; i++) {
+                    track.base[i] = low[i];
+                    track.step[i] = (high[i] - low[i]) / 65535.0f;
+                }
+                track.base[3] = 0.0f;
+            }
+            animatedTracks += !track.constant;
+        }
+    }
+
+    // the quantized frames decoded again, which is what sampling will see, so key removal measures the whole error
+    std::vector<uint16_t> quantized(frames.size() * 3 * 3);
+    std::vector<Transform> decoded(frames.size());
+    for (size_t c = 0; c < channels; c++) {
+        for (unsigned int f = 0; f < frameCount; f++) {
+            size_t i = c * frameCount + f;
+            uint16_t *q = &quantized[i * 9];
+            const Track *track = &tracks[c * 3];
+            float value[4];
+            encodeVector(frames[i].position, track[TRACK_POSITION].base, track[TRACK_POSITION].step, q);
+            decodeVector(q, track[TRACK_POSITION].base, track[TRACK_POSITION].step, value);
+            decoded[i].position = glm::vec3(value[0], value[1], value[2]);
+            encodeRotation(frames[i].rotation, q + 3);
+            decodeRotation(q + 3, value);
+            decoded[i].rotation = glm::quat(value[3], value[0], value[1], value[2]);
+            encodeVector(frames[i].scale, track[TRACK_SCALE].base, track[TRACK_SCALE].step, q + 6);
+            decodeVector(q + 6, track[TRACK_SCALE].base, track[TRACK_SCALE].step, value);
+            decoded[i].scale = glm::vec3(value[0], value[1], value[2]);
+        }
+    }
+
+    // 16 bits over a long range can be coarser than the tolerance on their own, such tracks keep their floats and
+    // key removal sees them as they are
+    rawTracks = 0;
+    for (size_t c = 0; c < channels; c++) {
+        for (int kind = 0; kind < 3; kind++) {
+            Track &track = tracks[c * 3 + kind];
+            if (track.constant)
+                continue;
+            float worst = 0.0f;
+            for (unsigned int f = 0; f < frameCount; f++) {
+                const Transform &a = frames[c * frameCount + f], &b = decoded[c * frameCount + f];
+                float error = kind == TRACK_ROTATION ? rotationError(a.rotation, b.rotation)
+                            : kind == TRACK_POSITION ? glm::length(a.position - b.position)
+                            : glm::length(a.scale - b.scale);
+                worst = std::max(worst, error);
+            }
+            if (worst <= tolerance[kind])
+                continue;
+
+            track.raw = true;
+            rawTracks++;
+            for (unsigned int f = 0; f < frameCount; f++) {
+                const Transform &a = frames[c * frameCount + f];
+                Transform &b = decoded[c * frameCount + f];
+                if (kind == TRACK_ROTATION)
+                    b.rotation = a.rotation;
+                else if (kind == TRACK_POSITION)
+                    b.position = a.position;
+                else
+                    b.scale = a.scale;
+            }
+        }
+    }
+
+    // whether interpolating the decoded keys a and b reproduces every resampled frame in between and the halfway
+    // points between those, where the resampled curve is blended like sampling would
+    auto fits = [&](size_t channel, int kind, unsigned int a, unsigned int b) {
+        const Transform *raw = &frames[channel * frameCount];
+        const Transform *keys = &decoded[channel * frameCount];
+        for (unsigned int half = a * 2 + 1; half < b * 2; half++) {
+            unsigned int f = half / 2;
+            float t = ((float) half * 0.5f - (float) a) / (float) (b - a);
+            float error;
+            if (kind == TRACK_ROTATION) {
+                glm::quat expected = half & 1 ? nlerp(raw[f].rotation, raw[f + 1].rotation, 0.5f) : raw[f].rotation;
+                error = rotationError(nlerp(keys[a].rotation, keys[b].rotation, t), expected);
+            } else if (kind == TRACK_POSITION) {
+                glm::vec3 expected = half & 1 ? glm::mix(raw[f].position, raw[f + 1].position, 0.5f) : raw[f].position;
+                error = glm::length(glm::mix(keys[a].position, keys[b].position, t) - expected);
+            } else {
+                glm::vec3 expected = half & 1 ? glm::mix(raw[f].scale, raw[f + 1].scale, 0.5f) : raw[f].scale;
+                error = glm::length(glm::mix(keys[a].scale, keys[b].scale, t) - expected);
+            }
+            if (error > tolerance[kind])
+                return false;
+        }
+        return true;
+    };
+
+    segmentOffsets.clear();
+    data.clear();
+    unsigned int segmentCount = frameCount > 1 ? (frameCount - 2) / segmentFrames + 1 : 1;
+    std::vector<uint8_t> counts, keyFrames;
+    std::vector<uint16_t> values;
+    for (unsigned int s = 0; s < segmentCount; s++) {
+        unsigned int first = s * segmentFrames;
+        unsigned int last = std::min(first + segmentFrames, frameCount - 1);
+        counts.clear();
+        keyFrames.clear();
+        values.clear();
+
+        for (size_t c = 0; c < channels; c++) {
+            for (int kind = 0; kind < 3; kind++) {
+                if (tracks[c * 3 + kind].constant)
+                    continue;
+                // greedily as far from the last kept key as interpolation allows
+                std::vector<unsigned int> keys = {first};
+                while (keys.back() < last) {
+                    unsigned int to = keys.back() + 1;
+                    while (to < last && fits(c, kind, keys.back(), to + 1))
+                        to++;
+                    keys.push_back(to);
+                }
+                counts.push_back((uint8_t) keys.size());
+                for (unsigned int key : keys) {
+                    keyFrames.push_back((uint8_t) (key - first));
+                    if (tracks[c * 3 + kind].raw) {
+                        const Transform &frame = frames[c * frameCount + key];
+                        float value[4] = {frame.rotation.x, frame.rotation.y, frame.rotation.z, frame.rotation.w};
+                        if (kind != TRACK_ROTATION) {
+                            const glm::vec3 &v = kind == TRACK_POSITION ? frame.position : frame.scale;
+                            value[0] = v.x;
+                            value[1] = v.y;
+                            value[2] = v.z;
+                        }
+                        uint16_t words[8];
+                        encodeRaw(value, kind == TRACK_ROTATION ? 4 : 3, words);
+                        values.insert(values.end(), words, words + keyWords(kind == TRACK_ROTATION, true));
+                    } else {
+                        const uint16_t *q = &quantized[(c * frameCount + key) * 9 + kind * 3];
+                        values.insert(values.end(), q, q + 3);
+                    }
+                }
+            }
+        }
+
+        segmentOffsets.push_back((uint32_t) data.size());
+        data.insert(data.end(), counts.begin(), counts.end());
+        data.resize(evenUp(data.size()));
+        data.insert(data.end(), keyFrames.begin(), keyFrames.end());
+        data.resize(evenUp(data.size()));
+        segmentOffsets.push_back((uint32_t) data.size());
+        const uint8_t *bytes = (const uint8_t *) values.data();
+        data.insert(data.end(), bytes, bytes + values.size() * sizeof(uint16_t));
+    }
+    return true;
+}
+
+size_t CompressedClip::Bytes() const {
+    return data.size() + segmentOffsets.size() * sizeof(uint32_t) + tracks.size() * sizeof(Track) +
+           nodes.size() * sizeof(unsigned int);
+}
+
+void CompressedClip::Sample(float time, Transform *pose) const {
+    if (duration > 0.0f) {
+        time = std::fmod(time, duration);
+        if (time < 0.0f)
+            time += duration;
+    } else {
+        time = 0.0f;
+    }
+
+    float frame = frameCount > 1 ? time / duration * (float) (frameCount - 1) : 0.0f;
+    unsigned int segmentCount = (unsigned int) segmentOffsets.size() / 2;
+    unsigned int segment = std::min((unsigned int) (frame / (float) segmentFrames), segmentCount - 1);
+    float local = frame - (float) (segment * segmentFrames);
+
+    const uint8_t *counts = data.data() + segmentOffsets[segment * 2];
+    const uint8_t *keyFrames = counts + evenUp(animatedTracks);
+    const uint16_t *values = (const uint16_t *) (data.data() + segmentOffsets[segment * 2 + 1]);
+
+    // four lanes of a block are a float apart, one component to the next four
+    KeyBlock block;
+    const size_t channels = nodes.size();
+    for (size_t first = 0; first < channels; first += 4) {
+        size_t lanes = std::min<size_t>(4, channels - first);
+        ClearKeyBlock(block, lanes);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            const Track *track = &tracks[(first + lane) * 3];
+            // a segment's tracks have few keys, a scan over their frames beats a search
+            for (int kind = 0; kind < 3; kind++) {
+                float *keys = kind == TRACK_POSITION ? &block.position[0][0][lane]
+                            : kind == TRACK_ROTATION ? &block.rotation[0][0][lane] : &block.scale[0][0][lane];
+                float *fraction = kind == TRACK_POSITION ? block.positionT
+                                : kind == TRACK_ROTATION ? block.rotationT : block.scaleT;
+                size_t components = kind == TRACK_ROTATION ? 4 : 3;
+                if (track[kind].constant) {
+                    for (size_t c = 0; c < components; c++)
+                        keys[c * 4] = keys[(components + c) * 4] = track[kind].base[c];
+                    fraction[lane] = 0.0f;
+                    continue;
+                }
+                unsigned int count = *counts++;
+                unsigned int k = findKey(keyFrames, count, local, fraction[lane]);
+                unsigned int next = std::min(k + 1, count - 1);
+                size_t words = keyWords(kind == TRACK_ROTATION, track[kind].raw);
+                if (track[kind].raw) {
+                    decodeRaw(values + k * words, components, keys, 4);
+                    decodeRaw(values + next * words, components, keys + components * 4, 4);
+                } else if (kind == TRACK_ROTATION) {
+                    decodeRotation(values + k * 3, keys, 4);
+                    decodeRotation(values + next * 3, keys + 16, 4);
+                } else {
+                    decodeVector(values + k * 3, track[kind].base, track[kind].step, keys, 4);
+                    decodeVector(values + next * 3, track[kind].base, track[kind].step, keys + 12, 4);
+                }
+                keyFrames += count;
+                values += count * words;
+            }
+        }
+        BlendKeys(block, lanes, &nodes[first], pose);
+    }
+}
+
+void CompressedClip::Report(std::ostream &out, const AnimationClip &raw, const CompressedClip &compressed,
+                            const Skeleton &skeleton) {
+    size_t rawBytes = RawClipBytes(raw), bytes = compressed.Bytes();
+    out << "Clip " << (raw.name.empty() ? "(unnamed)" : raw.name) << ": " << raw.duration << " s, "
+        << raw.channels.size() << " channels, " << rawBytes << " bytes raw, " << bytes << " compressed ("
+        << (bytes > 0 ? (float) rawBytes / (float) bytes : 0.0f) << "x), " << compressed.rawTracks << " of "
+        << compressed.animatedTracks << " animated tracks kept as floats" << std::endl;
+
+    // every frame and halfway between them, locally and for the bone positions in model space
+    size_t nodeCount = skeleton.parents.size();
+    std::vector<Transform> expected(nodeCount), sampled(nodeCount);
+    std::vector<glm::mat4> expectedWorld(nodeCount), sampledWorld(nodeCount);
+    std::vector<glm::mat4> palette(skeleton.boneNodes.size());
+    float worstPosition = 0.0f, worstRotation = 0.0f, worstScale = 0.0f, worstBone = 0.0f;
+    unsigned int steps = std::max(1u, (compressed.frameCount - 1) * 2);
+    for (unsigned int step = 0; step < steps; step++) {
+        float time = raw.duration * (float) step / (float) steps;
+        expected = skeleton.bindPose;
+        sampled = skeleton.bindPose;
+        SampleClip(raw, time, expected.data());
+        compressed.Sample(time, sampled.data());
+        for (const AnimationChannel &channel : raw.channels) {
+            const Transform &a = expected[channel.node], &b = sampled[channel.node];
+            worstPosition = std::max(worstPosition, glm::length(a.position - b.position));
+            worstRotation = std::max(worstRotation, rotationError(a.rotation, b.rotation));
+            worstScale = std::max(worstScale, glm::length(a.scale - b.scale));
+        }
+        ComputePalette(skeleton, expected.data(), expectedWorld.data(), palette.data());
+        ComputePalette(skeleton, sampled.data(), sampledWorld.data(), palette.data());
+        for (unsigned int node : skeleton.boneNodes)
+            worstBone = std::max(worstBone, glm::length(glm::vec3(expectedWorld[node][3] - sampledWorld[node][3])));
+    }
+    out << "  largest error: position " << worstPosition << ", rotation " << worstRotation << " rad, scale "
+        << worstScale << ", bone position in model space " << worstBone << std::endl;
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> times(4096);
+    for (float &time : times)
+        time = unit(rng) * raw.duration;
+    auto microseconds = [&](const std::function<void(float)> &sample) {
+        auto start = std::chrono::steady_clock::now();
+        for (float time : times)
+            sample(time);
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+               (double) times.size();
+    };
+    double rawTime = microseconds([&](float time) { SampleClip(raw, time, expected.data()); });
+    double compressedTime = microseconds([&](float time) { compressed.Sample(time, sampled.data()); });
+    out << "  sampling: " << rawTime << " us raw, " << compressedTime << " us compressed" << std::endl;
+}
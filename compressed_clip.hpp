@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "animation.hpp"
+
+struct ClipCompressionSettings {
+    // resampling rate of every channel before keys are removed, in frames per second
+    float frameRate = 30.0f;
+    // frames per segment, at most 255 so key frames fit a byte
+    unsigned int segmentFrames = 32;
+    // largest error a removed key or the quantization may cause, in units, radians and scale factor
+    float positionTolerance = 0.001f;
+    float rotationTolerance = 0.001f;
+    float scaleTolerance = 0.001f;
+};
+
+// An AnimationClip compressed offline for playing on many characters.
+//
+// Every channel is resampled at a fixed rate, which turns key times into frame numbers. Position, rotation and scale
+// are tracks of their own; a track that stays within tolerance of its first value is stored once as a constant. The
+// rest are quantized, rotations to three 15 bit components of the smallest three with the index of the dropped one in
+// two spare bits, positions and scales to 16 bits a component over the track's range, and then keys are removed
+// while interpolating across them stays within tolerance of the resampled curve. A track whose quantization alone
+// misses the tolerance, a position moving far in small steps say, keeps its keys as floats instead.
+//
+// The frames are cut into segments that each start and end on a key of every track, so sampling never looks past its
+// segment. A segment stores the key counts of its animated tracks, then their key frames as bytes, then their
+// values, each in channel order; a sample reads one segment front to back without allocating and blends four
+// channels at a time with BlendKeys like the uncompressed SampleClip
+class CompressedClip {
+public:
+    bool Compress(const AnimationClip &clip, const ClipCompressionSettings &settings = ClipCompressionSettings());
+
+    const std::string &Name() const { return name; }
+    float Duration() const { return duration; }
+    size_t Bytes() const;
+
+    // as SampleClip
+    void Sample(float time, Transform *pose) const;
+
+    // bytes of the raw and the compressed clip, the largest error of the compressed one over every frame, locally
+    // and for the bone positions of skeleton, and the time a sample takes either way
+    static void Report(std::ostream &out, const AnimationClip &raw, const CompressedClip &compressed,
+                       const Skeleton &skeleton);
+
+private:
+    enum TrackKind : uint8_t {
+        TRACK_POSITION,
+        TRACK_ROTATION,
+        TRACK_SCALE
+    };
+
+    // constant tracks keep their value in base, animated vector tracks their range as base + quantized * step. Raw
+    // tracks store their keys as floats, two words a component
+    struct Track {
+        bool constant;
+        bool raw;
+        float base[4];
+        float step[3];
+    };
+
+    std::string name;
+    float duration = 0.0f;
+    float frameRate = 30.0f;
+    unsigned int frameCount = 1;
+    unsigned int segmentFrames = 32;
+
+    std::vector<unsigned int> nodes;
+    // three per channel, position, rotation and scale
+    std::vector<Track> tracks;
+    unsigned int animatedTracks = 0, rawTracks = 0;
+    std::vector<uint32_t> segmentOffsets;
+    std::vector<uint8_t> data;
+};
+
+// sizes of the keys and times of an uncompressed clip
+size_t RawClipBytes(const AnimationClip &clip);
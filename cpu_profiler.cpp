@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "cpu_profiler.hpp"
+
+// Frames kept around for the report and the trace export
+const size_t HISTORY_FRAMES = 300;
+// Trace thread ids start above the ones the GPU profiler uses
+const unsigned int FIRST_THREAD_ID = 10;
+
+CpuProfiler &CpuProfiler::Instance() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+double CpuProfiler::NowMicroseconds() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+CpuProfiler::CpuProfiler() : frame(0), firstFrameBegin(0.0), droppedEvents(0), ticksPerMicrosecond(1000.0) {
+    anchorMicroseconds = NowMicroseconds();
+    anchorTicks = ProfilerTicks();
+    load = {0, 0.0, {}};
+}
+
+CpuThreadBuffer *CpuProfiler::RegisterThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // threads come and go (the capture encoder, the streamer's readers, the benchmark's short-lived job systems),
+    // reuse the rings of the ones that exited
+    for (std::unique_ptr<CpuThreadBuffer> &buffer : buffers) {
+        if (buffer->free) {
+            buffer->free = false;
+            buffer->retired.store(false, std::memory_order_relaxed);
+            return buffer.get();
+        }
+    }
+
+    buffers.push_back(std::make_unique<CpuThreadBuffer>());
+    CpuThreadBuffer *buffer = buffers.back().get();
+    buffer->tid = FIRST_THREAD_ID + (unsigned int) buffers.size() - 1;
+    buffer->name = "thread " + std::to_string(buffers.size() - 1);
+    return buffer;
+}
+
+void CpuProfiler::SetThreadName(const std::string &name) {
+    CpuThreadBuffer &buffer = LocalProfilerBuffer();
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer.name = name;
+}
+
+void CpuProfiler::calibrate() {
+    double microseconds = NowMicroseconds();
+    uint64_t ticks = ProfilerTicks();
+    // wait for a long enough interval that the measured rate is meaningful
+    if (microseconds - anchorMicroseconds > 1000.0)
+        ticksPerMicrosecond = (double) (ticks - anchorTicks) / (microseconds - anchorMicroseconds);
+}
+
+void CpuProfiler::drain(CpuThreadBuffer &buffer) {
+    uint32_t tail = buffer.tail.load(std::memory_order_relaxed);
+    uint32_t head = buffer.head.load(std::memory_order_acquire);
+
+    for (; tail != head; tail++) {
+        const CpuEvent &recorded = buffer.events[tail & (CpuThreadBuffer::CAPACITY - 1)];
+        Event event = {recorded.name, buffer.tid,
+                       anchorMicroseconds + (double) (int64_t) (recorded.begin - anchorTicks) / ticksPerMicrosecond,
+                       anchorMicroseconds + (double) (int64_t) (recorded.end - anchorTicks) / ticksPerMicrosecond};
+
+        // the latest frame that started before the event did, or the load. Stragglers from frames that already
+        // left the history are dropped
+        Frame *owner = frame == 0 || event.begin < firstFrameBegin ? &load : nullptr;
+        for (auto it = frames.rbegin(); it != frames.rend() && !owner; ++it) {
+            if (it->begin <= event.begin)
+                owner = &*it;
+        }
+        if (owner)
+            owner->events.push_back(event);
+    }
+
+    buffer.tail.store(tail, std::memory_order_release);
+    droppedEvents += buffer.dropped.exchange(0, std::memory_order_relaxed);
+}
+
+void CpuProfiler::BeginFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    frames.push_back({++frame, NowMicroseconds(), {}});
+    if (frame == 1)
+        firstFrameBegin = frames.back().begin;
+}
+
+void CpuProfiler::EndFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+    calibrate();
+
+    for (std::unique_ptr<CpuThreadBuffer> &buffer : buffers) {
+        if (buffer->free)
+            continue;
+        // read before draining, everything the thread pushed before retiring is then visible
+        bool retired = buffer->retired.load(std::memory_order_acquire);
+        drain(*buffer);
+        if (retired)
+            buffer->free = true;
+    }
+
+    while (frames.size() > HISTORY_FRAMES)
+        frames.pop_front();
+}
+
+void CpuProfiler::Report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ios::fmtflags flags = out.flags();
+
+    struct Totals {
+        double milliseconds = 0.0, maxMilliseconds = 0.0;
+        unsigned long calls = 0;
+    };
+    std::vector<std::string> names;
+    std::map<std::string, Totals> totals;
+
+    // frames still being recorded or drained would skew the averages, leave out the newest one
+    size_t complete = frames.empty() ? 0 : frames.size() - 1;
+    for (size_t f = 0; f < complete; f++) {
+        std::map<std::string, double> perFrame;
+        for (const Event &event : frames[f].events) {
+            if (!totals.count(event.name))
+                names.push_back(event.name);
+            Totals &t = totals[event.name];
+            t.calls++;
+            perFrame[event.name] += (event.end - event.begin) / 1000.0;
+        }
+        for (const auto &entry : perFrame) {
+            Totals &t = totals[entry.first];
+            t.milliseconds += entry.second;
+            t.maxMilliseconds = std::max(t.maxMilliseconds, entry.second);
+        }
+    }
+
+    out << std::left << std::setw(28) << "cpu scope" << std::right << std::setw(12) << "ms/frame" << std::setw(10)
+        << "max" << std::setw(13) << "calls/frame" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const std::string &name : names) {
+        const Totals &t = totals[name];
+        out << std::left << std::setw(28) << name << std::right << std::setw(12) << t.milliseconds / (double) complete
+            << std::setw(10) << t.maxMilliseconds << std::setw(13) << std::setprecision(1)
+            << (double) t.calls / (double) complete << std::setprecision(3) << std::endl;
+    }
+
+    std::map<std::string, double> loadTotals;
+    for (const Event &event : load.events)
+        loadTotals[event.name] += (event.end - event.begin) / 1000.0;
+    out << "load:" << std::endl;
+    for (const auto &entry : loadTotals)
+        out << "  " << std::left << std::setw(26) << entry.first << std::right << std::setw(12) << entry.second
+            << " ms" << std::endl;
+    out << droppedEvents << " events dropped on full buffers" << std::endl;
+
+    out.flags(flags);
+}
+
+std::string CpuProfiler::ChromeTraceEvents() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+
+    bool first = true;
+    auto separate = [&]() {
+        if (!first)
+            out << ",\n";
+        first = false;
+    };
+
+    for (const std::unique_ptr<CpuThreadBuffer> &buffer : buffers) {
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+    }
+
+    auto write = [&](const Frame &f) {
+        for (const Event &event : f.events) {
+            separate();
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.tid
+                << ",\"ts\":" << event.begin << ",\"dur\":" << event.end - event.begin
+                << ",\"args\":{\"frame\":" << f.index << "}}";
+        }
+    };
+    write(load);
+    for (const Frame &f : frames)
+        write(f);
+
+    return out.str();
+}
+
+bool CpuProfiler::ExportChromeTrace(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::CPU_PROFILER::CANNOT_WRITE_TRACE " << path << std::endl;
+        return false;
+    }
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" << ChromeTraceEvents() << "\n]}\n";
+    return true;
+}
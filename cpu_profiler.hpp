@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// PROFILE_SCOPE("name") times the rest of the enclosing block on the calling thread. Only the pointer to the name is
+// recorded, so it has to be a string literal. PROFILE_BEGIN_FRAME() and PROFILE_END_FRAME() bracket a frame, and
+// PROFILE_TRACE_EVENTS() is what to append to the GPU profiler's trace. Without PROFILING defined the macros expand
+// to nothing, or to no events
+#ifdef PROFILING
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+#define PROFILE_SCOPE(name) CpuScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) CpuProfiler::Instance().SetThreadName(name)
+#define PROFILE_BEGIN_FRAME() CpuProfiler::Instance().BeginFrame()
+#define PROFILE_END_FRAME() CpuProfiler::Instance().EndFrame()
+#define PROFILE_TRACE_EVENTS() CpuProfiler::Instance().ChromeTraceEvents()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_BEGIN_FRAME()
+#define PROFILE_END_FRAME()
+#define PROFILE_TRACE_EVENTS() std::string()
+#endif
+
+// The time stamp counter where there is one, the monotonic clock in nanoseconds elsewhere
+inline uint64_t ProfilerTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+#endif
+}
+
+struct CpuEvent {
+    const char *name;
+    uint64_t begin, end;
+};
+
+// Single producer, single consumer ring of finished scopes. The owning thread pushes, the collector drains. A full
+// ring drops the event instead of waiting
+struct CpuThreadBuffer {
+    static const uint32_t CAPACITY = 1u << 14;
+
+    CpuEvent events[CAPACITY];
+    std::atomic<uint32_t> head{0}, tail{0};
+    std::atomic<uint32_t> dropped{0};
+    // set by the owning thread as it exits, the buffer is handed to the next new thread once drained
+    std::atomic<bool> retired{false};
+    bool free = false;
+    unsigned int tid = 0;
+    std::string name;
+
+    void Push(const char *eventName, uint64_t begin, uint64_t end) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events[h & (CAPACITY - 1)] = {eventName, begin, end};
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+// Collects the scopes of every thread. EndFrame drains the per-thread rings and files each event under the frame it
+// started in; whatever ran before the first BeginFrame is kept as the load
+class CpuProfiler {
+public:
+    static CpuProfiler &Instance();
+
+    // microseconds since the first call, shared with the GPU profiler so both land on one timeline
+    static double NowMicroseconds();
+
+    CpuThreadBuffer *RegisterThread();
+    void SetThreadName(const std::string &name);
+
+    void BeginFrame();
+    void EndFrame();
+
+    // per scope milliseconds per frame over the retained frames, and the load
+    void Report(std::ostream &out) const;
+
+    // the load and the retained frames as trace event objects, for GpuProfiler::ExportChromeTrace to splice in
+    std::string ChromeTraceEvents() const;
+    bool ExportChromeTrace(const std::string &path) const;
+
+private:
+    CpuProfiler();
+
+    struct Event {
+        const char *name;
+        unsigned int tid;
+        double begin, end;
+    };
+
+    struct Frame {
+        unsigned long index;
+        double begin;
+        std::vector<Event> events;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<CpuThreadBuffer>> buffers;
+    Frame load;
+    std::deque<Frame> frames;
+    unsigned long frame;
+    double firstFrameBegin;
+    unsigned long droppedEvents;
+
+    // ticks are turned into microseconds by the rate measured between the anchor and the latest EndFrame
+    uint64_t anchorTicks;
+    double anchorMicroseconds;
+    double ticksPerMicrosecond;
+
+    void calibrate();
+    void drain(CpuThreadBuffer &buffer);
+};
+
+// The calling thread's ring, registered the first time the thread records anything
+struct CpuThreadHandle {
+    CpuThreadBuffer *buffer = nullptr;
+
+    ~CpuThreadHandle() {
+        if (buffer)
+            buffer->retired.store(true, std::memory_order_release);
+    }
+};
+
+inline CpuThreadBuffer &LocalProfilerBuffer() {
+    thread_local CpuThreadHandle handle;
+    if (!handle.buffer)
+        handle.buffer = CpuProfiler::Instance().RegisterThread();
+    return *handle.buffer;
+}
+
+class CpuScope {
+public:
+    explicit CpuScope(const char *name) : name(name), begin(ProfilerTicks()) {}
+    ~CpuScope() { LocalProfilerBuffer().Push(name, begin, ProfilerTicks()); }
+
+private:
+    const char *name;
+    uint64_t begin;
+};
@@ -0,0 +1,92 @@
+#include <glad/glad.h>
+#include <algorithm>
+
+#include "depth_prepass.hpp"
+#include "gpu_profiler.hpp"
+
+DepthPrepass::DepthPrepass(unsigned int framesInFlight, unsigned int window)
+        : depthShader("shaders/prepass/shader.vs", "shaders/prepass/shader.fs"),
+          alphaTestedShader("shaders/prepass_alpha/shader.vs", "shaders/prepass_alpha/shader.fs"), enabled(false),
+          slots(std::max(2u, framesInFlight)), next(0), window(window), nextSample{0, 0} {
+    for (Slot &slot : slots)
+        glGenQueries(1, &slot.query);
+}
+
+DepthPrepass::~DepthPrepass() {
+    for (Slot &slot : slots)
+        glDeleteQueries(1, &slot.query);
+}
+
+void DepthPrepass::DrawDepth(const std::vector<OpaqueDraw> &draws, const glm::mat4 &view,
+                             const glm::mat4 &projection) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    depthShader.use();
+    depthShader.setMat4("projection", projection);
+    depthShader.setMat4("view", view);
+    for (const OpaqueDraw &draw : draws) {
+        if (draw.alphaTested)
+            continue;
+        draw.model->DrawDepth(depthShader, draw.transform);
+    }
+
+    // after the plain draws, so their depth already rejects what the discarding shader would have run for
+    alphaTestedShader.use();
+    alphaTestedShader.setMat4("projection", projection);
+    alphaTestedShader.setMat4("view", view);
+    for (const OpaqueDraw &draw : draws) {
+        if (!draw.alphaTested)
+            continue;
+        draw.model->Draw(alphaTestedShader, draw.transform);
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DepthPrepass::collect(Slot &slot) {
+    slot.pending = false;
+    GLuint available = 0;
+    glGetQueryObjectuiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available || slot.samples == 0)
+        return;
+
+    GLuint passed = 0;
+    glGetQueryObjectuiv(slot.query, GL_QUERY_RESULT, &passed);
+    RecordSample(overdraw[slot.prepass], nextSample[slot.prepass], window, (float) passed / (float) slot.samples);
+}
+
+void DepthPrepass::BeginShading(unsigned long samples) {
+    Slot &slot = slots[next];
+    if (slot.pending)
+        collect(slot);
+    slot.samples = samples;
+    slot.prepass = enabled;
+    slot.pending = true;
+
+    if (enabled) {
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, slot.query);
+}
+
+void DepthPrepass::EndShading() {
+    glEndQuery(GL_SAMPLES_PASSED);
+    if (enabled) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    next = (next + 1) % slots.size();
+}
+
+void DepthPrepass::Report(std::ostream &out) const {
+    out << "Depth pre-pass " << (enabled ? "on" : "off") << ", shaded samples per target sample:" << std::endl;
+    const char *labels[2] = {"without pre-pass", "with pre-pass"};
+    for (int prepass = 0; prepass < 2; prepass++) {
+        if (overdraw[prepass].empty())
+            continue;
+        out << "  " << labels[prepass] << ": " << average(overdraw[prepass]) << " avg, "
+            << percentile(overdraw[prepass], 0.99f) << " p99 over " << overdraw[prepass].size() << " frames"
+            << std::endl;
+    }
+}
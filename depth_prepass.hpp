@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "model.hpp"
+#include "shader.hpp"
+
+// Something drawn by the opaque passes. Alpha tested draws cut holes into themselves with their diffuse alpha
+struct OpaqueDraw {
+    Model *model;
+    glm::mat4 transform;
+    bool alphaTested;
+};
+
+// Optional depth only pass ahead of forward shading. The pre-pass lays down the nearest depth of every pixel with
+// color writes off, then shading runs with GL_EQUAL so each pixel is shaded once no matter the draw order. Plain draws
+// go through a position only shader and the positions only vertex stream; alpha tested ones have to sample their
+// texture to discard, which is the only place they need to, since the equal test already rejects whatever lies
+// behind their holes during shading. Shading vertex shaders must declare gl_Position invariant like the pre-pass
+// shaders do, or equal can fail on rounding.
+//
+// Either way the samples passing the depth test while shading are counted with occlusion queries, read back a few
+// frames late so nothing waits on them, to compare overdraw with and without the pre-pass per scene
+class DepthPrepass {
+public:
+    explicit DepthPrepass(unsigned int framesInFlight = 4, unsigned int window = 240);
+    ~DepthPrepass();
+
+    DepthPrepass(const DepthPrepass &) = delete;
+    DepthPrepass &operator=(const DepthPrepass &) = delete;
+
+    void SetEnabled(bool enabled) { this->enabled = enabled; }
+    bool Enabled() const { return enabled; }
+
+    // draws the depth of draws into the bound framebuffer, leaving color alone
+    void DrawDepth(const std::vector<OpaqueDraw> &draws, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // wrap the shading of the same draws. samples is the bound target's total sample count, the shaded count is
+    // reported relative to it
+    void BeginShading(unsigned long samples);
+    void EndShading();
+
+    // shaded samples per target sample with the pre-pass on and off, which is the average overdraw of shading
+    void Report(std::ostream &out) const;
+
+private:
+    struct Slot {
+        unsigned int query = 0;
+        unsigned long samples = 0;
+        bool prepass = false;
+        bool pending = false;
+    };
+
+    Shader depthShader, alphaTestedShader;
+    bool enabled;
+
+    std::vector<Slot> slots;
+    unsigned int next;
+    unsigned int window;
+    // indexed by whether the pre-pass was on
+    std::vector<float> overdraw[2];
+    size_t nextSample[2];
+
+    void collect(Slot &slot);
+};
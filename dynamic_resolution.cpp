@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "dynamic_resolution.hpp"
+
+// Scales are multiples of this, every distinct scale is a distinct set of render targets
+const float SCALE_STEP = 0.05f;
+// Weight of the newest frame in the smoothed frame time
+const float SMOOTHING = 0.2f;
+// The dead band: above the budget is too slow, below UNDER_BUDGET of it there's room to grow
+const float UNDER_BUDGET = 0.8f;
+// Where in the band a change aims the frame time at
+const float AIM = 0.9f;
+const unsigned int DECREASE_AFTER = 3;
+const unsigned int INCREASE_AFTER = 30;
+// Frames to ignore after a change, the GPU timings trail by the profiler's frames in flight
+const unsigned int COOLDOWN = 8;
+// Frames of history kept for the trace
+const size_t TRACE_FRAMES = 3600;
+
+DynamicResolution::DynamicResolution(float targetMilliseconds, float minScale, float maxScale)
+        : enabled(false), targetMilliseconds(targetMilliseconds), minScale(minScale), maxScale(maxScale),
+          scale(maxScale), smoothed(0.0f), framesOver(0), framesUnder(0), cooldown(0), frame(0), changes(0) {
+}
+
+void DynamicResolution::SetLimits(float minScale, float maxScale) {
+    this->minScale = std::max(SCALE_STEP, std::min(minScale, maxScale));
+    this->maxScale = std::max(this->minScale, maxScale);
+    scale = std::min(std::max(scale, this->minScale), this->maxScale);
+}
+
+float DynamicResolution::Update(float frameMilliseconds) {
+    frame++;
+    if (frameMilliseconds > 0.0f)
+        smoothed = smoothed == 0.0f ? frameMilliseconds : smoothed + SMOOTHING * (frameMilliseconds - smoothed);
+
+    trace.push_back({frame, frameMilliseconds, smoothed, Scale()});
+    if (trace.size() > TRACE_FRAMES)
+        trace.pop_front();
+
+    if (!enabled || smoothed == 0.0f)
+        return Scale();
+    if (cooldown > 0) {
+        cooldown--;
+        return scale;
+    }
+
+    bool over = smoothed > targetMilliseconds;
+    bool under = smoothed < targetMilliseconds * UNDER_BUDGET;
+    framesOver = over ? framesOver + 1 : 0;
+    framesUnder = under ? framesUnder + 1 : 0;
+
+    float next = scale;
+    if (framesOver >= DECREASE_AFTER || framesUnder >= INCREASE_AFTER) {
+        // the cost of a frame is mostly per pixel, so it goes with the square of the scale
+        next = scale * std::sqrt(targetMilliseconds * AIM / smoothed);
+        next = std::round(next / SCALE_STEP) * SCALE_STEP;
+
+        // falling can jump as far as needed, rising goes one step at a time
+        if (over)
+            next = std::min(next, scale - SCALE_STEP);
+        else
+            next = scale + SCALE_STEP;
+        next = std::min(std::max(next, minScale), maxScale);
+    }
+
+    if (std::abs(next - scale) > SCALE_STEP * 0.5f) {
+        scale = next;
+        changes++;
+        cooldown = COOLDOWN;
+        framesOver = 0;
+        framesUnder = 0;
+    }
+    return scale;
+}
+
+void DynamicResolution::Report(std::ostream &out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+
+    size_t overBudget = std::count_if(trace.begin(), trace.end(), [&](const Sample &sample) {
+        return sample.milliseconds > targetMilliseconds;
+    });
+    out << "dynamic resolution " << (enabled ? "on" : "off") << ": scale " << Scale() << " in [" << minScale << ", "
+        << maxScale << "], budget " << targetMilliseconds << " ms, smoothed " << smoothed << " ms, " << changes
+        << " changes, " << (trace.empty() ? 0.0 : 100.0 * (double) overBudget / (double) trace.size())
+        << "% of the last " << trace.size() << " frames over budget" << std::endl;
+
+    out.flags(flags);
+}
+
+bool DynamicResolution::ExportTrace(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::DYNAMIC_RESOLUTION::CANNOT_WRITE_TRACE " << path << std::endl;
+        return false;
+    }
+
+    file << "frame,milliseconds,smoothed,scale,target\n";
+    file << std::fixed << std::setprecision(3);
+    for (const Sample &sample : trace)
+        file << sample.frame << "," << sample.milliseconds << "," << sample.smoothed << "," << sample.scale << ","
+             << targetMilliseconds << "\n";
+    return true;
+}
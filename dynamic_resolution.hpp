@@ -0,0 +1,48 @@
+#pragma once
+
+#include <deque>
+#include <ostream>
+#include <string>
+
+// Picks the scale the scene renders at from measured frame times, to hold a frame time budget. Decisions use a
+// smoothed frame time and a dead band around the budget: the scale only drops after a few frames over budget and only
+// rises after a long run well under it, one step at a time, so it settles instead of oscillating. After every change
+// it waits for the new scale to show up in the measurements, which trail by the frames in flight
+class DynamicResolution {
+public:
+    explicit DynamicResolution(float targetMilliseconds = 16.6f, float minScale = 0.5f, float maxScale = 1.0f);
+
+    void SetEnabled(bool enabled) { this->enabled = enabled; }
+    bool Enabled() const { return enabled; }
+
+    void SetTarget(float milliseconds) { targetMilliseconds = milliseconds; }
+    void SetLimits(float minScale, float maxScale);
+
+    // feeds the time of the latest measured frame, GPU time where there is one, and returns the scale to render the
+    // next frame at. Disabled, it always returns the maximum scale
+    float Update(float frameMilliseconds);
+
+    float Scale() const { return enabled ? scale : maxScale; }
+
+    void Report(std::ostream &out) const;
+
+    // one line per frame: frame, measured and smoothed milliseconds, scale
+    bool ExportTrace(const std::string &path) const;
+
+private:
+    struct Sample {
+        unsigned long frame;
+        float milliseconds, smoothed, scale;
+    };
+
+    bool enabled;
+    float targetMilliseconds;
+    float minScale, maxScale;
+
+    float scale;
+    float smoothed;
+    unsigned int framesOver, framesUnder, cooldown;
+    unsigned long frame, changes;
+
+    std::deque<Sample> trace;
+};
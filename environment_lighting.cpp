@@ -0,0 +1,651 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <xmmintrin.h>
+
+// the implementation is compiled into model.cpp's translation unit
+#undef STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "environment_lighting.hpp"
+#include "binary_io.hpp"
+#include "cpu_profiler.hpp"
+#include "job_system.hpp"
+
+const char ENVIRONMENT_CACHE_MAGIC[4] = {'L', 'O', 'G', 'E'};
+const uint32_t ENVIRONMENT_CACHE_VERSION = 1;
+
+const float PI = 3.14159265f;
+
+// a row of any stage is costly enough that splitting pays off however few rows there are
+const size_t PARALLEL_ROW_THRESHOLD = 0;
+
+// One mip of a cube map, RGB texels of the six faces one after the other
+struct CubeLevel {
+    unsigned int size;
+    std::vector<float> texels;
+
+    float *Texel(unsigned int face, unsigned int x, unsigned int y) {
+        return &texels[(((size_t) face * size + y) * size + x) * 3];
+    }
+    const float *Texel(unsigned int face, unsigned int x, unsigned int y) const {
+        return &texels[(((size_t) face * size + y) * size + x) * 3];
+    }
+};
+
+// the direction through s and t in [-1, 1] on a face, in the order and orientation GL expects of cube maps
+static glm::vec3 faceDirection(unsigned int face, float s, float t) {
+    switch (face) {
+        case 0: return glm::vec3(1.0f, -t, -s);
+        case 1: return glm::vec3(-1.0f, -t, s);
+        case 2: return glm::vec3(s, 1.0f, t);
+        case 3: return glm::vec3(s, -1.0f, -t);
+        case 4: return glm::vec3(s, -t, 1.0f);
+        default: return glm::vec3(-s, -t, -1.0f);
+    }
+}
+
+static unsigned int directionFace(const glm::vec3 &d, float &s, float &t) {
+    glm::vec3 a = glm::abs(d);
+    if (a.x >= a.y && a.x >= a.z) {
+        s = (d.x > 0.0f ? -d.z : d.z) / a.x;
+        t = -d.y / a.x;
+        return d.x > 0.0f ? 0 : 1;
+    }
+    if (a.y >= a.z) {
+        s = d.x / a.y;
+        t = (d.y > 0.0f ? d.z : -d.z) / a.y;
+        return d.y > 0.0f ? 2 : 3;
+    }
+    s = (d.z > 0.0f ? d.x : -d.x) / a.z;
+    t = -d.y / a.z;
+    return d.z > 0.0f ? 4 : 5;
+}
+
+static glm::vec3 texelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size) {
+    float s = ((float) x + 0.5f) / (float) size * 2.0f - 1.0f;
+    float t = ((float) y + 0.5f) / (float) size * 2.0f - 1.0f;
+    return glm::normalize(faceDirection(face, s, t));
+}
+
+// solid angle of a face texel, from the area element of the cube projected onto the sphere
+static float areaElement(float x, float y) {
+    return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+}
+
+static float texelSolidAngle(unsigned int x, unsigned int y, unsigned int size) {
+    float inverse = 2.0f / (float) size;
+    float x0 = (float) x * inverse - 1.0f, y0 = (float) y * inverse - 1.0f;
+    float x1 = x0 + inverse, y1 = y0 + inverse;
+    return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+}
+
+// bilinear within the face the direction points at, clamped at its edges
+static glm::vec3 sampleLevel(const CubeLevel &level, const glm::vec3 &direction) {
+    float s, t;
+    unsigned int face = directionFace(direction, s, t);
+    float x = glm::clamp((s + 1.0f) * 0.5f * (float) level.size - 0.5f, 0.0f, (float) level.size - 1.0f);
+    float y = glm::clamp((t + 1.0f) * 0.5f * (float) level.size - 0.5f, 0.0f, (float) level.size - 1.0f);
+    unsigned int x0 = (unsigned int) x, y0 = (unsigned int) y;
+    unsigned int x1 = std::min(x0 + 1, level.size - 1), y1 = std::min(y0 + 1, level.size - 1);
+    float fx = x - (float) x0, fy = y - (float) y0;
+    const float *a = level.Texel(face, x0, y0), *b = level.Texel(face, x1, y0);
+    const float *c = level.Texel(face, x0, y1), *d = level.Texel(face, x1, y1);
+    glm::vec3 result;
+    for (int i = 0; i < 3; i++)
+        result[i] = (a[i] * (1.0f - fx) + b[i] * fx) * (1.0f - fy) + (c[i] * (1.0f - fx) + d[i] * fx) * fy;
+    return result;
+}
+
+// trilinear between the two mips around lod
+static glm::vec3 sampleCube(const std::vector<CubeLevel> &levels, const glm::vec3 &direction, float lod) {
+    lod = glm::clamp(lod, 0.0f, (float) levels.size() - 1.0f);
+    unsigned int first = (unsigned int) lod;
+    float fraction = lod - (float) first;
+    glm::vec3 result = sampleLevel(levels[first], direction);
+    if (fraction > 0.0f && first + 1 < levels.size())
+        result = glm::mix(result, sampleLevel(levels[first + 1], direction), fraction);
+    return result;
+}
+
+static glm::vec3 sampleEquirect(const EnvironmentSource &source, const glm::vec3 &direction) {
+    float u = std::atan2(direction.z, direction.x) / (2.0f * PI) + 0.5f;
+    float v = std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / PI;
+    float x = u * (float) source.width - 0.5f;
+    float y = glm::clamp(v * (float) source.height - 0.5f, 0.0f, (float) source.height - 1.0f);
+    int x0 = (int) std::floor(x);
+    unsigned int y0 = (unsigned int) y, y1 = std::min(y0 + 1, source.height - 1);
+    float fx = x - (float) x0, fy = y - (float) y0;
+    // wraps around horizontally
+    unsigned int xa = (unsigned int) ((x0 % (int) source.width + (int) source.width) % (int) source.width);
+    unsigned int xb = (xa + 1) % source.width;
+    const float *a = &source.pixels[((size_t) y0 * source.width + xa) * 3];
+    const float *b = &source.pixels[((size_t) y0 * source.width + xb) * 3];
+    const float *c = &source.pixels[((size_t) y1 * source.width + xa) * 3];
+    const float *d = &source.pixels[((size_t) y1 * source.width + xb) * 3];
+    glm::vec3 result;
+    for (int i = 0; i < 3; i++)
+        result[i] = (a[i] * (1.0f - fx) + b[i] * fx) * (1.0f - fy) + (c[i] * (1.0f - fx) + d[i] * fx) * fy;
+    return result;
+}
+
+static glm::vec2 hammersley(unsigned int i, unsigned int count) {
+    uint32_t bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return glm::vec2((float) i / (float) count, (float) bits * 2.3283064365386963e-10f);
+}
+
+// a half vector around +Z distributed as GGX with alpha, the square of the roughness
+static glm::vec3 sampleGGX(glm::vec2 xi, float alpha) {
+    float phi = 2.0f * PI * xi.x;
+    float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (alpha * alpha - 1.0f) * xi.y));
+    float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+static float distributionGGX(float NdotH, float alpha) {
+    float a2 = alpha * alpha;
+    float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+    return a2 / (PI * d * d);
+}
+
+EnvironmentSource ProceduralSky(glm::vec3 sunDirection, unsigned int width, unsigned int height) {
+    EnvironmentSource source;
+    source.name = "procedural sky";
+    source.width = width;
+    source.height = height;
+    source.pixels.resize((size_t) width * height * 3);
+
+    glm::vec3 toSun = glm::normalize(-sunDirection);
+    const glm::vec3 horizon(1.6f, 1.55f, 1.4f), zenith(0.6f, 0.8f, 1.4f), ground(0.6f, 0.55f, 0.5f);
+    const glm::vec3 sun(1.0f, 0.95f, 0.85f);
+    for (unsigned int y = 0; y < height; y++) {
+        float theta = ((float) y + 0.5f) / (float) height * PI;
+        for (unsigned int x = 0; x < width; x++) {
+            float phi = (((float) x + 0.5f) / (float) width - 0.5f) * 2.0f * PI;
+            glm::vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            glm::vec3 radiance = d.y >= 0.0f ? glm::mix(horizon, zenith, std::sqrt(d.y))
+                                             : glm::mix(horizon * 0.7f, ground, std::min(1.0f, -d.y * 4.0f));
+            // about as much light as a small disc of forty times the sky's brightness
+            radiance += sun * 40.0f * std::pow(std::max(glm::dot(d, toSun), 0.0f), 256.0f);
+            float *pixel = &source.pixels[((size_t) y * width + x) * 3];
+            pixel[0] = radiance.r;
+            pixel[1] = radiance.g;
+            pixel[2] = radiance.b;
+        }
+    }
+    return source;
+}
+
+bool LoadEnvironment(const std::string &path, EnvironmentSource &source) {
+    // models flip their textures for GL, this is sampled by direction with the top row first
+    stbi_set_flip_vertically_on_load(false);
+    int width, height, channels;
+    float *data = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+    if (!data) {
+        std::cout << "ERROR::ENVIRONMENT::CANNOT_LOAD " << path << std::endl;
+        return false;
+    }
+    source.name = path;
+    source.width = (unsigned int) width;
+    source.height = (unsigned int) height;
+    source.pixels.assign(data, data + (size_t) width * height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+uint64_t HashEnvironment(const EnvironmentSource &source, const EnvironmentBakeSettings &settings) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void *data, size_t size) {
+        const uint8_t *bytes = (const uint8_t *) data;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    add(&source.width, sizeof(source.width));
+    add(&source.height, sizeof(source.height));
+    add(source.pixels.data(), source.pixels.size() * sizeof(float));
+    add(&settings, sizeof(settings));
+    add(&ENVIRONMENT_CACHE_VERSION, sizeof(ENVIRONMENT_CACHE_VERSION));
+    return hash;
+}
+
+// the source as a cube with a box filtered mip chain, four samples of the image per texel of the first level
+static void resample(const EnvironmentSource &source, unsigned int size, unsigned int threads,
+                     std::vector<CubeLevel> &levels) {
+    levels.clear();
+    levels.push_back({size, std::vector<float>((size_t) 6 * size * size * 3)});
+    JobSystem &jobs = JobSystem::Instance();
+    jobs.ParallelFor(6 * size, 8, threads, PARALLEL_ROW_THRESHOLD, [&](size_t first, size_t last) {
+        PROFILE_SCOPE("resample environment");
+        CubeLevel &level = levels[0];
+        for (size_t row = first; row < last; row++) {
+            unsigned int face = (unsigned int) (row / size), y = (unsigned int) (row % size);
+            for (unsigned int x = 0; x < size; x++) {
+                glm::vec3 sum(0.0f);
+                for (int sub = 0; sub < 4; sub++) {
+                    float s = ((float) x + 0.25f + 0.5f * (float) (sub & 1)) / (float) size * 2.0f - 1.0f;
+                    float t = ((float) y + 0.25f + 0.5f * (float) (sub >> 1)) / (float) size * 2.0f - 1.0f;
+                    sum += sampleEquirect(source, glm::normalize(faceDirection(face, s, t)));
+                }
+                float *texel = level.Texel(face, x, y);
+                texel[0] = sum.r * 0.25f;
+                texel[1] = sum.g * 0.25f;
+                texel[2] = sum.b * 0.25f;
+            }
+        }
+    });
+
+    while (levels.back().size > 1) {
+        const CubeLevel &above = levels.back();
+        CubeLevel level = {above.size / 2, std::vector<float>((size_t) 6 * (above.size / 2) * (above.size / 2) * 3)};
+        for (unsigned int face = 0; face < 6; face++) {
+            for (unsigned int y = 0; y < level.size; y++) {
+                for (unsigned int x = 0; x < level.size; x++) {
+                    float *texel = level.Texel(face, x, y);
+                    for (int i = 0; i < 3; i++) {
+                        texel[i] = (above.Texel(face, x * 2, y * 2)[i] + above.Texel(face, x * 2 + 1, y * 2)[i] +
+                                    above.Texel(face, x * 2, y * 2 + 1)[i] +
+                                    above.Texel(face, x * 2 + 1, y * 2 + 1)[i]) * 0.25f;
+                    }
+                }
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+}
+
+// projects the radiance onto nine SH coefficients, one partial sum per row so the result doesn't depend on how
+// the rows were split, then convolves with the cosine lobe
+static void projectIrradiance(const CubeLevel &level, unsigned int threads, glm::vec3 irradiance[9]) {
+    std::vector<glm::vec3> rows((size_t) 6 * level.size * 9, glm::vec3(0.0f));
+    JobSystem &jobs = JobSystem::Instance();
+    jobs.ParallelFor(6 * level.size, 8, threads, PARALLEL_ROW_THRESHOLD, [&](size_t first, size_t last) {
+        PROFILE_SCOPE("project irradiance");
+        for (size_t row = first; row < last; row++) {
+            unsigned int face = (unsigned int) (row / level.size), y = (unsigned int) (row % level.size);
+            glm::vec3 *sum = &rows[row * 9];
+            for (unsigned int x = 0; x < level.size; x++) {
+                glm::vec3 d = texelDirection(face, x, y, level.size);
+                const float *texel = level.Texel(face, x, y);
+                glm::vec3 radiance = glm::vec3(texel[0], texel[1], texel[2]) * texelSolidAngle(x, y, level.size);
+                sum[0] += radiance * 0.282095f;
+                sum[1] += radiance * (0.488603f * d.y);
+                sum[2] += radiance * (0.488603f * d.z);
+                sum[3] += radiance * (0.488603f * d.x);
+                sum[4] += radiance * (1.092548f * d.x * d.y);
+                sum[5] += radiance * (1.092548f * d.y * d.z);
+                sum[6] += radiance * (0.315392f * (3.0f * d.z * d.z - 1.0f));
+                sum[7] += radiance * (1.092548f * d.x * d.z);
+                sum[8] += radiance * (0.546274f * (d.x * d.x - d.y * d.y));
+            }
+        }
+    });
+
+    glm::dvec3 total[9] = {};
+    for (size_t row = 0; row < rows.size() / 9; row++) {
+        for (int i = 0; i < 9; i++)
+            total[i] += glm::dvec3(rows[row * 9 + i]);
+    }
+    // cosine lobe per band over pi, times the constant of each basis function so the shader skips them
+    const float band[3] = {1.0f, 2.0f / 3.0f, 0.25f};
+    const float constant[9] = {0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                               1.092548f, 0.315392f, 1.092548f, 0.546274f};
+    for (int i = 0; i < 9; i++)
+        irradiance[i] = glm::vec3(total[i]) * band[i == 0 ? 0 : i < 4 ? 1 : 2] * constant[i];
+}
+
+// GGX prefiltered radiance for the roughness of each level, with the normal, view and reflection taken as one
+static void prefilterSpecular(const std::vector<CubeLevel> &source, const EnvironmentBakeSettings &settings,
+                              unsigned int threads, EnvironmentBake &bake) {
+    unsigned int levels = std::max(1u, settings.specularLevels);
+    bake.specularSize = settings.specularSize;
+    bake.specular.assign(levels, std::vector<float>());
+    float texelSolid = 4.0f * PI / (6.0f * (float) source[0].size * (float) source[0].size);
+
+    for (unsigned int l = 0; l < levels; l++) {
+        CubeLevel level = {std::max(1u, settings.specularSize >> l), std::vector<float>()};
+        level.texels.resize((size_t) 6 * level.size * level.size * 3);
+        float roughness = levels > 1 ? (float) l / (float) (levels - 1) : 0.0f;
+        float alpha = std::max(roughness * roughness, 1e-4f);
+
+        // the samples around +Z, the same for every texel of the level and padded to fours with weightless ones
+        unsigned int count = (settings.specularSamples + 3) & ~3u;
+        std::vector<float> lx(count, 0.0f), ly(count, 0.0f), lz(count, 1.0f), weight(count, 0.0f), lod(count, 0.0f);
+        for (unsigned int i = 0; i < settings.specularSamples && l > 0; i++) {
+            glm::vec3 h = sampleGGX(hammersley(i, settings.specularSamples), alpha);
+            glm::vec3 light = 2.0f * h.z * h - glm::vec3(0.0f, 0.0f, 1.0f);
+            if (light.z <= 0.0f)
+                continue;
+            lx[i] = light.x;
+            ly[i] = light.y;
+            lz[i] = light.z;
+            weight[i] = light.z;
+            // the mip whose texels cover about the solid angle this sample stands for
+            float pdf = distributionGGX(h.z, alpha) * 0.25f;
+            float sampleSolid = 1.0f / ((float) settings.specularSamples * pdf + 1e-6f);
+            lod[i] = std::max(0.5f * std::log2(sampleSolid / texelSolid) + 1.0f, 0.0f);
+        }
+        // a mirror only needs the source at the level's own resolution
+        float mirrorLod = std::max(0.0f, std::log2((float) source[0].size / (float) level.size));
+
+        JobSystem &jobs = JobSystem::Instance();
+        jobs.ParallelFor(6 * level.size, 1, threads, PARALLEL_ROW_THRESHOLD, [&](size_t first, size_t last) {
+            PROFILE_SCOPE("prefilter specular");
+            alignas(16) float wx[4], wy[4], wz[4];
+            for (size_t row = first; row < last; row++) {
+                unsigned int face = (unsigned int) (row / level.size), y = (unsigned int) (row % level.size);
+                for (unsigned int x = 0; x < level.size; x++) {
+                    glm::vec3 n = texelDirection(face, x, y, level.size);
+                    glm::vec3 result;
+                    if (l == 0) {
+                        result = sampleCube(source, n, mirrorLod);
+                    } else {
+                        glm::vec3 up = std::fabs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                        glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+                        glm::vec3 bitangent = glm::cross(n, tangent);
+                        glm::vec3 sum(0.0f);
+                        float total = 0.0f;
+                        // four samples into the texel's frame at once
+                        for (unsigned int i = 0; i < count; i += 4) {
+                            __m128 sx = _mm_loadu_ps(&lx[i]), sy = _mm_loadu_ps(&ly[i]), sz = _mm_loadu_ps(&lz[i]);
+                            for (int c = 0; c < 3; c++) {
+                                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent[c]), sx),
+                                                                 _mm_mul_ps(_mm_set1_ps(bitangent[c]), sy)),
+                                                      _mm_mul_ps(_mm_set1_ps(n[c]), sz));
+                                _mm_store_ps(c == 0 ? wx : c == 1 ? wy : wz, r);
+                            }
+                            for (unsigned int k = 0; k < 4; k++) {
+                                if (weight[i + k] <= 0.0f)
+                                    continue;
+                                sum += sampleCube(source, glm::vec3(wx[k], wy[k], wz[k]), lod[i + k]) * weight[i + k];
+                                total += weight[i + k];
+                            }
+                        }
+                        result = total > 0.0f ? sum / total : sampleCube(source, n, mirrorLod);
+                    }
+                    float *texel = level.Texel(face, x, y);
+                    texel[0] = result.r;
+                    texel[1] = result.g;
+                    texel[2] = result.b;
+                }
+            }
+        });
+        bake.specular[l] = std::move(level.texels);
+    }
+}
+
+// the split sum's scale and bias of F0 for every n.v and roughness, Smith GGX visibility with k = alpha / 2
+static void integrateBRDF(const EnvironmentBakeSettings &settings, unsigned int threads, EnvironmentBake &bake) {
+    unsigned int size = settings.brdfSize;
+    unsigned int count = (settings.brdfSamples + 3) & ~3u;
+    bake.brdfSize = size;
+    bake.brdf.assign((size_t) size * size * 2, 0.0f);
+    JobSystem &jobs = JobSystem::Instance();
+    jobs.ParallelFor(size, 1, threads, PARALLEL_ROW_THRESHOLD, [&](size_t first, size_t last) {
+        PROFILE_SCOPE("integrate BRDF");
+        // the view lies in the xz plane, so the half vectors' y never matters. Padding has z = 1 and no weight
+        std::vector<float> hx(count, 0.0f), hz(count, 1.0f), valid(count, 0.0f);
+        for (size_t y = first; y < last; y++) {
+            float roughness = ((float) y + 0.5f) / (float) size;
+            float alpha = roughness * roughness;
+            for (unsigned int i = 0; i < settings.brdfSamples; i++) {
+                glm::vec3 h = sampleGGX(hammersley(i, settings.brdfSamples), alpha);
+                hx[i] = h.x;
+                hz[i] = h.z;
+                valid[i] = 1.0f;
+            }
+            __m128 k = _mm_set1_ps(alpha * 0.5f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+            for (unsigned int x = 0; x < size; x++) {
+                float NdotV = ((float) x + 0.5f) / (float) size;
+                __m128 vx = _mm_set1_ps(std::sqrt(1.0f - NdotV * NdotV)), vz = _mm_set1_ps(NdotV);
+                __m128 g1v = _mm_div_ps(vz, _mm_add_ps(_mm_mul_ps(vz, _mm_sub_ps(one, k)), k));
+                __m128 scale = zero, bias = zero;
+                for (unsigned int i = 0; i < count; i += 4) {
+                    __m128 sx = _mm_loadu_ps(&hx[i]), sz = _mm_loadu_ps(&hz[i]);
+                    __m128 VdotH = _mm_max_ps(_mm_add_ps(_mm_mul_ps(vx, sx), _mm_mul_ps(vz, sz)), zero);
+                    // z of the reflected light
+                    __m128 NdotL = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), VdotH), sz), vz);
+                    __m128 keep = _mm_and_ps(_mm_cmpgt_ps(NdotL, zero), _mm_cmpgt_ps(_mm_loadu_ps(&valid[i]), zero));
+                    NdotL = _mm_max_ps(NdotL, zero);
+                    __m128 g1l = _mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, _mm_sub_ps(one, k)), k));
+                    __m128 visibility = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(g1v, g1l), VdotH), _mm_mul_ps(sz, vz));
+                    __m128 f = _mm_sub_ps(one, VdotH);
+                    __m128 f2 = _mm_mul_ps(f, f);
+                    __m128 fresnel = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+                    visibility = _mm_and_ps(visibility, keep);
+                    scale = _mm_add_ps(scale, _mm_mul_ps(_mm_sub_ps(one, fresnel), visibility));
+                    bias = _mm_add_ps(bias, _mm_mul_ps(fresnel, visibility));
+                }
+                alignas(16) float s[4], b[4];
+                _mm_store_ps(s, scale);
+                _mm_store_ps(b, bias);
+                float *texel = &bake.brdf[((size_t) y * size + x) * 2];
+                texel[0] = (s[0] + s[1] + s[2] + s[3]) / (float) settings.brdfSamples;
+                texel[1] = (b[0] + b[1] + b[2] + b[3]) / (float) settings.brdfSamples;
+            }
+        }
+    });
+}
+
+void BakeEnvironment(const EnvironmentSource &source, const EnvironmentBakeSettings &settings, EnvironmentBake &bake,
+                     unsigned int threads, EnvironmentBakeTimings *timings) {
+    PROFILE_SCOPE("BakeEnvironment");
+    EnvironmentBakeTimings measured;
+    auto start = std::chrono::steady_clock::now();
+    auto lap = [&start](double &milliseconds) {
+        auto now = std::chrono::steady_clock::now();
+        milliseconds = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+    };
+
+    std::vector<CubeLevel> cube;
+    resample(source, std::max(1u, settings.sourceSize), threads, cube);
+    lap(measured.resample);
+    projectIrradiance(cube[0], threads, bake.irradiance);
+    lap(measured.irradiance);
+    prefilterSpecular(cube, settings, threads, bake);
+    lap(measured.specular);
+    integrateBRDF(settings, threads, bake);
+    lap(measured.brdf);
+    if (timings)
+        *timings = measured;
+}
+
+bool WriteEnvironmentCache(const std::string &path, uint64_t hash, const EnvironmentBake &bake) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::ENVIRONMENT::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    file.write(ENVIRONMENT_CACHE_MAGIC, 4);
+    WriteValue(file, ENVIRONMENT_CACHE_VERSION);
+    WriteValue(file, hash);
+    WriteValue(file, (uint32_t) bake.specularSize);
+    WriteValue(file, (uint32_t) bake.specular.size());
+    WriteValue(file, (uint32_t) bake.brdfSize);
+    file.write((const char *) bake.irradiance, sizeof(bake.irradiance));
+    for (const std::vector<float> &level : bake.specular)
+        file.write((const char *) level.data(), (std::streamsize) (level.size() * sizeof(float)));
+    file.write((const char *) bake.brdf.data(), (std::streamsize) (bake.brdf.size() * sizeof(float)));
+    if (!file) {
+        std::cout << "ERROR::ENVIRONMENT::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ReadEnvironmentCache(const std::string &path, uint64_t hash, EnvironmentBake &bake) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    char magic[4];
+    uint32_t version, specularSize, levels, brdfSize;
+    uint64_t stored;
+    if (!file.read(magic, 4) || std::string(magic, 4) != std::string(ENVIRONMENT_CACHE_MAGIC, 4) ||
+        !ReadValue(file, version) || version != ENVIRONMENT_CACHE_VERSION || !ReadValue(file, stored) || stored != hash)
+        return false;
+    if (!ReadValue(file, specularSize) || !ReadValue(file, levels) || !ReadValue(file, brdfSize) || levels > 16)
+        return false;
+
+    bake.specularSize = specularSize;
+    bake.brdfSize = brdfSize;
+    file.read((char *) bake.irradiance, sizeof(bake.irradiance));
+    bake.specular.assign(levels, std::vector<float>());
+    for (uint32_t l = 0; l < levels; l++) {
+        size_t size = std::max(1u, specularSize >> l);
+        bake.specular[l].resize(6 * size * size * 3);
+        file.read((char *) bake.specular[l].data(), (std::streamsize) (bake.specular[l].size() * sizeof(float)));
+    }
+    bake.brdf.resize((size_t) brdfSize * brdfSize * 2);
+    file.read((char *) bake.brdf.data(), (std::streamsize) (bake.brdf.size() * sizeof(float)));
+    if (!file) {
+        std::cout << "ERROR::ENVIRONMENT::TRUNCATED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+EnvironmentLighting::EnvironmentLighting()
+        : hash(0), cached(false), milliseconds(0.0), irradiance(), specularLevels(0), specularCube(0),
+          brdfTexture(0) {
+}
+
+EnvironmentLighting::~EnvironmentLighting() {
+    glDeleteTextures(1, &specularCube);
+    glDeleteTextures(1, &brdfTexture);
+}
+
+bool EnvironmentLighting::Load(const EnvironmentSource &source, const std::string &cacheDirectory,
+                               const EnvironmentBakeSettings &settings) {
+    PROFILE_SCOPE("EnvironmentLighting::Load");
+    if (source.width == 0 || source.height == 0 || source.pixels.size() < (size_t) source.width * source.height * 3) {
+        std::cout << "ERROR::ENVIRONMENT::EMPTY_SOURCE " << source.name << std::endl;
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    name = source.name;
+    hash = HashEnvironment(source, settings);
+    char file[40];
+    std::snprintf(file, sizeof(file), "environment_%016llx.bin", (unsigned long long) hash);
+    std::string path = (std::filesystem::path(cacheDirectory) / file).string();
+
+    EnvironmentBake bake;
+    cached = ReadEnvironmentCache(path, hash, bake);
+    if (!cached) {
+        BakeEnvironment(source, settings, bake);
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        WriteEnvironmentCache(path, hash, bake);
+    }
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::copy(bake.irradiance, bake.irradiance + 9, irradiance);
+    specularLevels = (unsigned int) bake.specular.size();
+
+    if (!specularCube)
+        glGenTextures(1, &specularCube);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specularCube);
+    for (unsigned int l = 0; l < specularLevels; l++) {
+        unsigned int size = std::max(1u, bake.specularSize >> l);
+        size_t faceFloats = (size_t) size * size * 3;
+        for (unsigned int face = 0; face < 6; face++) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint) l, GL_RGB16F, (GLsizei) size, (GLsizei) size,
+                         0, GL_RGB, GL_FLOAT, &bake.specular[l][face * faceFloats]);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint) specularLevels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // the small rough levels would show their face edges otherwise
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    if (!brdfTexture)
+        glGenTextures(1, &brdfTexture);
+    glBindTexture(GL_TEXTURE_2D, brdfTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, (GLsizei) bake.brdfSize, (GLsizei) bake.brdfSize, 0, GL_RG, GL_FLOAT,
+                 bake.brdf.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void EnvironmentLighting::Bind(const Shader &shader, unsigned int firstUnit) const {
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specularCube);
+    shader.setInt("prefilteredEnvironment", (int) firstUnit);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, brdfTexture);
+    shader.setInt("brdfLUT", (int) firstUnit + 1);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setFloat("prefilteredLevels", (float) std::max(1u, specularLevels) - 1.0f);
+    for (int i = 0; i < 9; i++)
+        shader.setVec3("irradianceSH[" + std::to_string(i) + "]", irradiance[i]);
+}
+
+void EnvironmentLighting::Report(std::ostream &out) const {
+    out << "Environment lighting: " << name << ", " << (cached ? "read from the cache" : "baked") << " in "
+        << milliseconds << " ms, " << specularLevels << " prefiltered levels" << std::endl;
+}
+
+void BenchmarkEnvironmentBake(std::ostream &out, unsigned int size) {
+    EnvironmentBakeSettings settings;
+    settings.specularSize = size;
+    EnvironmentSource sky = ProceduralSky(glm::vec3(-0.2f, -1.0f, -0.3f), 1024, 512);
+
+    out << "Environment bake of a " << sky.width << "x" << sky.height << " sky, " << settings.sourceSize
+        << " source faces, " << size << " prefiltered faces over " << settings.specularLevels << " levels at "
+        << settings.specularSamples << " samples, " << settings.brdfSize << "x" << settings.brdfSize << " BRDF at "
+        << settings.brdfSamples << " samples:" << std::endl;
+    unsigned int hardware = JobSystem::Instance().Threads();
+    EnvironmentBake bake;
+    for (unsigned int threads : {1u, hardware}) {
+        EnvironmentBakeTimings timings;
+        BakeEnvironment(sky, settings, bake, threads, &timings);
+        out << "  " << threads << " thread" << (threads > 1 ? "s" : "") << ": " << timings.Total()
+            << " ms, resample " << timings.resample << ", irradiance " << timings.irradiance << ", specular "
+            << timings.specular << ", BRDF " << timings.brdf << std::endl;
+        if (threads == hardware)
+            break;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t hash = HashEnvironment(sky, settings);
+    out << "  hashing the source for the cache: "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms ("
+        << std::hex << hash << std::dec << ")" << std::endl;
+
+    // a white environment has to come out white at every roughness, with all its irradiance in the constant term
+    EnvironmentSource white;
+    white.width = 64;
+    white.height = 32;
+    white.pixels.assign((size_t) white.width * white.height * 3, 1.0f);
+    BakeEnvironment(white, settings, bake);
+    float specularError = 0.0f, irradianceError = std::fabs(bake.irradiance[0].r - 1.0f);
+    for (const std::vector<float> &level : bake.specular) {
+        for (float value : level)
+            specularError = std::max(specularError, std::fabs(value - 1.0f));
+    }
+    for (int i = 1; i < 9; i++)
+        irradianceError = std::max(irradianceError, glm::length(bake.irradiance[i]));
+    // a smooth surface seen head on reflects F0 and nothing else
+    const float *smooth = &bake.brdf[((size_t) 0 * bake.brdfSize + bake.brdfSize - 1) * 2];
+    out << "  white environment: largest irradiance error " << irradianceError << ", prefiltered " << specularError
+        << ", smooth head-on BRDF scale " << smooth[0] << " bias " << smooth[1] << std::endl;
+}
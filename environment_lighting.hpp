@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "shader.hpp"
+
+// Radiance around the scene as an equirectangular image, rows from the top
+struct EnvironmentSource {
+    std::string name;
+    unsigned int width = 0, height = 0;
+    std::vector<float> pixels;
+};
+
+// loads a Radiance .hdr file, or any other image stb_image reads
+bool LoadEnvironment(const std::string &path, EnvironmentSource &source);
+
+// A sky brightening towards the horizon over a darker ground, with a soft sun opposite to sunDirection. Averages
+// about one, so the ambient scale keeps meaning what it did with a flat ambient
+EnvironmentSource ProceduralSky(glm::vec3 sunDirection, unsigned int width = 256, unsigned int height = 128);
+
+struct EnvironmentBakeSettings {
+    // faces of the cube the source is resampled to before anything is integrated over it
+    unsigned int sourceSize = 128;
+    // faces of the first prefiltered level, roughness goes from 0 to 1 over the levels
+    unsigned int specularSize = 64;
+    unsigned int specularLevels = 6;
+    unsigned int specularSamples = 128;
+    unsigned int brdfSize = 64;
+    unsigned int brdfSamples = 256;
+};
+
+// What the lighting shaders fetch instead of a flat ambient
+struct EnvironmentBake {
+    // irradiance over pi as L2 spherical harmonics, the cosine lobe and the basis constants folded in so the shader
+    // only evaluates the polynomials
+    glm::vec3 irradiance[9];
+    // RGB cube faces of every prefiltered level, +X -X +Y -Y +Z -Z, each half the size of the one before
+    unsigned int specularSize = 0;
+    std::vector<std::vector<float>> specular;
+    // scale and bias of F0 for the split sum, n.v along x and roughness along y
+    unsigned int brdfSize = 0;
+    std::vector<float> brdf;
+};
+
+// milliseconds each stage of a bake took
+struct EnvironmentBakeTimings {
+    double resample = 0.0, irradiance = 0.0, specular = 0.0, brdf = 0.0;
+
+    double Total() const { return resample + irradiance + specular + brdf; }
+};
+
+// Bakes everything on the CPU. The stages are split into rows over the job system, threads as for the scene
+// systems: 0 or anything above 1 uses every worker, 1 stays on the calling thread. Specular and BRDF integrals are
+// importance sampled GGX over a Hammersley set, four samples at a time with SSE, and the specular samples read the
+// source mip matching their solid angle, which keeps a few hundred of them from being noisy
+void BakeEnvironment(const EnvironmentSource &source, const EnvironmentBakeSettings &settings, EnvironmentBake &bake,
+                     unsigned int threads = 0, EnvironmentBakeTimings *timings = nullptr);
+
+// of the source pixels and the settings, names the cache file
+uint64_t HashEnvironment(const EnvironmentSource &source, const EnvironmentBakeSettings &settings);
+
+bool WriteEnvironmentCache(const std::string &path, uint64_t hash, const EnvironmentBake &bake);
+// false if the file is missing or was baked from something else
+bool ReadEnvironmentCache(const std::string &path, uint64_t hash, EnvironmentBake &bake);
+
+// The baked environment on the GPU. Load reads the bake from the cache directory or bakes and writes it there, so
+// only the first run with a new source pays for it
+class EnvironmentLighting {
+public:
+    EnvironmentLighting();
+    ~EnvironmentLighting();
+
+    EnvironmentLighting(const EnvironmentLighting &) = delete;
+    EnvironmentLighting &operator=(const EnvironmentLighting &) = delete;
+
+    bool Load(const EnvironmentSource &source, const std::string &cacheDirectory,
+              const EnvironmentBakeSettings &settings = EnvironmentBakeSettings());
+
+    // binds the prefiltered cube and the BRDF table to firstUnit and the one after it and sets the SH uniforms
+    void Bind(const Shader &shader, unsigned int firstUnit) const;
+
+    // where the bake came from and how long it took
+    void Report(std::ostream &out) const;
+
+private:
+    std::string name;
+    uint64_t hash;
+    bool cached;
+    double milliseconds;
+
+    glm::vec3 irradiance[9];
+    unsigned int specularLevels;
+    unsigned int specularCube, brdfTexture;
+};
+
+// Bakes a procedural sky with size sized prefiltered faces on one thread and on every core, prints the time of every
+// stage, and checks the bake against what a constant environment and a mirror should give
+void BenchmarkEnvironmentBake(std::ostream &out, unsigned int size);
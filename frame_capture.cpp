@@ -0,0 +1,332 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <zlib.h>
+
+#include "frame_capture.hpp"
+#include "cpu_profiler.hpp"
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ParseCaptureFormat(const std::string &name, CaptureFormat &format) {
+    if (name == "png")
+        format = CaptureFormat::PNG;
+    else if (name == "raw")
+        format = CaptureFormat::RAW;
+    else if (name == "y4m")
+        format = CaptureFormat::Y4M;
+    else
+        return false;
+    return true;
+}
+
+FrameCapture::FrameCapture(const std::string &directory, CaptureFormat format, double framesPerSecond,
+                           unsigned int ringSize)
+        : directory(directory), format(format), framesPerSecond(framesPerSecond), slots(std::max(2u, ringSize)),
+          next(0), frames(0), stopping(false), streamWidth(0), streamHeight(0), encodedFrames(0), skippedFrames(0),
+          stallMilliseconds(0.0), encodeMilliseconds(0.0), bytesWritten(0) {
+    for (Slot &slot : slots)
+        glGenBuffers(1, &slot.PBO);
+    encoder = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    encoder.join();
+
+    for (Slot &slot : slots)
+        glDeleteBuffers(1, &slot.PBO);
+}
+
+void FrameCapture::Capture(unsigned int FBO, int width, int height) {
+    PROFILE_SCOPE("FrameCapture::Capture");
+    Slot &slot = slots[next];
+    next = (next + 1) % slots.size();
+    reclaim(slot);
+
+    size_t size = (size_t) width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    if (slot.capacity < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    // with a pack buffer bound the pixels land in the buffer, the call returns without waiting for them
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.frame = frames++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    slot.state = READING;
+}
+
+bool FrameCapture::map(Slot &slot, bool wait) {
+    GLsync fence = (GLsync) slot.fence;
+    if (wait) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    } else if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(fence);
+    slot.fence = nullptr;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) slot.width * slot.height * 4,
+                                    GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.mapped = (const unsigned char *) pixels;
+        slot.state = ENCODING;
+        queue.push_back((unsigned int) (&slot - slots.data()));
+    }
+    wake.notify_one();
+    return true;
+}
+
+void FrameCapture::unmap(Slot &slot) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    slot.mapped = nullptr;
+    slot.state = FREE;
+}
+
+void FrameCapture::reclaim(Slot &slot) {
+    SlotState state;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = slot.state;
+    }
+    if (state == FREE)
+        return;
+
+    // the ring has wrapped around to a buffer still in use, the one place the render thread waits
+    auto start = std::chrono::steady_clock::now();
+    if (state == READING)
+        map(slot, true);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return slot.state == ENCODED; });
+    }
+    unmap(slot);
+    stallMilliseconds += millisecondsSince(start);
+}
+
+void FrameCapture::Poll() {
+    // oldest first, the encoder has to see frames in order
+    bool blocked = false;
+    for (unsigned int i = 0; i < slots.size(); i++) {
+        Slot &slot = slots[(next + i) % slots.size()];
+        SlotState state;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            state = slot.state;
+        }
+
+        if (state == READING && !blocked)
+            blocked = !map(slot, false);
+        else if (state == ENCODED)
+            unmap(slot);
+    }
+}
+
+void FrameCapture::Flush() {
+    for (unsigned int i = 0; i < slots.size(); i++)
+        reclaim(slots[(next + i) % slots.size()]);
+
+    // every slot is free, so the encoder is idle and the stream is safe to touch
+    if (stream.is_open())
+        stream.flush();
+}
+
+void FrameCapture::encodeLoop() {
+    PROFILE_THREAD("capture encoder");
+    while (true) {
+        unsigned int index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            index = queue.front();
+            queue.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = encode(slots[index]);
+        double elapsed = millisecondsSince(start);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[index].state = ENCODED;
+            encodedFrames++;
+            encodeMilliseconds += elapsed;
+            bytesWritten += bytes;
+        }
+        done.notify_all();
+    }
+}
+
+size_t FrameCapture::encode(const Slot &slot) {
+    PROFILE_SCOPE("FrameCapture::encode");
+    if (!slot.mapped) {
+        std::cout << "ERROR::FRAME_CAPTURE::MAP_FAILED" << std::endl;
+        return 0;
+    }
+
+    char name[32];
+    if (format == CaptureFormat::PNG) {
+        std::snprintf(name, sizeof(name), "/capture_%05lu.png", slot.frame);
+        return writePNG(directory + name, slot);
+    } else if (format == CaptureFormat::RAW) {
+        // RGBA, rows top to bottom
+        std::snprintf(name, sizeof(name), "/capture_%05lu.raw", slot.frame);
+        std::ofstream file(directory + name, std::ios::binary);
+        size_t rowBytes = (size_t) slot.width * 4;
+        for (int y = slot.height - 1; y >= 0; y--)
+            file.write((const char *) slot.mapped + y * rowBytes, (std::streamsize) rowBytes);
+        if (!file) {
+            std::cout << "ERROR::FRAME_CAPTURE::CANNOT_WRITE " << directory + name << std::endl;
+            return 0;
+        }
+        return rowBytes * slot.height;
+    }
+    return writeY4M(slot);
+}
+
+void writeChunk(std::ofstream &file, const char *type, const unsigned char *data, size_t size) {
+    unsigned char length[4] = {(unsigned char) (size >> 24), (unsigned char) (size >> 16),
+                               (unsigned char) (size >> 8), (unsigned char) size};
+    uLong crc = crc32(0, (const Bytef *) type, 4);
+    // a null buffer would reset the checksum rather than extend it
+    if (size > 0)
+        crc = crc32(crc, data, (uInt) size);
+    unsigned char checksum[4] = {(unsigned char) (crc >> 24), (unsigned char) (crc >> 16),
+                                 (unsigned char) (crc >> 8), (unsigned char) crc};
+
+    file.write((const char *) length, 4);
+    file.write(type, 4);
+    file.write((const char *) data, (std::streamsize) size);
+    file.write((const char *) checksum, 4);
+}
+
+size_t FrameCapture::writePNG(const std::string &path, const Slot &slot) {
+    // 8 bit RGB, the alpha the scene leaves behind means nothing. Every row uses the Sub filter, storing each byte
+    // as the difference to the pixel on its left, which compresses smooth gradients far better than raw bytes
+    size_t stride = (size_t) slot.width * 3 + 1;
+    rows.resize(stride * slot.height);
+    for (int y = 0; y < slot.height; y++) {
+        const unsigned char *source = slot.mapped + (size_t) (slot.height - 1 - y) * slot.width * 4;
+        unsigned char *row = &rows[y * stride];
+        row[0] = 1;
+        for (int x = 0; x < slot.width; x++) {
+            for (int c = 0; c < 3; c++) {
+                unsigned char left = x > 0 ? source[(x - 1) * 4 + c] : 0;
+                row[1 + x * 3 + c] = (unsigned char) (source[x * 4 + c] - left);
+            }
+        }
+    }
+
+    uLongf compressedSize = compressBound((uLong) rows.size());
+    compressed.resize(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, rows.data(), (uLong) rows.size(), Z_BEST_SPEED) != Z_OK) {
+        std::cout << "ERROR::FRAME_CAPTURE::COMPRESSION_FAILED" << std::endl;
+        return 0;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::FRAME_CAPTURE::CANNOT_WRITE " << path << std::endl;
+        return 0;
+    }
+
+    const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write((const char *) signature, 8);
+
+    unsigned int w = (unsigned int) slot.width, h = (unsigned int) slot.height;
+    const unsigned char header[13] = {(unsigned char) (w >> 24), (unsigned char) (w >> 16), (unsigned char) (w >> 8),
+                                      (unsigned char) w, (unsigned char) (h >> 24), (unsigned char) (h >> 16),
+                                      (unsigned char) (h >> 8), (unsigned char) h,
+                                      8, 2, 0, 0, 0};
+    writeChunk(file, "IHDR", header, sizeof(header));
+    writeChunk(file, "IDAT", compressed.data(), compressedSize);
+    writeChunk(file, "IEND", nullptr, 0);
+
+    return file ? 8 + 3 * 12 + sizeof(header) + compressedSize : 0;
+}
+
+size_t FrameCapture::writeY4M(const Slot &slot) {
+    if (!stream.is_open()) {
+        std::string path = directory + "/capture.y4m";
+        stream.open(path, std::ios::binary);
+        if (!stream) {
+            std::cout << "ERROR::FRAME_CAPTURE::CANNOT_WRITE " << path << std::endl;
+            return 0;
+        }
+        streamWidth = slot.width;
+        streamHeight = slot.height;
+        // full resolution chroma, no subsampling to get wrong on odd sizes
+        stream << "YUV4MPEG2 W" << streamWidth << " H" << streamHeight << " F"
+               << (long) std::lround(framesPerSecond * 1000.0) << ":1000 Ip A1:1 C444\n";
+    }
+    if (slot.width != streamWidth || slot.height != streamHeight) {
+        // a stream can't change size halfway through
+        std::lock_guard<std::mutex> lock(mutex);
+        skippedFrames++;
+        return 0;
+    }
+
+    // BT.601 limited range
+    size_t planeSize = (size_t) slot.width * slot.height;
+    rows.resize(planeSize * 3);
+    unsigned char *Y = rows.data(), *U = Y + planeSize, *V = U + planeSize;
+    for (int y = 0; y < slot.height; y++) {
+        const unsigned char *source = slot.mapped + (size_t) (slot.height - 1 - y) * slot.width * 4;
+        for (int x = 0; x < slot.width; x++) {
+            int r = source[x * 4], g = source[x * 4 + 1], b = source[x * 4 + 2];
+            size_t i = (size_t) y * slot.width + x;
+            Y[i] = (unsigned char) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            U[i] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            V[i] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    stream << "FRAME\n";
+    stream.write((const char *) rows.data(), (std::streamsize) rows.size());
+    return stream ? 6 + rows.size() : 0;
+}
+
+void FrameCapture::Report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+
+    out << "capture: " << frames << " frames read back, " << encodedFrames << " encoded";
+    if (skippedFrames > 0)
+        out << ", " << skippedFrames << " skipped on a size change";
+    out << ", " << (double) bytesWritten / (1024.0 * 1024.0) << " MB written" << std::endl;
+    out << "  render thread waited " << stallMilliseconds << " ms in total, encoding took "
+        << (encodedFrames ? encodeMilliseconds / (double) encodedFrames : 0.0) << " ms per frame" << std::endl;
+
+    out.flags(flags);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat {
+    PNG,
+    RAW,
+    Y4M
+};
+
+// "png", "raw" or "y4m", returns false for anything else
+bool ParseCaptureFormat(const std::string &name, CaptureFormat &format);
+
+// Reads frames back without stalling the pipeline. Capture starts an asynchronous glReadPixels into a pixel buffer
+// object and fences it; Poll maps the buffers whose fence has signaled, a frame or more later, and hands the mapped
+// memory straight to an encoder thread. The buffer is unmapped once the encoder is done with it. The render thread
+// only ever waits when every buffer in the ring is still in use
+class FrameCapture {
+public:
+    // frames go into directory as capture_NNNNN.png / .raw, or as one capture.y4m stream at framesPerSecond
+    FrameCapture(const std::string &directory, CaptureFormat format, double framesPerSecond = 60.0,
+                 unsigned int ringSize = 4);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // queues a readback of the color attachment of FBO, call once the frame is rendered into it
+    void Capture(unsigned int FBO, int width, int height);
+
+    // hands finished readbacks to the encoder and recycles the buffers it's done with, never blocks
+    void Poll();
+
+    // waits for every readback and every encode to finish
+    void Flush();
+
+    void Report(std::ostream &out) const;
+
+private:
+    enum SlotState {
+        FREE,
+        READING,
+        ENCODING,
+        ENCODED
+    };
+
+    struct Slot {
+        unsigned int PBO = 0;
+        size_t capacity = 0;
+        // GLsync of the readback
+        void *fence = nullptr;
+        int width = 0, height = 0;
+        unsigned long frame = 0;
+        const unsigned char *mapped = nullptr;
+        SlotState state = FREE;
+    };
+
+    std::string directory;
+    CaptureFormat format;
+    double framesPerSecond;
+
+    std::vector<Slot> slots;
+    unsigned int next;
+    unsigned long frames;
+
+    // slot states past READING and the encode queue are shared with the encoder thread
+    mutable std::mutex mutex;
+    std::condition_variable wake, done;
+    std::deque<unsigned int> queue;
+    bool stopping;
+    std::thread encoder;
+
+    // the y4m stream, opened on the first frame, which fixes its size
+    std::ofstream stream;
+    int streamWidth, streamHeight;
+
+    // owned by the encoder thread, kept to avoid reallocating every frame
+    std::vector<unsigned char> rows, compressed;
+
+    unsigned long encodedFrames, skippedFrames;
+    double stallMilliseconds, encodeMilliseconds;
+    size_t bytesWritten;
+
+    bool map(Slot &slot, bool wait);
+    void unmap(Slot &slot);
+    void reclaim(Slot &slot);
+    void encodeLoop();
+    // these return the bytes written, 0 on failure
+    size_t encode(const Slot &slot);
+    size_t writePNG(const std::string &path, const Slot &slot);
+    size_t writeY4M(const Slot &slot);
+};
@@ -0,0 +1,122 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "frame_scheduler.hpp"
+#include "gpu_profiler.hpp"
+
+// Timestamp queries in flight, read back this many frames later
+const unsigned int PRESENT_SLOTS = 4;
+// Re-measure the GPU clock offset every so often, the clocks drift apart
+const unsigned long CALIBRATION_INTERVAL = 120;
+
+FrameScheduler::FrameScheduler(double step, unsigned int maxStepsPerFrame, unsigned int window)
+        : step(step), maxStepsPerFrame(maxStepsPerFrame), window(window), lastFrameTime(-1.0), lastElapsed(0.0),
+          accumulator(0.0),
+          simulationTime(0.0), droppedSteps(0), lowLatency(false), previousFence(nullptr),
+          inputTime(0.0), slots(PRESENT_SLOTS), nextSlot(0), presentedFrames(0), gpuToFrameClock(0.0),
+          nextFrameSample(0), nextStepsSample(0), nextLatencySample(0) {
+    for (PresentSlot &slot : slots)
+        glGenQueries(1, &slot.query);
+}
+
+FrameScheduler::~FrameScheduler() {
+    for (PresentSlot &slot : slots)
+        glDeleteQueries(1, &slot.query);
+    if (previousFence)
+        glDeleteSync((GLsync) previousFence);
+}
+
+unsigned int FrameScheduler::BeginFrame(double now) {
+    if (lastFrameTime < 0.0)
+        lastFrameTime = now;
+    double elapsed = now - lastFrameTime;
+    lastFrameTime = now;
+    lastElapsed = elapsed;
+
+    accumulator += elapsed;
+    unsigned int steps = (unsigned int) (accumulator / step);
+    if (steps > maxStepsPerFrame) {
+        droppedSteps += steps - maxStepsPerFrame;
+        steps = maxStepsPerFrame;
+        accumulator = std::fmod(accumulator, step);
+    } else {
+        accumulator -= (double) steps * step;
+    }
+    simulationTime += (double) steps * step;
+
+    if (elapsed > 0.0) {
+        RecordSample(frameMilliseconds, nextFrameSample, window, (float) (elapsed * 1000.0));
+        RecordSample(stepsPerFrame, nextStepsSample, window, (float) steps);
+    }
+    return steps;
+}
+
+void FrameScheduler::WaitForPreviousFrame() {
+    if (!lowLatency || !previousFence)
+        return;
+    glClientWaitSync((GLsync) previousFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync((GLsync) previousFence);
+    previousFence = nullptr;
+}
+
+void FrameScheduler::MarkInputSampled(double now) {
+    inputTime = now;
+}
+
+void FrameScheduler::calibrate(double now) {
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuToFrameClock = now - (double) gpuNow / 1e9;
+}
+
+void FrameScheduler::collect(PresentSlot &slot) {
+    slot.pending = false;
+    int available = 0;
+    glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 finished = 0;
+    glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &finished);
+    double latency = (double) finished / 1e9 + gpuToFrameClock - slot.inputTime;
+    RecordSample(latencyMilliseconds, nextLatencySample, window, (float) (latency * 1000.0));
+}
+
+void FrameScheduler::MarkPresented(double now) {
+    if (presentedFrames++ % CALIBRATION_INTERVAL == 0)
+        calibrate(now);
+
+    PresentSlot &slot = slots[nextSlot];
+    nextSlot = (nextSlot + 1) % slots.size();
+    if (slot.pending)
+        collect(slot);
+
+    // the GPU reaches this point once everything submitted for the frame, the swap included, has executed
+    glQueryCounter(slot.query, GL_TIMESTAMP);
+    slot.inputTime = inputTime;
+    slot.pending = true;
+
+    if (previousFence)
+        glDeleteSync((GLsync) previousFence);
+    previousFence = lowLatency ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : nullptr;
+}
+
+void FrameScheduler::Report(std::ostream &out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+
+    out << "frame scheduler: " << 1.0 / step << " Hz simulation, " << average(stepsPerFrame)
+        << " steps/frame, " << droppedSteps << " steps dropped, low latency " << (lowLatency ? "on" : "off")
+        << std::endl;
+    out << "  frame time      avg " << average(frameMilliseconds) << "  p50 " << percentile(frameMilliseconds, 0.5f)
+        << "  p95 " << percentile(frameMilliseconds, 0.95f) << "  p99 " << percentile(frameMilliseconds, 0.99f)
+        << " ms" << std::endl;
+    // up to the GPU finishing the frame, scanout comes on top of this
+    out << "  input to photon avg " << average(latencyMilliseconds) << "  p50 "
+        << percentile(latencyMilliseconds, 0.5f) << "  p95 " << percentile(latencyMilliseconds, 0.95f)
+        << "  p99 " << percentile(latencyMilliseconds, 0.99f) << " ms" << std::endl;
+
+    out.flags(flags);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+// Runs the simulation at a fixed step regardless of the frame rate. Every frame the elapsed time is added to an
+// accumulator and whole steps are taken out of it; what's left over tells the renderer how far to interpolate between
+// the last two simulated states. Also records frame times and an input to photon estimate per frame
+class FrameScheduler {
+public:
+    explicit FrameScheduler(double step = 1.0 / 120.0, unsigned int maxStepsPerFrame = 8, unsigned int window = 240);
+    ~FrameScheduler();
+
+    FrameScheduler(const FrameScheduler &) = delete;
+    FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+    // measures the frame and returns how many simulation steps to run. After a long stall the steps are capped and
+    // the rest of the backlog is dropped instead of making the next frame even longer
+    unsigned int BeginFrame(double now);
+
+    double Step() const { return step; }
+
+    // time of the latest simulated state
+    double SimulationTime() const { return simulationTime; }
+
+    // wall time between the last two frames
+    float FrameMilliseconds() const { return (float) (lastElapsed * 1000.0); }
+
+    // fraction of a step the frame lies past the latest state, render state = mix(previous, latest, Alpha())
+    float Alpha() const { return (float) (accumulator / step); }
+
+    // the time rendered this frame, a step behind the simulation plus the interpolation. Held at zero until the first
+    // step, when there is nothing a step behind to show
+    double RenderTime() const { return std::max(0.0, simulationTime - step + accumulator); }
+
+    // low latency keeps at most one frame queued on the GPU: WaitForPreviousFrame blocks until the last one is done,
+    // so input sampled after it is never waiting behind other frames
+    void SetLowLatency(bool enabled) { lowLatency = enabled; }
+    bool LowLatency() const { return lowLatency; }
+    void WaitForPreviousFrame();
+
+    // when the input used for the camera was read
+    void MarkInputSampled(double now);
+
+    // right after the swap: fences the frame and timestamps the point the GPU finishes it
+    void MarkPresented(double now);
+
+    void Report(std::ostream &out) const;
+
+private:
+    struct PresentSlot {
+        unsigned int query = 0;
+        double inputTime = 0.0;
+        bool pending = false;
+    };
+
+    double step;
+    unsigned int maxStepsPerFrame;
+    unsigned int window;
+
+    double lastFrameTime;
+    double lastElapsed;
+    double accumulator;
+    double simulationTime;
+    unsigned long droppedSteps;
+
+    bool lowLatency;
+    // GLsync of the last presented frame
+    void *previousFence;
+    double inputTime;
+
+    std::vector<PresentSlot> slots;
+    unsigned int nextSlot;
+    unsigned long presentedFrames;
+    // GPU timestamps in seconds plus this offset give the time the frame clock runs on
+    double gpuToFrameClock;
+
+    std::vector<float> frameMilliseconds, stepsPerFrame, latencyMilliseconds;
+    size_t nextFrameSample, nextStepsSample, nextLatencySample;
+
+    void collect(PresentSlot &slot);
+    void calibrate(double now);
+};
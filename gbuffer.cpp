@@ -0,0 +1,100 @@
+#include <glad/glad.h>
+#include <iostream>
+
+#include "gbuffer.hpp"
+
+const unsigned int ALBEDO_SPEC_BYTES = 4;
+const unsigned int NORMAL_BYTES = 4;
+const unsigned int DEPTH_BYTES = 4;
+
+unsigned int createTarget(GLint internalFormat, GLenum format, GLenum type, int width, int height) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    // the lighting pass reads exactly one texel per fragment
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+GBuffer::GBuffer(int width, int height) : width(width), height(height) {
+    allocate();
+}
+
+GBuffer::~GBuffer() {
+    release();
+}
+
+void GBuffer::Resize(int width, int height) {
+    if (width == this->width && height == this->height)
+        return;
+
+    this->width = width;
+    this->height = height;
+
+    release();
+    allocate();
+}
+
+void GBuffer::allocate() {
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+    albedoSpec = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    normal = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+    depth = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpec, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+    unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, attachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GBuffer::release() {
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &albedoSpec);
+    glDeleteTextures(1, &normal);
+    glDeleteTextures(1, &depth);
+}
+
+void GBuffer::BindForWriting() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, width, height);
+}
+
+void GBuffer::BindForReading(unsigned int firstUnit) const {
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, albedoSpec);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, normal);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+unsigned int GBuffer::BytesPerPixel() {
+    return ALBEDO_SPEC_BYTES + NORMAL_BYTES + DEPTH_BYTES;
+}
+
+void GBuffer::Report() const {
+    double pixels = (double) width * (double) height;
+    double megabytes = pixels * BytesPerPixel() / (1024.0 * 1024.0);
+
+    // the geometry pass writes every attachment once per covered pixel (more with overdraw), the lighting pass reads
+    // them all back once
+    std::cout << "G-buffer " << width << "x" << height << ": " << BytesPerPixel() << " bytes/pixel ("
+              << ALBEDO_SPEC_BYTES << " albedo+specular, " << NORMAL_BYTES << " normal, " << DEPTH_BYTES << " depth), "
+              << megabytes << " MB, ~" << megabytes * 2.0 << " MB/frame written+read without overdraw" << std::endl;
+}
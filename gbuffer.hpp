@@ -0,0 +1,40 @@
+#pragma once
+
+// Render targets for the deferred path. Only what the lighting pass can't rebuild is stored:
+//   0: RGBA8  albedo in rgb, specular intensity in a
+//   1: RG16   normal, octahedral encoded
+//   depth: 24 bit depth texture, positions are reconstructed from it with the inverse projection
+class GBuffer {
+public:
+    GBuffer(int width, int height);
+    ~GBuffer();
+
+    GBuffer(const GBuffer &) = delete;
+    GBuffer &operator=(const GBuffer &) = delete;
+
+    // reallocates the attachments if the size changed
+    void Resize(int width, int height);
+
+    // binds the framebuffer for the geometry pass
+    void BindForWriting() const;
+
+    // binds albedo/specular, normal and depth to three consecutive texture units
+    void BindForReading(unsigned int firstUnit) const;
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // storage per pixel across all attachments, depth counted as 4 bytes since that's how drivers lay it out
+    static unsigned int BytesPerPixel();
+
+    // prints the memory footprint and the per-frame traffic of the geometry and lighting passes
+    void Report() const;
+
+private:
+    int width, height;
+    unsigned int FBO;
+    unsigned int albedoSpec, normal, depth;
+
+    void allocate();
+    void release();
+};
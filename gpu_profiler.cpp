@@ -0,0 +1,235 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "gpu_profiler.hpp"
+#include "cpu_profiler.hpp"
+
+// Frames of resolved scopes kept around for the trace export
+const size_t HISTORY_FRAMES = 300;
+// The GPU and CPU clocks drift apart slowly, re-measure the offset every so often
+const unsigned long CALIBRATION_INTERVAL = 120;
+
+float percentile(std::vector<float> values, float p) {
+    if (values.empty())
+        return 0.0f;
+    size_t index = std::min(values.size() - 1, (size_t) (p * (float) values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+float average(const std::vector<float> &values) {
+    if (values.empty())
+        return 0.0f;
+    float sum = 0.0f;
+    for (float value : values)
+        sum += value;
+    return sum / (float) values.size();
+}
+
+void RecordSample(std::vector<float> &samples, size_t &next, unsigned int window, float value) {
+    if (samples.size() < window)
+        samples.push_back(value);
+    else
+        samples[next] = value;
+    next = (next + 1) % window;
+}
+
+double GpuProfiler::NowMicroseconds() {
+    return CpuProfiler::NowMicroseconds();
+}
+
+GpuProfiler::GpuProfiler(unsigned int framesInFlight, unsigned int window) : slots(std::max(2u, framesInFlight)),
+                                                                             current(0), frame(0), window(window),
+                                                                             droppedFrames(0), gpuToCpuOffset(0.0) {
+    calibrate();
+}
+
+GpuProfiler::~GpuProfiler() {
+    for (FrameSlot &slot : slots) {
+        if (!slot.queries.empty())
+            glDeleteQueries((GLsizei) slot.queries.size(), slot.queries.data());
+    }
+}
+
+void GpuProfiler::calibrate() {
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuToCpuOffset = NowMicroseconds() - (double) gpuNow / 1000.0;
+}
+
+unsigned int GpuProfiler::takeQuery(FrameSlot &slot) {
+    if (slot.usedQueries == slot.queries.size()) {
+        // grow in chunks, the slot settles on however many the frame needs
+        size_t grow = std::max<size_t>(16, slot.queries.size());
+        slot.queries.resize(slot.queries.size() + grow);
+        glGenQueries((GLsizei) grow, slot.queries.data() + slot.queries.size() - grow);
+    }
+    return slot.queries[slot.usedQueries++];
+}
+
+void GpuProfiler::collect(FrameSlot &slot) {
+    slot.pending = false;
+    if (slot.scopes.empty())
+        return;
+
+    // the last query issued in the frame finishes last, if it's done so is everything before it
+    int available = 0;
+    glGetQueryObjectiv(slot.scopes.front().endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        droppedFrames++;
+        return;
+    }
+
+    for (const ScopeRecord &scope : slot.scopes) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+
+        float gpuMilliseconds = (float) (end - begin) / 1e6f;
+        float cpuMilliseconds = (float) (scope.cpuEnd - scope.cpuBegin) / 1000.0f;
+
+        auto found = samples.find(scope.name);
+        if (found == samples.end()) {
+            names.push_back(scope.name);
+            found = samples.emplace(scope.name, Samples()).first;
+        }
+        Samples &s = found->second;
+        if (s.gpu.size() < window) {
+            s.gpu.push_back(gpuMilliseconds);
+            s.cpu.push_back(cpuMilliseconds);
+        } else {
+            s.gpu[s.next] = gpuMilliseconds;
+            s.cpu[s.next] = cpuMilliseconds;
+        }
+        s.next = (s.next + 1) % window;
+        s.count++;
+
+        history.push_back({scope.name, scope.depth, slot.frame,
+                           (double) begin / 1000.0 + gpuToCpuOffset, (double) end / 1000.0 + gpuToCpuOffset,
+                           scope.cpuBegin, scope.cpuEnd});
+    }
+
+    while (!history.empty() && history.front().frame + HISTORY_FRAMES < slot.frame)
+        history.pop_front();
+}
+
+void GpuProfiler::BeginFrame() {
+    frame++;
+    current = frame % slots.size();
+
+    FrameSlot &slot = slots[current];
+    if (slot.pending)
+        collect(slot);
+    slot.scopes.clear();
+    slot.usedQueries = 0;
+    slot.frame = frame;
+
+    if (frame % CALIBRATION_INTERVAL == 0)
+        calibrate();
+
+    Begin("frame");
+}
+
+void GpuProfiler::EndFrame() {
+    // close anything left open so the slot is consistent
+    while (!open.empty())
+        End();
+    slots[current].pending = true;
+}
+
+void GpuProfiler::Begin(const std::string &name) {
+    FrameSlot &slot = slots[current];
+
+    ScopeRecord scope;
+    scope.name = name;
+    scope.depth = (int) open.size();
+    scope.beginQuery = takeQuery(slot);
+    scope.endQuery = takeQuery(slot);
+    scope.cpuBegin = NowMicroseconds();
+    scope.cpuEnd = scope.cpuBegin;
+    glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+
+    open.push_back((unsigned int) slot.scopes.size());
+    slot.scopes.push_back(scope);
+}
+
+void GpuProfiler::End() {
+    if (open.empty())
+        return;
+
+    ScopeRecord &scope = slots[current].scopes[open.back()];
+    open.pop_back();
+    glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+    scope.cpuEnd = NowMicroseconds();
+}
+
+float GpuProfiler::AverageMilliseconds(const std::string &name) const {
+    auto found = samples.find(name);
+    return found == samples.end() ? 0.0f : average(found->second.gpu);
+}
+
+unsigned long GpuProfiler::SampleCount(const std::string &name) const {
+    auto found = samples.find(name);
+    return found == samples.end() ? 0 : found->second.count;
+}
+
+float GpuProfiler::LatestMilliseconds(const std::string &name) const {
+    auto found = samples.find(name);
+    if (found == samples.end() || found->second.gpu.empty())
+        return 0.0f;
+    const Samples &s = found->second;
+    return s.gpu[(s.next + s.gpu.size() - 1) % s.gpu.size()];
+}
+
+void GpuProfiler::Report(std::ostream &out) const {
+    std::ios::fmtflags flags = out.flags();
+
+    out << std::left << std::setw(28) << "scope" << std::right << std::setw(10) << "gpu avg" << std::setw(10)
+        << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "cpu avg" << std::endl;
+    out << std::fixed << std::setprecision(3);
+
+    // depth of each scope as last seen, for indentation
+    std::map<std::string, int> depths;
+    for (const TraceEvent &event : history)
+        depths[event.name] = event.depth;
+
+    for (const std::string &name : names) {
+        const Samples &s = samples.at(name);
+        std::string label = std::string(2 * depths[name], ' ') + name;
+        out << std::left << std::setw(28) << label << std::right
+            << std::setw(10) << average(s.gpu) << std::setw(10) << percentile(s.gpu, 0.5f)
+            << std::setw(10) << percentile(s.gpu, 0.95f) << std::setw(10) << percentile(s.gpu, 0.99f)
+            << std::setw(10) << average(s.cpu) << std::endl;
+    }
+    out << droppedFrames << " frames dropped waiting for queries" << std::endl;
+
+    out.flags(flags);
+}
+
+bool GpuProfiler::ExportChromeTrace(const std::string &path, const std::string &extraEvents) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::GPU_PROFILER::CANNOT_WRITE_TRACE " << path << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"Render thread (submission)\"}}";
+
+    for (const TraceEvent &event : history) {
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << event.gpuBegin
+             << ",\"dur\":" << event.gpuEnd - event.gpuBegin << ",\"args\":{\"frame\":" << event.frame << "}}";
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":" << event.cpuBegin
+             << ",\"dur\":" << event.cpuEnd - event.cpuBegin << ",\"args\":{\"frame\":" << event.frame << "}}";
+    }
+    if (!extraEvents.empty())
+        file << ",\n" << extraEvents;
+
+    file << "\n]}\n";
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Statistics over a window of samples, shared by the reports
+float percentile(std::vector<float> values, float p);
+float average(const std::vector<float> &values);
+// appends value to a window of the latest samples, overwriting the oldest at next once it is full
+void RecordSample(std::vector<float> &samples, size_t &next, unsigned int window, float value);
+
+// Times nested scopes on the GPU with GL_TIMESTAMP queries, and the same scopes on the CPU. Queries go into a ring
+// of per-frame slots and are only read back when the slot comes around again a few frames later, by which point the
+// GPU has normally finished with them, so profiling never waits on the GPU. Frames whose queries still aren't done
+// are dropped rather than waited for
+class GpuProfiler {
+public:
+    explicit GpuProfiler(unsigned int framesInFlight = 4, unsigned int window = 240);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // reads back the slot being reused and opens the "frame" scope
+    void BeginFrame();
+    void EndFrame();
+
+    void Begin(const std::string &name);
+    void End();
+
+    // rolling statistics over the last window frames, in milliseconds
+    float AverageMilliseconds(const std::string &name) const;
+
+    // the most recent sample, which trails the current frame by the number of frames in flight
+    float LatestMilliseconds(const std::string &name) const;
+    // samples read back so far. Frames whose queries weren't done are dropped, so a frame can go by without a new
+    // sample; this tells a new LatestMilliseconds from one already seen
+    unsigned long SampleCount(const std::string &name) const;
+    void Report(std::ostream &out) const;
+
+    // writes the retained history of GPU and CPU scopes in the Chrome trace event format, viewable in
+    // chrome://tracing or Perfetto. extraEvents is spliced into the event array as is
+    bool ExportChromeTrace(const std::string &path, const std::string &extraEvents = "") const;
+
+    // microseconds on the clock the CPU scopes (and the exported trace) use, the same one CpuProfiler records on
+    static double NowMicroseconds();
+
+private:
+    struct ScopeRecord {
+        std::string name;
+        int depth;
+        unsigned int beginQuery, endQuery;
+        double cpuBegin, cpuEnd;
+    };
+
+    struct FrameSlot {
+        std::vector<ScopeRecord> scopes;
+        std::vector<unsigned int> queries;
+        unsigned int usedQueries = 0;
+        unsigned long frame = 0;
+        bool pending = false;
+    };
+
+    struct Samples {
+        std::vector<float> gpu, cpu;
+        size_t next = 0;
+        unsigned long count = 0;
+    };
+
+    struct TraceEvent {
+        std::string name;
+        int depth;
+        unsigned long frame;
+        double gpuBegin, gpuEnd;
+        double cpuBegin, cpuEnd;
+    };
+
+    std::vector<FrameSlot> slots;
+    unsigned int current;
+    unsigned long frame;
+    unsigned int window;
+    unsigned long droppedFrames;
+    std::vector<unsigned int> open;
+
+    std::map<std::string, Samples> samples;
+    // report order, which is the order scopes were first seen in
+    std::vector<std::string> names;
+    std::deque<TraceEvent> history;
+
+    // GPU timestamps plus this offset give microseconds on the CPU clock
+    double gpuToCpuOffset;
+
+    unsigned int takeQuery(FrameSlot &slot);
+    void collect(FrameSlot &slot);
+    void calibrate();
+};
+
+// Times the enclosing block
+class GpuScope {
+public:
+    GpuScope(GpuProfiler &profiler, const std::string &name) : profiler(profiler) { profiler.Begin(name); }
+    ~GpuScope() { profiler.End(); }
+
+private:
+    GpuProfiler &profiler;
+};
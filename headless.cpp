@@ -0,0 +1,166 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.hpp"
+
+bool CameraPath::Load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    keys.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        Key key;
+        if (in >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch)
+            keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) { return a.time < b.time; });
+
+    if (keys.empty()) {
+        std::cout << "ERROR::CAMERA_PATH::NO_KEYFRAMES " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CameraPath CameraPath::Orbit(float radius, float height, float period) {
+    const int KEYS = 64;
+    CameraPath orbit;
+    orbit.looping = true;
+    float pitch = -glm::degrees(std::atan2(height, radius));
+    for (int i = 0; i <= KEYS; i++) {
+        float angle = 360.0f * (float) i / (float) KEYS;
+        float radians = glm::radians(angle);
+        // facing the origin means looking back along the direction to the camera
+        glm::vec3 position(radius * std::cos(radians), height, -radius * std::sin(radians));
+        orbit.keys.push_back({period * (float) i / (float) KEYS, position, angle + 180.0f, pitch});
+    }
+    return orbit;
+}
+
+CameraPath CameraPath::FlyOver(const glm::vec3 &from, const glm::vec3 &to, float duration) {
+    CameraPath flight;
+    glm::vec3 direction = to - from;
+    // yaw 0 looks down +x and 90 down -z, as in Camera
+    float yaw = glm::degrees(std::atan2(-direction.z, direction.x));
+    float pitch = glm::degrees(std::atan2(direction.y, glm::length(glm::vec2(direction.x, direction.z))));
+    flight.keys.push_back({0.0f, from, yaw, pitch});
+    flight.keys.push_back({duration, to, yaw, pitch});
+    return flight;
+}
+
+void CameraPath::Apply(Camera &camera, float time) const {
+    if (keys.empty())
+        return;
+
+    float start = keys.front().time, end = keys.back().time;
+    if (looping && end > start)
+        time = start + std::fmod(std::max(0.0f, time - start), end - start);
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key &key) { return t < key.time; });
+    if (next == keys.begin() || next == keys.end()) {
+        const Key &key = next == keys.begin() ? keys.front() : keys.back();
+        camera.Position = key.position;
+        camera.SetOrientation(key.yaw, key.pitch);
+        return;
+    }
+
+    const Key &a = *(next - 1), &b = *next;
+    float t = (time - a.time) / (b.time - a.time);
+    camera.Position = glm::mix(a.position, b.position, t);
+    camera.SetOrientation(a.yaw + (b.yaw - a.yaw) * t, a.pitch + (b.pitch - a.pitch) * t);
+}
+
+#ifdef HEADLESS
+HeadlessContext::HeadlessContext() : display(nullptr), context(nullptr) {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+    if (eglDisplay == EGL_NO_DISPLAY && getPlatformDisplay) {
+        auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+        EGLDeviceEXT device;
+        EGLint deviceCount = 0;
+        if (queryDevices && queryDevices(1, &device, &deviceCount) && deviceCount > 0)
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+    }
+
+    if (eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+        return;
+    }
+    display = eglDisplay;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "ERROR::HEADLESS::NO_DESKTOP_GL" << std::endl;
+        return;
+    }
+
+    // the surface type defaults to windows, which a surfaceless display has no configs for
+    const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, 0,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        std::cout << "ERROR::HEADLESS::NO_EGL_CONFIG" << std::endl;
+        return;
+    }
+
+    const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << std::endl;
+        return;
+    }
+
+    // no surface at all, which needs EGL_KHR_surfaceless_context
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        std::cout << "ERROR::HEADLESS::MAKE_CURRENT_FAILED" << std::endl;
+        eglDestroyContext(eglDisplay, eglContext);
+        return;
+    }
+    context = eglContext;
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (context) {
+        eglMakeCurrent((EGLDisplay) display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay) display, (EGLContext) context);
+    }
+    if (display)
+        eglTerminate((EGLDisplay) display);
+}
+
+void *HeadlessContext::GetProcAddress(const char *name) {
+    return (void *) eglGetProcAddress(name);
+}
+#endif
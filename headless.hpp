@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.hpp"
+#include "frame_capture.hpp"
+
+// Options of a headless run, parsed along with the renderer's in options.hpp:
+//   --headless [--size WxH] [--frames N] [--fps F] [--camera-path file] [--output directory] [--format png|raw|y4m]
+//              [--dynamic-resolution milliseconds [--min-scale s] [--max-scale s]]
+// Without --output frames are rendered but not read back, which makes the run a throughput benchmark
+struct HeadlessOptions {
+    bool enabled = false;
+    int width = 1280, height = 720;
+    unsigned int frames = 240;
+    double framesPerSecond = 60.0;
+    std::string cameraPath;
+    std::string outputDirectory;
+    CaptureFormat format = CaptureFormat::PNG;
+    // a frame time budget turns dynamic resolution on
+    float dynamicResolutionMilliseconds = 0.0f;
+    float minScale = 0.5f, maxScale = 1.0f;
+};
+
+// Camera keyframes, one per line as "time x y z yaw pitch" with # starting a comment. Linearly interpolated in
+// between, clamped at the ends unless the path loops
+class CameraPath {
+public:
+    bool Load(const std::string &path);
+
+    // a circle around the origin, for runs without a path file
+    static CameraPath Orbit(float radius, float height, float period);
+
+    // a straight flight from one point to another, looking ahead
+    static CameraPath FlyOver(const glm::vec3 &from, const glm::vec3 &to, float duration);
+
+    void Apply(Camera &camera, float time) const;
+
+private:
+    struct Key {
+        float time;
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+
+    std::vector<Key> keys;
+    bool looping = false;
+};
+
+#ifdef HEADLESS
+// An OpenGL 3.3 core context with no window and no display server, through EGL. Tries Mesa's surfaceless platform
+// first (which is what llvmpipe runs on), then the first EGL device, then the default display. Rendering has to go to
+// a framebuffer object, there is no default framebuffer
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    bool Valid() const { return context != nullptr; }
+
+    // for gladLoadGLLoader
+    static void *GetProcAddress(const char *name);
+
+private:
+    void *display;
+    void *context;
+};
+#endif
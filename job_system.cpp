@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "job_system.hpp"
+#include "cpu_profiler.hpp"
+#include "transform.hpp"
+
+bool JobDeque::Push(Job *job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+    buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job *JobDeque::Pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // the last job, thieves may be after it too
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *JobDeque::Steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job *job = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+// the worker threads know which system and deque they belong to, the creating thread is recognized by its id
+static thread_local const JobSystem *workerSystem = nullptr;
+static thread_local int workerIndex = -1;
+
+JobSystem::JobSystem(unsigned int workerCount) : owner(std::this_thread::get_id()) {
+    for (unsigned int i = 0; i <= workerCount; i++)
+        deques.push_back(std::make_unique<JobDeque>());
+    for (unsigned int i = 1; i <= workerCount; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+JobSystem &JobSystem::Instance() {
+    static JobSystem system(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return system;
+}
+
+int JobSystem::localIndex() const {
+    if (std::this_thread::get_id() == owner)
+        return 0;
+    return workerSystem == this ? workerIndex : -1;
+}
+
+void JobSystem::push(Job *job) {
+    // counted before it becomes visible, so a thief can never take the count below zero
+    queued.fetch_add(1);
+    int index = localIndex();
+    if (index >= 0) {
+        if (!deques[index]->Push(job)) {
+            queued.fetch_sub(1);
+            execute(job);
+            return;
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        injected.push_back(job);
+    }
+
+    // a worker going to sleep registers before it checks queued, so either it sees the job or it gets woken
+    if (sleeping.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+}
+
+Job *JobSystem::take(int index, uint32_t &seed) {
+    Job *job = index >= 0 ? deques[index]->Pop() : nullptr;
+
+    if (!job) {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        if (!injected.empty()) {
+            job = injected.front();
+            injected.pop_front();
+        }
+    }
+
+    if (!job) {
+        // xorshift picks where to start, so thieves don't all line up behind the same victim
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        size_t count = deques.size();
+        for (size_t k = 0; k < count && !job; k++) {
+            size_t victim = (seed + k) % count;
+            if ((int) victim == index)
+                continue;
+            job = deques[victim]->Steal();
+            if (job)
+                jobsStolen++;
+        }
+    }
+
+    if (job)
+        queued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::execute(Job *job) {
+    job->work();
+    jobsRun++;
+    JobCounter *counter = job->counter;
+    delete job;
+    if (!counter)
+        return;
+
+    // under the lock, so a job being attached as a continuation either sees the counter pending or runs right away
+    std::vector<Job *> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations);
+    }
+    for (Job *next : ready)
+        push(next);
+}
+
+void JobSystem::Run(std::function<void()> work, JobCounter *counter, JobCounter *after) {
+    Job *job = new Job{std::move(work), counter};
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    if (after) {
+        std::lock_guard<std::mutex> lock(after->mutex);
+        if (after->pending.load(std::memory_order_acquire) > 0) {
+            after->continuations.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+void JobSystem::Wait(JobCounter &counter) {
+    int index = localIndex();
+    uint32_t seed = 2463534242u + (uint32_t) (index + 1) * 2654435761u;
+    while (!counter.Done()) {
+        Job *job = take(index, seed);
+        if (job)
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+    // the job that finished the counter may still be holding its lock, the counter can only go once it lets go
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &f) {
+    if (count == 0)
+        return;
+
+    // a few ranges per thread, so the ones finishing early have something left to steal
+    size_t ranges = std::min<size_t>(Threads() * 4, (count + std::max<size_t>(1, grain) - 1) / std::max<size_t>(1, grain));
+    if (ranges <= 1) {
+        f(0, count);
+        return;
+    }
+
+    size_t perRange = (count + ranges - 1) / ranges;
+    JobCounter counter;
+    for (size_t first = perRange; first < count; first += perRange) {
+        size_t last = std::min(first + perRange, count);
+        Run([&f, first, last]() { f(first, last); }, &counter);
+    }
+    f(0, perRange);
+    Wait(counter);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, unsigned int threads, size_t threshold,
+                            const std::function<void(size_t, size_t)> &f) {
+    if (threads == 1 || (threads == 0 && count < threshold)) {
+        f(0, count);
+        return;
+    }
+    ParallelFor(count, grain, f);
+}
+
+void JobSystem::Report(std::ostream &out) {
+    out << "Jobs: " << jobsRun.exchange(0) << " run, " << jobsStolen.exchange(0) << " stolen, on " << Threads()
+        << " threads" << std::endl;
+}
+
+void JobSystem::workerLoop(unsigned int index) {
+    workerSystem = this;
+    workerIndex = (int) index;
+    PROFILE_THREAD("job worker");
+    uint32_t seed = 2463534242u + index * 2654435761u;
+
+    while (!stopping) {
+        Job *job = take((int) index, seed);
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping++;
+        wake.wait(lock, [&]() { return stopping || queued.load() > 0; });
+        sleeping--;
+    }
+}
+
+void BenchmarkJobs(std::ostream &out, unsigned int count) {
+    std::vector<Transform> transforms(count);
+    for (unsigned int i = 0; i < count; i++) {
+        transforms[i].position = glm::vec3((float) i, 0.0f, 0.0f);
+        transforms[i].rotation = glm::angleAxis((float) i * 0.001f, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    std::vector<glm::mat4> matrices(count);
+    std::vector<float> values(count);
+
+    const int repeats = 10;
+    auto milliseconds = [&](const std::function<void()> &run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++)
+            run();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+    };
+
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < hardware; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardware);
+
+    out << count << " elements, milliseconds per run (speedup over one thread):" << std::endl;
+    double baseCompose = 0.0, baseMath = 0.0;
+    for (unsigned int threads : threadCounts) {
+        JobSystem jobs(threads - 1);
+        double compose = milliseconds([&]() {
+            jobs.ParallelFor(count, 1024, [&](size_t first, size_t last) {
+                ComposeTransforms(&transforms[first], last - first, &matrices[first]);
+            });
+        });
+        // arithmetic only, which should scale with the cores where composing is bound by memory
+        double math = milliseconds([&]() {
+            jobs.ParallelFor(count, 1024, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    float x = (float) i;
+                    for (int k = 0; k < 16; k++)
+                        x = std::sqrt(x * 0.5f + 1.0f) + std::sin(x);
+                    values[i] = x;
+                }
+            });
+        });
+        if (threads == 1) {
+            baseCompose = compose;
+            baseMath = math;
+        }
+        out << "  " << threads << " thread" << (threads > 1 ? "s" : "") << ": compose transforms " << compose << " ("
+            << baseCompose / compose << "x), arithmetic " << math << " (" << baseMath / math << "x)" << std::endl;
+    }
+}
+
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+struct Job {
+    std::function<void()> work;
+    class JobCounter *counter;
+};
+
+// Chase and Lev's work stealing deque, in the form Lê et al. give for weak memory models. The owning thread pushes and
+// pops at the bottom without locking, other threads steal from the top with one compare and swap. Fixed capacity, a
+// push into a full deque fails and the caller runs the job itself
+class JobDeque {
+public:
+    static const int64_t CAPACITY = 4096;
+
+    bool Push(Job *job);
+    // owner only, newest first
+    Job *Pop();
+    // any thread, oldest first. nullptr when empty or when another thief won the race
+    Job *Steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Job *> buffer[CAPACITY];
+};
+
+// Counts the jobs started with it that haven't finished. Jobs started after it run once it reaches zero
+class JobCounter {
+public:
+    JobCounter() = default;
+
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> pending{0};
+    std::mutex mutex;
+    std::vector<Job *> continuations;
+};
+
+// Worker threads with a deque each, plus the thread that created the system which takes part whenever it waits. A
+// thread runs the newest job of its own deque and, once that is empty, steals the oldest job of a random other one,
+// so work spawned from a job stays on the cache that spawned it while idle threads take the large old pieces. Jobs
+// started by threads outside the system go through a locked queue.
+//
+// Waiting on a counter runs other jobs until the counter reaches zero, there are no fibers to switch to. A job may
+// wait on jobs it started itself, since the wait runs them. Idle workers sleep until something is queued
+class JobSystem {
+public:
+    // workerCount threads on top of the calling one
+    explicit JobSystem(unsigned int workerCount);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // one worker per core besides the thread that first asks for it
+    static JobSystem &Instance();
+
+    // counter, when given, counts the job until it has run. With after given the job only starts once after is done
+    void Run(std::function<void()> work, JobCounter *counter = nullptr, JobCounter *after = nullptr);
+
+    // runs jobs until counter is done
+    void Wait(JobCounter &counter);
+
+    // f(first, last) over [0, count) in ranges of at least grain, split across the threads, and waits for all of them
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &f);
+
+    // the same, steered by the threads argument the scene systems and the other batch work take: 0 keeps counts
+    // below threshold on the calling thread and splits larger ones, 1 keeps everything on the calling thread and
+    // anything else always splits
+    void ParallelFor(size_t count, size_t grain, unsigned int threads, size_t threshold,
+                     const std::function<void(size_t, size_t)> &f);
+
+    unsigned int Threads() const { return (unsigned int) deques.size(); }
+
+    // jobs run and stolen since the last report
+    void Report(std::ostream &out);
+
+private:
+    std::vector<std::unique_ptr<JobDeque>> deques;
+    std::vector<std::thread> workers;
+    std::thread::id owner;
+
+    std::mutex injectedMutex;
+    std::deque<Job *> injected;
+
+    std::atomic<int> queued{0};
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    std::atomic<unsigned long> jobsRun{0}, jobsStolen{0};
+
+    // the deque of the calling thread, -1 for threads outside the system
+    int localIndex() const;
+    void push(Job *job);
+    // takes a job from the thread's own deque, the injected queue or another deque. nullptr if there is none
+    Job *take(int index, uint32_t &seed);
+    void execute(Job *job);
+    void workerLoop(unsigned int index);
+};
+
+// Runs the workload of the scene systems and a synthetic one on job systems of 1 up to every core and prints the
+// speedups
+void BenchmarkJobs(std::ostream &out, unsigned int count);
@@ -1,4 +1,9 @@
+#include <chrono>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -6,12 +11,37 @@
 #include "shader.hpp"
 #include "camera.hpp"
 #include "model.hpp"
+#include "clusters.hpp"
+#include "gbuffer.hpp"
+#include "shadows.hpp"
+#include "postprocess.hpp"
+#include "render_target_pool.hpp"
+#include "render_graph.hpp"
+#include "gpu_profiler.hpp"
+#include "cpu_profiler.hpp"
+#include "frame_scheduler.hpp"
+#include "options.hpp"
+#include "frame_capture.hpp"
+#include "dynamic_resolution.hpp"
+#include "transparency.hpp"
+#include "vegetation.hpp"
+#include "depth_prepass.hpp"
+#include "scene_systems.hpp"
+#include "world_streamer.hpp"
+#include "job_system.hpp"
+#include "command_list.hpp"
+#include "animation.hpp"
+#include "compressed_clip.hpp"
+#include "environment_lighting.hpp"
+#include "screen_quad.hpp"
+#include "normal_matrix.hpp"
 
 unsigned int loadTexture(const std::string &path);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const unsigned int NR_LIGHTS = 1024;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -19,33 +49,101 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-float deltaTime;
-float lastFrame;
+// L switches the frame scheduler's low latency mode
+bool toggleLowLatency = false;
+
+// C starts and stops recording the window into capture/
+bool toggleCapture = false;
+
+// R switches dynamic resolution, T also writes its frame time trace to resolution.csv
+bool toggleDynamicResolution = false;
+
+// O switches transparency between sorted and weighted blended, - and = halve and double the number of windows
+bool toggleTransparency = false;
+int resizeTransparent = 0;
+
+// F1 switches the opaque geometry between forward and deferred shading
+bool deferred = false;
+bool reportGBuffer = false;
+
+// Z switches the depth pre-pass of forward shading
+bool toggleDepthPrepass = false;
+
+// K switches the opaque passes between command lists and drawing every model directly
+bool toggleCommandLists = false;
+
+// 1-9 toggle post processing passes, P prints the profiler report, T writes trace.json
+int togglePostPass = -1;
+bool reportPostProcess = false;
+bool exportTrace = false;
+
+// G prints the compiled render graph of the next frame
+bool dumpRenderGraph = false;
 
 float screenRatio = (float) SCR_WIDTH / (float) SCR_HEIGHT;
+int screenWidth = SCR_WIDTH;
+int screenHeight = SCR_HEIGHT;
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     glViewport(0, 0, width, height);
+    screenWidth = width;
+    screenHeight = height;
     screenRatio = (float) width / (float) height;
 }
 
-void processInput(GLFWwindow *window) {
+// moves the camera by one fixed simulation step
+void processInput(GLFWwindow *window, float step) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
 
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::FORWARD, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::FORWARD, step);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::BACKWARD, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::BACKWARD, step);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::LEFT, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::LEFT, step);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::RIGHT, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::RIGHT, step);
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::UP, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::UP, step);
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        camera.ProcessKeyboard(Camera_Movement::DOWN, deltaTime);
+        camera.ProcessKeyboard(Camera_Movement::DOWN, step);
+}
+
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_F1) {
+        deferred = !deferred;
+        reportGBuffer = deferred;
+        std::cout << (deferred ? "Deferred" : "Forward") << " shading" << std::endl;
+    }
+    if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9)
+        togglePostPass = key - GLFW_KEY_1;
+    if (key == GLFW_KEY_P)
+        reportPostProcess = true;
+    if (key == GLFW_KEY_G)
+        dumpRenderGraph = true;
+    if (key == GLFW_KEY_T)
+        exportTrace = true;
+    if (key == GLFW_KEY_L)
+        toggleLowLatency = true;
+    if (key == GLFW_KEY_C)
+        toggleCapture = true;
+    if (key == GLFW_KEY_R)
+        toggleDynamicResolution = true;
+    if (key == GLFW_KEY_Z)
+        toggleDepthPrepass = true;
+    if (key == GLFW_KEY_K)
+        toggleCommandLists = true;
+    if (key == GLFW_KEY_O)
+        toggleTransparency = true;
+    if (key == GLFW_KEY_MINUS)
+        resizeTransparent = -1;
+    if (key == GLFW_KEY_EQUAL)
+        resizeTransparent = 1;
 }
 
 void mouse_callback(GLFWwindow *window, double pos_x, double pos_y) {
@@ -69,36 +167,159 @@ void scroll_callback(GLFWwindow *window, double delta_x, double delta_y) {
     camera.ProcessMouseScroll((float) delta_y);
 }
 
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+// Sets up the scene and renders until the window closes or the headless frames are done. Everything in here owns GL
+// objects, so it has to be destroyed while the context is still current
+static int render(GLFWwindow *window, const RendererOptions &options, const HeadlessOptions &headless) {
+    Shader lightingShader("shaders/lighting/shader.vs", "shaders/lighting/shader.fs");
+    Shader gBufferShader("shaders/gbuffer/shader.vs", "shaders/gbuffer/shader.fs");
+    Shader deferredShader("shaders/deferred/shader.vs", "shaders/deferred/shader.fs");
+    Shader shadowShader("shaders/shadow/shader.vs", "shaders/shadow/shader.fs");
+
+    // the bone palettes are a samplerBuffer, left on unit 0 it would clash with the diffuse map for every draw
+    for (Shader *shader : {&lightingShader, &gBufferShader}) {
+        shader->use();
+        shader->setInt("bones", BONE_TEXTURE_UNIT);
+    }
 
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    Model cube ("models/cube/cube.obj");
+    Model plane ("models/plane/plane.obj");
+    Model windowModel ("models/window/window.obj");
+    Model grassModel ("models/grass/grass.obj");
+
+    Scene scene;
+    SceneFrame sceneFrame;
+
+    // small colored point lights scattered above the plane, each one bobbing with its own phase
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (unsigned int i = 0; i < NR_LIGHTS; i++) {
+        Light light;
+        light.position = glm::vec3(unit(rng) * 8.0f - 4.0f, -0.8f, unit(rng) * 8.0f - 4.0f);
+        light.radius = 0.4f + unit(rng) * 0.4f;
+        light.color = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f;
+        light.cosInner = 1.0f;
+        light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        light.cosOuter = -1.0f;
+        CreateLight(scene, light, 0.3f, unit(rng) * 6.2831853f);
     }
-    glfwMakeContextCurrent(window);
 
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+    Transform planeTransform;
+    planeTransform.position = glm::vec3(0.0f, -1.01f, 0.0f);
+    planeTransform.scale = glm::vec3(4.0f);
+    CreateRenderable(scene, &plane, RENDER_CASTS_SHADOW | RENDER_STATIC, planeTransform);
+    CreateRenderable(scene, &cube, RENDER_CASTS_SHADOW | RENDER_STATIC, Transform());
+
+    // a small cube circling the middle one, the moving caster the shadow cascades redraw at their own rates
+    Transform orbiterTransform;
+    orbiterTransform.scale = glm::vec3(0.3f);
+    Entity orbiter = CreateRenderable(scene, &cube, RENDER_CASTS_SHADOW, orbiterTransform);
+
+    // transparent windows scattered over the plane, placed again whenever their number changes
+    TransparencyRenderer transparency;
+    transparency.SetMode(options.transparency);
+    unsigned int transparentCount = options.transparentCount;
+    std::vector<Entity> windows;
+    auto placeWindows = [&]() {
+        for (Entity window : windows)
+            scene.Destroy(window);
+
+        std::mt19937 placement(7);
+        windows.resize(transparentCount);
+        for (Entity &window : windows) {
+            Transform transform;
+            transform.position = glm::vec3(unit(placement) * 8.0f - 4.0f, unit(placement) * 1.5f - 0.5f,
+                                           unit(placement) * 8.0f - 4.0f);
+            transform.rotation = glm::angleAxis(unit(placement) * 3.1415927f, glm::vec3(0.0f, 1.0f, 0.0f));
+            transform.scale = glm::vec3(0.3f + unit(placement) * 0.5f);
+            window = CreateRenderable(scene, &windowModel, RENDER_TRANSPARENT, transform);
+        }
+    };
+    placeWindows();
+
+    // the streamed world goes into the same scene, its models are loaded up front
+    SceneFile worldFile;
+    std::vector<std::unique_ptr<Model>> worldModels;
+    std::unique_ptr<WorldStreamer> streamer;
+    if (!options.world.empty()) {
+        if (!worldFile.Open(options.world))
+            return -1;
+        streamer = std::make_unique<WorldStreamer>(scene, worldFile, [&](const std::string &path) {
+            std::string modelPath = path;
+            worldModels.push_back(std::make_unique<Model>(&modelPath[0]));
+            return worldModels.back().get();
+        });
     }
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // animated instances of one model in a grid on the plane, each starting its first clip somewhere else
+    std::unique_ptr<Model> characterModel;
+    std::vector<CompressedClip> compressedClips;
+    Characters characters;
+    if (!options.characterModel.empty()) {
+        std::string modelPath = options.characterModel;
+        characterModel = std::make_unique<Model>(&modelPath[0]);
+        const std::vector<AnimationClip> &clips = characterModel->Clips();
+        compressedClips.resize(clips.size());
+        for (size_t i = 0; i < clips.size(); i++) {
+            compressedClips[i].Compress(clips[i]);
+            CompressedClip::Report(std::cout, clips[i], compressedClips[i], characterModel->GetSkeleton());
+        }
+        unsigned int side = (unsigned int) std::ceil(std::sqrt((float) options.characterCount));
+        for (unsigned int i = 0; i < options.characterCount; i++) {
+            glm::vec3 position(((float) (i % side) - (float) side * 0.5f) * 2.0f, -1.0f,
+                               -4.0f - (float) (i / side) * 2.0f);
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+            if (clips.empty()) {
+                characters.Add(characterModel->GetSkeleton(), (const AnimationClip *) nullptr, characterModel.get(),
+                               transform, (float) i * 0.37f);
+            } else if (options.rawClips) {
+                characters.Add(characterModel->GetSkeleton(), &clips[0], characterModel.get(), transform,
+                               (float) i * 0.37f);
+            } else {
+                characters.Add(characterModel->GetSkeleton(), &compressedClips[0], characterModel.get(), transform,
+                               (float) i * 0.37f);
+            }
+        }
+    }
+    float lastAnimationTime = 0.0f;
 
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    Vegetation vegetation(grassModel, options.grassCount, glm::vec2(-4.0f), glm::vec2(4.0f), -1.01f);
 
-    Shader unlitShader("shaders/unlit/shader.vs", "shaders/unlit/shader.fs");
+    DepthPrepass depthPrepass;
+    depthPrepass.SetEnabled(options.depthPrepass);
 
-    Model cube ("models/cube/cube.obj");
-    Model plane ("models/plane/plane.obj");
+    CommandRenderer commandLists;
+    commandLists.SetEnabled(!options.directDraws);
+
+    ClusterGrid clusters;
+
+    GBuffer gBuffer(screenWidth, screenHeight);
+    CascadedShadowMap shadowMap;
+
+    // the scene is drawn multisampled offscreen, resolved, then run through the post processing chain. All of these
+    // targets come from the pool, which also decides the resolution they're rendered at
+    RenderTargetPool targetPool;
+    GpuProfiler profiler;
+    FrameScheduler scheduler;
+    DynamicResolution dynamicResolution;
+    glm::vec3 previousCameraPosition = camera.Position;
+
+    Shader blurShader("shaders/blur/shader.vs", "shaders/blur/shader.fs");
+    Shader edgeShader("shaders/post_processing/shader.vs", "shaders/post_processing/shader.fs");
+
+    PostProcessStack postProcess(targetPool, profiler);
+    postProcess.AddSeparablePass("blur", &blurShader, LinearSampledGaussian(8, 4.0f), 0.5f, false);
+    postProcess.AddPass("edges", &edgeShader, 1.0f, false);
+    glm::vec3 sunDirection(-0.2f, -1.0f, -0.3f);
+
+    // what the ambient term samples, the procedural sky matches the sun unless an image is given
+    EnvironmentLighting environment;
+    {
+        EnvironmentSource source;
+        if (options.environment.empty() || !LoadEnvironment(options.environment, source))
+            source = ProceduralSky(sunDirection);
+        environment.Load(source, "cache");
+    }
+    ScreenQuad screenQuad;
 
     // -----------------------------------------------------------------------------------------------------------------
 
@@ -108,52 +329,491 @@ int main() {
 
     // -----------------------------------------------------------------------------------------------------------------
 
-    while (!glfwWindowShouldClose(window)) {
-        deltaTime = glfwGetTime() - lastFrame;
-        lastFrame = glfwGetTime();
-
-        processInput(window);
+    // headless runs have no default framebuffer, frames go to this target and are read back from it. Time advances
+    // by a fixed amount per frame so the output doesn't depend on how fast it renders
+    RenderTarget headlessTarget;
+    CameraPath cameraPath = CameraPath::Orbit(6.0f, 2.0f, 8.0f);
+    unsigned int frameIndex = 0;
+    std::unique_ptr<FrameCapture> capture;
+    // samples of the frame scope dynamic resolution has seen
+    unsigned long lastFrameSample = 0;
+    if (headless.enabled) {
+        if (headless.dynamicResolutionMilliseconds > 0.0f) {
+            dynamicResolution.SetTarget(headless.dynamicResolutionMilliseconds);
+            dynamicResolution.SetLimits(headless.minScale, headless.maxScale);
+            dynamicResolution.SetEnabled(true);
+        }
+        headlessTarget = CreateRenderTarget(screenWidth, screenHeight, GL_RGBA8, 1, false);
+        if (!headless.cameraPath.empty() && !cameraPath.Load(headless.cameraPath))
+            return -1;
+        if (headless.cameraPath.empty() && streamer) {
+            glm::vec2 low = worldFile.Min(), high = worldFile.Max();
+            cameraPath = CameraPath::FlyOver(glm::vec3(low.x, 1.0f, low.y), glm::vec3(high.x, 1.0f, high.y),
+                                             (float) (headless.frames / headless.framesPerSecond));
+        }
+        if (!headless.outputDirectory.empty())
+            capture = std::make_unique<FrameCapture>(headless.outputDirectory, headless.format,
+                                                     headless.framesPerSecond);
+    }
+    auto now = [&]() {
+        return headless.enabled ? (double) frameIndex / headless.framesPerSecond : glfwGetTime();
+    };
+    auto runStart = std::chrono::steady_clock::now();
+
+    while (headless.enabled ? frameIndex < headless.frames : !glfwWindowShouldClose(window)) {
+        PROFILE_BEGIN_FRAME();
+        PROFILE_SCOPE("frame");
+
+        // in low latency mode input is read here, once the previous frame is off the GPU, rather than at the end of
+        // the last frame
+        scheduler.WaitForPreviousFrame();
+        if (scheduler.LowLatency() && window) {
+            glfwPollEvents();
+            scheduler.MarkInputSampled(now());
+        }
+
+        unsigned int steps = scheduler.BeginFrame(now());
+        if (headless.enabled) {
+            cameraPath.Apply(camera, (float) scheduler.RenderTime());
+            previousCameraPosition = camera.Position;
+        }
+        for (unsigned int i = 0; i < steps && window; i++) {
+            previousCameraPosition = camera.Position;
+            processInput(window, (float) scheduler.Step());
+        }
+
+        if (toggleCapture) {
+            if (capture) {
+                capture.reset();
+                std::cout << "Stopped capturing" << std::endl;
+            } else {
+                std::filesystem::create_directories("capture");
+                capture = std::make_unique<FrameCapture>("capture", CaptureFormat::PNG);
+                std::cout << "Capturing into capture/" << std::endl;
+            }
+            toggleCapture = false;
+        }
+
+        if (toggleDynamicResolution) {
+            dynamicResolution.SetEnabled(!dynamicResolution.Enabled());
+            std::cout << "Dynamic resolution " << (dynamicResolution.Enabled() ? "on" : "off") << std::endl;
+            toggleDynamicResolution = false;
+        }
+
+        if (toggleDepthPrepass) {
+            depthPrepass.SetEnabled(!depthPrepass.Enabled());
+            std::cout << "Depth pre-pass " << (depthPrepass.Enabled() ? "on" : "off") << std::endl;
+            toggleDepthPrepass = false;
+        }
+
+        if (toggleCommandLists) {
+            commandLists.SetEnabled(!commandLists.Enabled());
+            std::cout << "Opaque passes " << (commandLists.Enabled() ? "replay command lists" : "draw directly")
+                      << std::endl;
+            toggleCommandLists = false;
+        }
+
+        if (toggleTransparency) {
+            bool sorted = transparency.Mode() == TransparencyMode::SORTED;
+            transparency.SetMode(sorted ? TransparencyMode::WEIGHTED_BLENDED : TransparencyMode::SORTED);
+            std::cout << (sorted ? "Weighted blended" : "Sorted") << " transparency" << std::endl;
+            toggleTransparency = false;
+        }
+        if (resizeTransparent != 0) {
+            transparentCount = resizeTransparent > 0 ? std::max(1u, transparentCount * 2) : transparentCount / 2;
+            placeWindows();
+            std::cout << transparentCount << " transparent windows" << std::endl;
+            resizeTransparent = 0;
+        }
+
+        if (toggleLowLatency) {
+            scheduler.SetLowLatency(!scheduler.LowLatency());
+            std::cout << "Low latency " << (scheduler.LowLatency() ? "on" : "off") << std::endl;
+            toggleLowLatency = false;
+        }
+
+        if (togglePostPass >= 0) {
+            postProcess.Toggle(togglePostPass);
+            togglePostPass = -1;
+        }
+        if (reportPostProcess) {
+            postProcess.Report();
+            targetPool.Report(std::cout);
+            profiler.Report(std::cout);
+#ifdef PROFILING
+            CpuProfiler::Instance().Report(std::cout);
+#endif
+            scheduler.Report(std::cout);
+            if (capture)
+                capture->Report(std::cout);
+            dynamicResolution.Report(std::cout);
+            transparency.Report(std::cout);
+            vegetation.Report(std::cout);
+            depthPrepass.Report(std::cout);
+            commandLists.Report(std::cout);
+            characters.Report(std::cout);
+            environment.Report(std::cout);
+            if (streamer)
+                streamer->Report(std::cout);
+            JobSystem::Instance().Report(std::cout);
+            reportPostProcess = false;
+        }
+        if (exportTrace) {
+            if (profiler.ExportChromeTrace("trace.json", PROFILE_TRACE_EVENTS()))
+                std::cout << "Wrote trace.json" << std::endl;
+            if (dynamicResolution.ExportTrace("resolution.csv"))
+                std::cout << "Wrote resolution.csv" << std::endl;
+            exportTrace = false;
+        }
+
+        profiler.BeginFrame();
+
+        // GPU time of the newest frame the profiler has read back, the CPU frame time until there is one. Frames the
+        // profiler couldn't read back yet bring no new sample, and one already seen mustn't count again
+        unsigned long frameSamples = profiler.SampleCount("frame");
+        if (frameSamples == 0)
+            targetPool.SetRenderScale(dynamicResolution.Update(scheduler.FrameMilliseconds()));
+        else if (frameSamples != lastFrameSample)
+            targetPool.SetRenderScale(dynamicResolution.Update(profiler.LatestMilliseconds("frame")));
+        lastFrameSample = frameSamples;
+
+        targetPool.SetWindowSize(screenWidth, screenHeight);
+        targetPool.BeginFrame();
+        int renderWidth = targetPool.RenderWidth();
+        int renderHeight = targetPool.RenderHeight();
 
         // -------------------------------------------------------------------------------------------------------------
 
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_CULL_FACE);
         glEnable(GL_MULTISAMPLE);
 
         // -------------------------------------------------------------------------------------------------------------
 
-        unlitShader.use();
-
+        // the simulation runs ahead, everything is rendered a fraction of a step behind it
+        float time = (float) scheduler.RenderTime();
+        glm::vec3 eye = glm::mix(previousCameraPosition, camera.Position, scheduler.Alpha());
+        glm::mat4 view = camera.GetViewMatrix(eye);
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), screenRatio, 0.1f, 100.0f);
-        unlitShader.setMat4("projection", projection);
 
-        unlitShader.setMat4("view", camera.GetViewMatrix());
-
-        glm::mat4 model;
+        if (streamer) {
+            streamer->Update(eye);
+            if (streamer->StaticCastersChanged())
+                shadowMap.MarkStaticDirty();
+        }
+        AnimateLights(scene, time);
+        scene.SetPosition(orbiter, glm::vec3(std::cos(time * 0.5f) * 2.5f, -0.4f, std::sin(time * 0.5f) * 2.5f));
+        scene.SetRotation(orbiter, glm::angleAxis(time, glm::vec3(0.0f, 1.0f, 0.0f)));
+        characters.Update(time - lastAnimationTime);
+        lastAnimationTime = time;
+        UpdateTransforms(scene);
+        UpdateBounds(scene);
+        CullScene(scene, projection * view);
+        SubmitScene(scene, sceneFrame);
+        // recorded while nothing else runs on the GL thread, replayed by whichever opaque pass draws this frame
+        if (commandLists.Enabled())
+            commandLists.Record(sceneFrame.opaque, deferred ? gBufferShader : lightingShader);
+
+        clusters.Update(sceneFrame.lights, view, camera.Zoom, screenRatio, 0.1f, 100.0f);
+
+        transparency.Clear();
+        for (const TransparentDraw &draw : sceneFrame.transparent)
+            transparency.Add(draw.model, draw.transform);
+
+        // uniforms shared by the forward lighting shader and the deferred lighting pass
+        auto setLights = [&](const Shader &shader) {
+            shader.setVec3("viewPos", eye);
+            shader.setVec3("dirLight.direction", sunDirection);
+            shader.setVec3("dirLight.ambient", glm::vec3(0.05f));
+            shader.setVec3("dirLight.diffuse", glm::vec3(0.1f));
+            shader.setVec3("dirLight.specular", glm::vec3(0.1f));
+
+            // units 0 to 3 are taken by the material textures and the G-buffer
+            shadowMap.Bind(shader, 7);
+            clusters.Bind(shader, 8, (float) renderWidth, (float) renderHeight);
+            environment.Bind(shader, 11);
+        };
+
+        auto drawOpaque = [&](Shader &shader) {
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+
+            if (commandLists.Enabled())
+                commandLists.Replay();
+            else
+                commandLists.DrawDirect(sceneFrame.opaque, shader);
+        };
 
         // -------------------------------------------------------------------------------------------------------------
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.01f, 0.0f));
-        model = glm::scale(model, glm::vec3(4.0f));
-        unlitShader.setMat4("model", model);
-        plane.Draw(unlitShader);
+        PROFILE_SCOPE("render graph");
+        RenderGraph graph;
+
+        RenderTarget backbufferTarget = headlessTarget;
+        backbufferTarget.width = screenWidth;
+        backbufferTarget.height = screenHeight;
+
+        // the shadow map and the G-buffer manage their own textures, the graph only tracks who uses them
+        unsigned int shadowTexture = graph.ImportTexture("shadowMap", RenderTarget());
+        unsigned int gBufferTexture = graph.ImportTexture("gBuffer", RenderTarget());
+        unsigned int backbuffer = graph.ImportTexture("backbuffer", backbufferTarget);
+        unsigned int sceneColor = graph.CreateTexture("sceneColor", {renderWidth, renderHeight, GL_RGBA16F, 4, true});
+        unsigned int resolved = graph.CreateTexture("resolved", {renderWidth, renderHeight, GL_RGBA16F, 1, false});
+        graph.MarkOutput(backbuffer);
+
+        graph.AddPass("shadows", [&](RenderGraphBuilder &builder) {
+            builder.Write(shadowTexture);
+        }, [&](const RenderGraphContext &context) {
+            shadowMap.Update(view, camera.Zoom, screenRatio, 0.1f, sunDirection, sceneFrame.casters, shadowShader);
+        });
+
+        auto bindScene = [&](const RenderGraphContext &context, bool clear) {
+            glBindFramebuffer(GL_FRAMEBUFFER, context.Target(sceneColor).FBO);
+            glViewport(0, 0, renderWidth, renderHeight);
+            if (clear) {
+                glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+        };
+
+        if (deferred) {
+            graph.AddPass("gbuffer", [&](RenderGraphBuilder &builder) {
+                builder.Write(gBufferTexture);
+            }, [&](const RenderGraphContext &context) {
+                // allocated at the full size, a lower render scale only shrinks the viewport
+                gBuffer.Resize(targetPool.FullWidth(), targetPool.FullHeight());
+                if (reportGBuffer) {
+                    gBuffer.Report();
+                    reportGBuffer = false;
+                }
+                gBuffer.BindForWriting();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glViewport(0, 0, renderWidth, renderHeight);
+
+                gBufferShader.use();
+                drawOpaque(gBufferShader);
+                characters.Draw(gBufferShader);
+            });
+
+            graph.AddPass("deferred lighting", [&](RenderGraphBuilder &builder) {
+                builder.Read(gBufferTexture);
+                builder.Read(shadowTexture);
+                builder.Write(sceneColor);
+            }, [&](const RenderGraphContext &context) {
+                bindScene(context, true);
+
+                // the pass writes the G-buffer depth back out, so the test must always pass
+                glDepthFunc(GL_ALWAYS);
+                deferredShader.use();
+                gBuffer.BindForReading(1);
+                deferredShader.setInt("gAlbedoSpec", 1);
+                deferredShader.setInt("gNormal", 2);
+                deferredShader.setInt("gDepth", 3);
+                deferredShader.setVec2("gBufferScale", glm::vec2((float) renderWidth / (float) gBuffer.Width(),
+                                                                 (float) renderHeight / (float) gBuffer.Height()));
+                deferredShader.setMat4("inverseProjection", glm::inverse(projection));
+                deferredShader.setMat4("inverseView", glm::inverse(view));
+                deferredShader.setFloat("shininess", 32.0f);
+                setLights(deferredShader);
+                screenQuad.Draw();
+                glDepthFunc(GL_LESS);
+            });
+        } else {
+            if (depthPrepass.Enabled()) {
+                graph.AddPass("depth prepass", [&](RenderGraphBuilder &builder) {
+                    builder.Write(sceneColor);
+                }, [&](const RenderGraphContext &context) {
+                    bindScene(context, true);
+                    depthPrepass.DrawDepth(sceneFrame.opaque, view, projection);
+                });
+            }
+
+            graph.AddPass("forward opaque", [&](RenderGraphBuilder &builder) {
+                builder.Read(shadowTexture);
+                if (depthPrepass.Enabled())
+                    builder.Read(sceneColor);
+                builder.Write(sceneColor);
+            }, [&](const RenderGraphContext &context) {
+                bindScene(context, !depthPrepass.Enabled());
+
+                lightingShader.use();
+                lightingShader.setFloat("material.shininess", 32.0f);
+                setLights(lightingShader);
+                const RenderTarget &target = context.Target(sceneColor);
+                depthPrepass.BeginShading((unsigned long) target.width * target.height * target.samples);
+                drawOpaque(lightingShader);
+                depthPrepass.EndShading();
+                // after the pre-pass test is back to less, the characters aren't in the pre-pass
+                characters.Draw(lightingShader);
+            });
+        }
+
+        // alpha tested grass after either opaque path, into the multisampled target so alpha to coverage works
+        graph.AddPass("vegetation", [&](RenderGraphBuilder &builder) {
+            builder.Read(sceneColor);
+            builder.Write(sceneColor);
+        }, [&](const RenderGraphContext &context) {
+            glBindFramebuffer(GL_FRAMEBUFFER, context.Target(sceneColor).FBO);
+            glViewport(0, 0, renderWidth, renderHeight);
+            vegetation.Draw(view, projection, eye, sunDirection, time);
+        });
+
+        // transparent surfaces always go through the forward path, on top of whichever path drew the opaque ones
+        graph.AddPass("transparent", [&](RenderGraphBuilder &builder) {
+            builder.Read(sceneColor);
+            builder.Write(sceneColor);
+        }, [&](const RenderGraphContext &context) {
+            transparency.Draw(context.Target(sceneColor), view, projection);
+        });
+
+        graph.AddPass("resolve", [&](RenderGraphBuilder &builder) {
+            builder.Read(sceneColor);
+            builder.Write(resolved);
+        }, [&](const RenderGraphContext &context) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, context.Target(sceneColor).FBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context.Target(resolved).FBO);
+            glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight,
+                              GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        });
+
+        graph.AddPass("post processing", [&](RenderGraphBuilder &builder) {
+            builder.Read(resolved);
+            builder.Write(backbuffer);
+        }, [&](const RenderGraphContext &context) {
+            const RenderTarget &output = context.Target(backbuffer);
+            postProcess.Execute(context.Target(resolved).color, renderWidth, renderHeight,
+                                output.FBO, output.width, output.height);
+        });
+
+        graph.Compile();
+        if (dumpRenderGraph) {
+            std::cout << graph.Dump();
+            dumpRenderGraph = false;
+        }
+        graph.Execute(targetPool, &profiler);
 
         // -------------------------------------------------------------------------------------------------------------
 
-        model = glm::mat4(1.0f);
-        unlitShader.setMat4("model", model);
-        cube.Draw(unlitShader);
+        profiler.EndFrame();
 
-        // -------------------------------------------------------------------------------------------------------------
+        if (capture) {
+            capture->Capture(backbufferTarget.FBO, screenWidth, screenHeight);
+            capture->Poll();
+        }
+
+        if (window) {
+            PROFILE_SCOPE("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        scheduler.MarkPresented(now());
+        frameIndex++;
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!scheduler.LowLatency() && window) {
+            glfwPollEvents();
+            scheduler.MarkInputSampled(now());
+        }
+
+        PROFILE_END_FRAME();
     }
 
-    glfwTerminate();
+    if (headless.enabled) {
+        // everything submitted has to be done for the timing to mean anything
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+        std::cout << frameIndex << " frames at " << screenWidth << "x" << screenHeight << " in " << seconds << " s, "
+                  << (double) frameIndex / seconds << " fps" << std::endl;
+        if (capture) {
+            // the encoder may still be behind, the frame rate above is what rendering alone sustained
+            capture->Flush();
+            double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+            std::cout << "all frames written after " << total << " s" << std::endl;
+            capture->Report(std::cout);
+            capture.reset();
+        }
+        targetPool.Report(std::cout);
+        transparency.Report(std::cout);
+        vegetation.Report(std::cout);
+        depthPrepass.Report(std::cout);
+        commandLists.Report(std::cout);
+        characters.Report(std::cout);
+        environment.Report(std::cout);
+        if (streamer)
+            streamer->Report(std::cout);
+        JobSystem::Instance().Report(std::cout);
+        if (dynamicResolution.Enabled()) {
+            dynamicResolution.Report(std::cout);
+            std::string directory = headless.outputDirectory.empty() ? "." : headless.outputDirectory;
+            dynamicResolution.ExportTrace(directory + "/resolution.csv");
+        }
+        DestroyRenderTarget(headlessTarget);
+    } else {
+        // the last frames are still being read back and need the context
+        capture.reset();
+    }
     return 0;
 }
+
+int main(int argc, char **argv) {
+    PROFILE_THREAD("main");
+
+    RendererOptions options;
+    HeadlessOptions headless;
+    if (!ParseOptions(argc, argv, options, headless))
+        return -1;
+    deferred = options.deferred;
+
+    GLFWwindow *window = NULL;
+#ifdef HEADLESS
+    std::unique_ptr<HeadlessContext> headlessContext;
+#endif
+    if (headless.enabled) {
+#ifdef HEADLESS
+        headlessContext = std::make_unique<HeadlessContext>();
+        if (!headlessContext->Valid())
+            return -1;
+        if (!gladLoadGLLoader((GLADloadproc) HeadlessContext::GetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+#endif
+        screenWidth = headless.width;
+        screenHeight = headless.height;
+        screenRatio = (float) screenWidth / (float) screenHeight;
+        std::cout << "Headless on " << glGetString(GL_RENDERER) << std::endl;
+    } else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
+    }
+
+    // the renderer goes before the context, everything it owns deletes GL objects on the way out
+    int result = 0;
+    if (options.denseMeshSegments)
+        BenchmarkNormalMatrixShaders(std::cout, options.denseMeshSegments, screenWidth, screenHeight, headless.frames);
+    else
+        result = render(window, options, headless);
+    if (window)
+        glfwTerminate();
+    return result;
+}
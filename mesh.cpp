@@ -1,10 +1,13 @@
 #include <glad/glad.h>
 #include "mesh.hpp"
+#include "command_list.hpp"
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+           std::vector<SkinWeights> skin) {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
+    this->skin = skin;
 
     setupMesh();
 }
@@ -33,29 +36,109 @@ void Mesh::setupMesh() {
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, TexCoords));
 
+    // bone indices as integers and weights normalized to [0, 1], eight bytes a vertex in a stream of their own
+    if (!skin.empty()) {
+        glGenBuffers(1, &skinVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, skinVBO);
+        glBufferData(GL_ARRAY_BUFFER, skin.size() * sizeof(SkinWeights), skin.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(4);
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(SkinWeights), (void *) offsetof(SkinWeights, bones));
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinWeights),
+                              (void *) offsetof(SkinWeights, weights));
+    }
+
+    glBindVertexArray(0);
+
+    // position-only stream sharing the same index buffer
+    std::vector<glm::vec3> positions(vertices.size());
+    boundsMin = glm::vec3(0.0f);
+    boundsMax = glm::vec3(0.0f);
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].Position;
+        boundsMin = i == 0 ? positions[i] : glm::min(boundsMin, positions[i]);
+        boundsMax = i == 0 ? positions[i] : glm::max(boundsMax, positions[i]);
+    }
+
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+
+    glBindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *) 0);
+
     glBindVertexArray(0);
 }
 
-void Mesh::Draw(Shader &shader) {
+void Mesh::bindTextures(Shader &shader) {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
+    // the first diffuse and specular maps always go to units 0 and 1, which command list replay relies on
+    unsigned int nextUnit = 2;
     for (unsigned int i = 0; i < textures.size(); i++) {
-        glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
         // retrieve texture number (the N in diffuse_textureN)
         std::string number;
         std::string name = textures[i].type;
-        if (name == "texture_diffuse")
+        unsigned int unit;
+        if (name == "texture_diffuse") {
+            unit = diffuseNr == 1 ? 0 : nextUnit++;
             number = std::to_string(diffuseNr++);
-        else if (name == "texture_specular")
+        } else if (name == "texture_specular") {
+            unit = specularNr == 1 ? 1 : nextUnit++;
             number = std::to_string(specularNr++);
+        } else {
+            unit = nextUnit++;
+        }
 
-        shader.setInt(("material." + name + number).c_str(), i);
+        glActiveTexture(GL_TEXTURE0 + unit); // activate proper texture unit before binding
+        shader.setInt(("material." + name + number).c_str(), unit);
         glBindTexture(GL_TEXTURE_2D, textures[i].id);
     }
     glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::Draw(Shader &shader) {
+    bindTextures(shader);
 
     // draw mesh
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 }
+
+void Mesh::DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count) {
+    bindTextures(shader);
+
+    // the instance stream is pointed at again on every call since the buffer changes from draw to draw, and turned off
+    // afterwards so regular draws of the mesh never read it
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *) 0);
+    glVertexAttribDivisor(3, 1);
+    glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+    glDisableVertexAttribArray(3);
+    glBindVertexArray(0);
+}
+
+void Mesh::DrawDepth() {
+    glBindVertexArray(depthVAO);
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
+
+void Mesh::Record(CommandList &list) const {
+    unsigned int diffuse = 0, specular = 0;
+    for (const Texture &texture : textures) {
+        if (texture.type == "texture_diffuse" && !diffuse)
+            diffuse = texture.id;
+        else if (texture.type == "texture_specular" && !specular)
+            specular = texture.id;
+    }
+    list.BindMaterial(diffuse, specular);
+    list.DrawIndexed(VAO, (unsigned int) indices.size());
+}
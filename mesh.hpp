@@ -1,15 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <glm/glm.hpp>
 #include "shader.hpp"
 
+class CommandList;
+
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 TexCoords;
 };
 
+// Up to four bones moving a vertex, indices into the model's bones and weights in 255ths adding up to 255
+struct SkinWeights {
+    uint8_t bones[4];
+    uint8_t weights[4];
+};
+
 struct Texture {
     unsigned int id;
     std::string type;
@@ -22,14 +31,33 @@ public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
+    // one per vertex for meshes bound to bones, empty otherwise
+    std::vector<SkinWeights> skin;
+    // local space bounding box
+    glm::vec3 boundsMin, boundsMax;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+         std::vector<SkinWeights> skin = {});
 
     void Draw(Shader &shader);
 
+    // draws count instances, each one reading a vec4 at location 3 from instanceBuffer
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count);
+
+    // draws positions only, for depth-only passes
+    void DrawDepth();
+
+    // appends what Draw does to list, the first diffuse and specular texture and the draw
+    void Record(CommandList &list) const;
+
 private:
     //  render data
     unsigned int VAO, VBO, EBO;
+    // tightly packed positions so that depth-only passes don't fetch normals and texture coordinates
+    unsigned int depthVAO, positionVBO;
+    // bone indices at location 4 and weights at location 5, only for skinned meshes
+    unsigned int skinVBO = 0;
 
     void setupMesh();
+    void bindTextures(Shader &shader);
 };
@@ -1,19 +1,161 @@
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
+#include <cmath>
 #include <stb_image.h>
 #include <glad/glad.h>
 #include "model.hpp"
+#include "cpu_profiler.hpp"
+#include "normal_matrix.hpp"
+#include "job_system.hpp"
+#include "command_list.hpp"
 
-unsigned int TextureFromFile(const char *path, const std::string &directory);
+void uploadTexture(unsigned int textureID, unsigned char *data, int width, int height, int nrComponents);
 
-void Model::Draw(Shader &shader) {
+// Assimp matrices are row major, a1 b1 c1 d1 is the first column
+static glm::mat4 toGlm(const aiMatrix4x4 &m) {
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+}
+
+void Model::Draw(Shader &shader, const glm::mat4 &transform) {
+    Draw(shader, transform, NormalMatrix(transform));
+}
+
+void Model::Draw(Shader &shader, const glm::mat4 &transform, const glm::mat3 &normalMatrix) {
+    if (anyNodeDirty)
+        UpdateNodes();
+
+    shader.setMat4("model", transform);
+    shader.setMat3("normalMatrix", normalMatrix);
+    if (flat) {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(shader);
+        return;
+    }
+
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        const ModelNode &node = nodes[n];
+        if (node.meshCount == 0)
+            continue;
+        glm::mat4 model = transform * nodeWorld[n];
+        shader.setMat4("model", model);
+        shader.setMat3("normalMatrix", NormalMatrix(model));
+        for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++)
+            meshes[i].Draw(shader);
+    }
+}
+
+void Model::DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count) {
     for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+        meshes[i].DrawInstanced(shader, instanceBuffer, count);
+}
+
+void Model::DrawDepth(Shader &shader, const glm::mat4 &transform) {
+    if (anyNodeDirty)
+        UpdateNodes();
+
+    shader.setMat4("model", transform);
+    if (flat) {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth();
+        return;
+    }
+
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        const ModelNode &node = nodes[n];
+        if (node.meshCount == 0)
+            continue;
+        shader.setMat4("model", transform * nodeWorld[n]);
+        for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++)
+            meshes[i].DrawDepth();
+    }
+}
+
+void Model::DrawSkinned(Shader &shader, const glm::mat4 &transform, unsigned int firstBone) {
+    if (anyNodeDirty)
+        UpdateNodes();
+
+    shader.setInt("firstBone", (int) firstBone);
+    // the palette already holds the node transforms of skinned meshes
+    glm::mat3 normalMatrix = NormalMatrix(transform);
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        const ModelNode &node = nodes[n];
+        for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++) {
+            bool skinned = !meshes[i].skin.empty();
+            glm::mat4 model = skinned ? transform : transform * nodeWorld[n];
+            shader.setInt("skinned", skinned);
+            shader.setMat4("model", model);
+            shader.setMat3("normalMatrix", skinned ? normalMatrix : NormalMatrix(model));
+            meshes[i].Draw(shader);
+        }
+    }
+    shader.setInt("skinned", 0);
+}
+
+void Model::Record(CommandList &list, const glm::mat4 &transform) const {
+    if (flat) {
+        list.SetDrawData(transform, NormalMatrix(transform));
+        for (const Mesh &mesh : meshes)
+            mesh.Record(list);
+        return;
+    }
+
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        const ModelNode &node = nodes[n];
+        if (node.meshCount == 0)
+            continue;
+        glm::mat4 model = transform * nodeWorld[n];
+        list.SetDrawData(model, NormalMatrix(model));
+        for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++)
+            meshes[i].Record(list);
+    }
+}
+
+int Model::FindNode(const std::string &name) const {
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        if (nodes[n].name == name)
+            return (int) n;
+    }
+    return -1;
+}
+
+void Model::SetNodeTransform(unsigned int node, const glm::mat4 &local) {
+    nodes[node].local = local;
+    nodeDirty[node] = 1;
+    anyNodeDirty = true;
+    flat = false;
+}
+
+unsigned int Model::UpdateNodes() {
+    unsigned int recomputed = 0;
+    unsigned int n = 0;
+    while (n < nodes.size()) {
+        if (!nodeDirty[n]) {
+            n++;
+            continue;
+        }
+        // the subtree follows its root with parents ahead of children, so it is recomputed front to back and the
+        // walk resumes after it. Dirty nodes inside it are covered too
+        unsigned int end = nodes[n].subtreeEnd;
+        for (unsigned int i = n; i < end; i++) {
+            const ModelNode &node = nodes[i];
+            nodeWorld[i] = node.parent < 0 ? node.local : nodeWorld[node.parent] * node.local;
+            nodeDirty[i] = 0;
+        }
+        recomputed += end - n;
+        n = end;
+    }
+    anyNodeDirty = false;
+    return recomputed;
 }
 
 void Model::loadModel(std::string path) {
+    PROFILE_SCOPE("Model::loadModel");
     Assimp::Importer import;
-    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    const aiScene *scene;
+    {
+        PROFILE_SCOPE("Assimp::ReadFile");
+        scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    }
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
@@ -21,10 +163,90 @@ void Model::loadModel(std::string path) {
     }
     directory = path.substr(0, path.find_last_of('/'));
 
-    processNode(scene->mRootNode, scene);
+    processNode(scene->mRootNode, scene, -1);
+
+    for (const std::string &name : boneNames) {
+        int node = FindNode(name);
+        if (node < 0)
+            std::cout << "ERROR::MODEL::BONE_WITHOUT_NODE " << name << std::endl;
+        skeleton.boneNodes.push_back((unsigned int) std::max(0, node));
+    }
+    loadAnimations(scene);
+
+    // the meshes already refer to the texture names, decoding the files is left to the job system and only the
+    // uploads have to happen here, where the context is current
+    {
+        PROFILE_SCOPE("Model::decodeTextures");
+        struct Decoded {
+            unsigned char *data;
+            int width, height, nrComponents;
+        };
+        std::vector<Decoded> decoded(pendingTextures.size());
+        stbi_set_flip_vertically_on_load(true);
+        JobSystem::Instance().ParallelFor(pendingTextures.size(), 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                PROFILE_SCOPE("stbi_load");
+                Decoded &image = decoded[i];
+                image.data = stbi_load(pendingTextures[i].second.c_str(), &image.width, &image.height,
+                                       &image.nrComponents, 0);
+            }
+        });
+        for (size_t i = 0; i < pendingTextures.size(); i++) {
+            if (decoded[i].data)
+                uploadTexture(pendingTextures[i].first, decoded[i].data, decoded[i].width, decoded[i].height,
+                              decoded[i].nrComponents);
+            else
+                std::cout << "Texture failed to load at path: " << pendingTextures[i].second << std::endl;
+            stbi_image_free(decoded[i].data);
+        }
+        pendingTextures.clear();
+    }
+
+    nodeWorld.resize(nodes.size());
+    nodeDirty.assign(nodes.size(), 0);
+    if (!nodes.empty()) {
+        nodeDirty[0] = 1;
+        anyNodeDirty = true;
+    }
+    UpdateNodes();
+
+    bool first = true;
+    for (unsigned int n = 0; n < nodes.size(); n++) {
+        flat = flat && nodeWorld[n] == glm::mat4(1.0f);
+        for (unsigned int i = nodes[n].firstMesh; i < nodes[n].firstMesh + nodes[n].meshCount; i++) {
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 local((corner & 1) ? meshes[i].boundsMax.x : meshes[i].boundsMin.x,
+                                (corner & 2) ? meshes[i].boundsMax.y : meshes[i].boundsMin.y,
+                                (corner & 4) ? meshes[i].boundsMax.z : meshes[i].boundsMin.z);
+                glm::vec3 placed = glm::vec3(nodeWorld[n] * glm::vec4(local, 1.0f));
+                boundsMin = first ? placed : glm::min(boundsMin, placed);
+                boundsMax = first ? placed : glm::max(boundsMax, placed);
+                first = false;
+            }
+        }
+    }
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene, int parent) {
+    unsigned int index = (unsigned int) nodes.size();
+    ModelNode entry;
+    entry.name = node->mName.C_Str();
+    entry.parent = parent;
+    entry.local = toGlm(node->mTransformation);
+    entry.firstMesh = (unsigned int) meshes.size();
+    entry.meshCount = node->mNumMeshes;
+    nodes.push_back(entry);
+
+    aiVector3D scaling, position;
+    aiQuaternion rotation;
+    node->mTransformation.Decompose(scaling, rotation, position);
+    Transform bind;
+    bind.position = glm::vec3(position.x, position.y, position.z);
+    bind.rotation = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+    bind.scale = glm::vec3(scaling.x, scaling.y, scaling.z);
+    skeleton.parents.push_back(parent);
+    skeleton.bindPose.push_back(bind);
+
     // process all the node's meshes (if any)
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
         aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
@@ -32,8 +254,9 @@ void Model::processNode(aiNode *node, const aiScene *scene) {
     }
     // then do the same for each of its children
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, (int) index);
     }
+    nodes[index].subtreeEnd = (unsigned int) nodes.size();
 }
 
 Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
@@ -77,6 +300,49 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
             indices.push_back(face.mIndices[j]);
     }
 
+    // the four heaviest bones of every vertex, weights as floats until they are quantized
+    std::vector<SkinWeights> skin;
+    if (mesh->HasBones()) {
+        std::vector<glm::vec4> weights(mesh->mNumVertices, glm::vec4(0.0f));
+        skin.assign(mesh->mNumVertices, SkinWeights{{0, 0, 0, 0}, {0, 0, 0, 0}});
+        for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+            const aiBone *bone = mesh->mBones[b];
+            unsigned int index = boneIndex(bone);
+            if (index >= MAX_BONES) {
+                std::cout << "ERROR::MODEL::TOO_MANY_BONES " << bone->mName.C_Str() << std::endl;
+                continue;
+            }
+            for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+                const aiVertexWeight &weight = bone->mWeights[w];
+                glm::vec4 &slots = weights[weight.mVertexId];
+                int lightest = 0;
+                for (int k = 1; k < 4; k++)
+                    lightest = slots[k] < slots[lightest] ? k : lightest;
+                if (weight.mWeight > slots[lightest]) {
+                    slots[lightest] = weight.mWeight;
+                    skin[weight.mVertexId].bones[lightest] = (uint8_t) index;
+                }
+            }
+        }
+
+        // in 255ths adding up to 255, the rounding error goes to the heaviest bone. A vertex no bone weighs follows
+        // the first bone
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            float sum = weights[v].x + weights[v].y + weights[v].z + weights[v].w;
+            if (sum <= 0.0f) {
+                skin[v].weights[0] = 255;
+                continue;
+            }
+            int total = 0, heaviest = 0;
+            for (int k = 0; k < 4; k++) {
+                skin[v].weights[k] = (uint8_t) std::lround(weights[v][k] / sum * 255.0f);
+                total += skin[v].weights[k];
+                heaviest = weights[v][k] > weights[v][heaviest] ? k : heaviest;
+            }
+            skin[v].weights[heaviest] = (uint8_t) (skin[v].weights[heaviest] + 255 - total);
+        }
+    }
+
     // process material
     if (mesh->mMaterialIndex >= 0) {
         if (mesh->mMaterialIndex >= 0) {
@@ -90,7 +356,72 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
         }
     }
 
-    return Mesh(vertices, indices, textures);
+    return Mesh(vertices, indices, textures, skin);
+}
+
+unsigned int Model::boneIndex(const aiBone *bone) {
+    for (unsigned int i = 0; i < boneNames.size(); i++) {
+        if (boneNames[i] == bone->mName.C_Str())
+            return i;
+    }
+    boneNames.push_back(bone->mName.C_Str());
+    skeleton.boneOffsets.push_back(toGlm(bone->mOffsetMatrix));
+    return (unsigned int) boneNames.size() - 1;
+}
+
+void Model::loadAnimations(const aiScene *scene) {
+    for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+        const aiAnimation *animation = scene->mAnimations[a];
+        // files without a tick rate are usually meant at 25
+        float ticksPerSecond = animation->mTicksPerSecond > 0.0 ? (float) animation->mTicksPerSecond : 25.0f;
+        AnimationClip clip;
+        clip.name = animation->mName.C_Str();
+        clip.duration = (float) animation->mDuration / ticksPerSecond;
+
+        for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+            const aiNodeAnim *keys = animation->mChannels[c];
+            int node = FindNode(keys->mNodeName.C_Str());
+            if (node < 0) {
+                std::cout << "ERROR::MODEL::CHANNEL_WITHOUT_NODE " << keys->mNodeName.C_Str() << std::endl;
+                continue;
+            }
+
+            AnimationChannel channel;
+            channel.node = (unsigned int) node;
+            for (unsigned int k = 0; k < keys->mNumPositionKeys; k++) {
+                const aiVectorKey &key = keys->mPositionKeys[k];
+                channel.positionTimes.push_back((float) key.mTime / ticksPerSecond);
+                channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned int k = 0; k < keys->mNumRotationKeys; k++) {
+                const aiQuatKey &key = keys->mRotationKeys[k];
+                channel.rotationTimes.push_back((float) key.mTime / ticksPerSecond);
+                channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned int k = 0; k < keys->mNumScalingKeys; k++) {
+                const aiVectorKey &key = keys->mScalingKeys[k];
+                channel.scaleTimes.push_back((float) key.mTime / ticksPerSecond);
+                channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+
+            // sampling expects a key of every kind, what the file leaves out stays at the bind pose
+            const Transform &bind = skeleton.bindPose[node];
+            if (channel.positions.empty()) {
+                channel.positionTimes.push_back(0.0f);
+                channel.positions.push_back(bind.position);
+            }
+            if (channel.rotations.empty()) {
+                channel.rotationTimes.push_back(0.0f);
+                channel.rotations.push_back(bind.rotation);
+            }
+            if (channel.scales.empty()) {
+                channel.scaleTimes.push_back(0.0f);
+                channel.scales.push_back(bind.scale);
+            }
+            clip.channels.push_back(channel);
+        }
+        clips.push_back(clip);
+    }
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName) {
@@ -108,7 +439,8 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
         }
         if (!skip) {   // if texture hasn't been loaded already, load it
             Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), directory);
+            glGenTextures(1, &texture.id);
+            pendingTextures.push_back({texture.id, directory + '/' + str.C_Str()});
             texture.type = typeName;
             texture.path = str.C_Str();
             textures.push_back(texture);
@@ -118,40 +450,20 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
     return textures;
 }
 
-unsigned int TextureFromFile(const char *path, const std::string &directory) {
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+void uploadTexture(unsigned int textureID, unsigned char *data, int width, int height, int nrComponents) {
+    PROFILE_SCOPE("uploadTexture");
+    GLenum format = GL_RGBA;
+    if (nrComponents == 1)
+        format = GL_RED;
+    else if (nrComponents == 3)
+        format = GL_RGB;
 
-    stbi_set_flip_vertically_on_load(true);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
 
-    return textureID;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
@@ -1,9 +1,25 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <assimp/scene.h>
 #include "mesh.hpp"
+#include "animation.hpp"
+
+class CommandList;
+
+// One node of the model's hierarchy. Nodes are stored depth first, so a parent always comes before its children and
+// the subtree of node i is the range [i, subtreeEnd)
+struct ModelNode {
+    std::string name;
+    int parent;
+    unsigned int subtreeEnd;
+    // relative to the parent, as imported or as last set
+    glm::mat4 local;
+    // the node's meshes are meshes [firstMesh, firstMesh + meshCount)
+    unsigned int firstMesh, meshCount;
+};
 
 class Model {
 public:
@@ -11,20 +27,76 @@ public:
         loadModel(path);
     }
 
-    void Draw(Shader &shader);
+    // local space bounding box enclosing all the meshes, placed by the node transforms they were imported with
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+
+    // draws every mesh placed by its node, transform places the whole model. Sets the model and normalMatrix
+    // uniforms; the second form takes the normal matrix of transform, used as is for nodes at the model's origin
+    void Draw(Shader &shader, const glm::mat4 &transform);
+    void Draw(Shader &shader, const glm::mat4 &transform, const glm::mat3 &normalMatrix);
+
+    // draws count instances of every mesh, per instance data is a vec4 at location 3. Node transforms are not
+    // applied, the instance data places the meshes
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, unsigned int count);
+
+    // draws positions only, for depth-only passes. Sets the model uniform like Draw
+    void DrawDepth(Shader &shader, const glm::mat4 &transform);
+
+    // Draw for an animated instance: meshes bound to bones are placed by the palette starting at firstBone in the
+    // shader's bone texture, one matrix per bone, the others by their nodes as usual
+    void DrawSkinned(Shader &shader, const glm::mat4 &transform, unsigned int firstBone);
+
+    // appends what Draw does to list without touching GL, so any thread can record. The nodes must be up to date
+    void Record(CommandList &list, const glm::mat4 &transform) const;
+
+    const std::vector<ModelNode> &Nodes() const { return nodes; }
+    // index of the first node called name, -1 if there is none
+    int FindNode(const std::string &name) const;
+
+    // moves a node and everything below it, the world matrices follow on the next UpdateNodes or draw
+    void SetNodeTransform(unsigned int node, const glm::mat4 &local);
+    // recomputes the subtrees of the nodes set since the last update in one pass over the node array, skipping
+    // whole clean subtrees. Returns the number of nodes recomputed
+    unsigned int UpdateNodes();
+    bool NodesDirty() const { return anyNodeDirty; }
+    // relative to the model's origin
+    const glm::mat4 &NodeWorld(unsigned int node) const { return nodeWorld[node]; }
+
+    // the nodes and bones animations move, and the animations imported with the model
+    const Skeleton &GetSkeleton() const { return skeleton; }
+    const std::vector<AnimationClip> &Clips() const { return clips; }
 
 private:
     // model data
     std::vector<Mesh> meshes;
     std::string directory;
     std::vector<Texture> textures_loaded;
+    // texture names already handed to meshes, with the files still to be decoded into them
+    std::vector<std::pair<unsigned int, std::string>> pendingTextures;
+
+    std::vector<ModelNode> nodes;
+    std::vector<glm::mat4> nodeWorld;
+    std::vector<uint8_t> nodeDirty;
+    bool anyNodeDirty = false;
+    // every node sits at the model's origin, so draws set the uniforms once for all meshes
+    bool flat = true;
+
+    Skeleton skeleton;
+    // names of the bones as meshes referred to them, matched to nodes once the hierarchy is loaded
+    std::vector<std::string> boneNames;
+    std::vector<AnimationClip> clips;
 
     void loadModel(std::string path);
 
-    void processNode(aiNode *node, const aiScene *scene);
+    void processNode(aiNode *node, const aiScene *scene, int parent);
 
     Mesh processMesh(aiMesh *mesh, const aiScene *scene);
 
+    // the model wide index of a bone, added on first use
+    unsigned int boneIndex(const aiBone *bone);
+
+    void loadAnimations(const aiScene *scene);
+
     std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
                                               std::string typeName);
 };
@@ -0,0 +1,236 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <xmmintrin.h>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "normal_matrix.hpp"
+#include "render_target.hpp"
+#include "shader.hpp"
+
+// relative to the squared scale, loose enough for matrices composed in single precision
+const float UNIFORM_SCALE_TOLERANCE = 1e-4f;
+
+bool IsUniformScale(const glm::mat4 &model) {
+    glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+    float scale = glm::dot(a, a);
+    float tolerance = UNIFORM_SCALE_TOLERANCE * scale;
+    return std::fabs(glm::dot(b, b) - scale) <= tolerance && std::fabs(glm::dot(c, c) - scale) <= tolerance &&
+           std::fabs(glm::dot(a, b)) <= tolerance && std::fabs(glm::dot(b, c)) <= tolerance &&
+           std::fabs(glm::dot(c, a)) <= tolerance;
+}
+
+glm::mat3 NormalMatrix(const glm::mat4 &model) {
+    if (IsUniformScale(model))
+        return glm::mat3(model);
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+
+void NormalMatrices(const glm::mat4 *models, size_t count, glm::mat3 *normals) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // one register per element of the upper 3x3, one matrix per lane. glm is column major, m[column][row], so
+        // transposing the same column of the four matrices gives its rows
+        __m128 m[3][4];
+        for (int column = 0; column < 3; column++) {
+            for (int lane = 0; lane < 4; lane++)
+                m[column][lane] = _mm_loadu_ps(&models[i + lane][column][0]);
+            _MM_TRANSPOSE4_PS(m[column][0], m[column][1], m[column][2], m[column][3]);
+        }
+
+        // the cofactor columns are cross products of the other two columns
+        __m128 cofactors[3][3];
+        for (int column = 0; column < 3; column++) {
+            const __m128 *u = m[(column + 1) % 3], *v = m[(column + 2) % 3];
+            cofactors[column][0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+            cofactors[column][1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+            cofactors[column][2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+        }
+
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], cofactors[0][0]),
+                                                   _mm_mul_ps(m[0][1], cofactors[0][1])),
+                                        _mm_mul_ps(m[0][2], cofactors[0][2]));
+        __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+        // and back, a column of every matrix per transpose, stored three floats at a time
+        for (int column = 0; column < 3; column++) {
+            __m128 lanes[4] = {_mm_mul_ps(cofactors[column][0], inverseDeterminant),
+                               _mm_mul_ps(cofactors[column][1], inverseDeterminant),
+                               _mm_mul_ps(cofactors[column][2], inverseDeterminant), _mm_setzero_ps()};
+            _MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+            for (int lane = 0; lane < 4; lane++) {
+                float *out = &normals[i + lane][column][0];
+                _mm_storel_pi((__m64 *) out, lanes[lane]);
+                _mm_store_ss(out + 2, _mm_movehl_ps(lanes[lane], lanes[lane]));
+            }
+        }
+    }
+
+    // leftovers that don't fill a whole register
+    for (; i < count; i++)
+        normals[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+}
+
+// how far apart two normal matrices point once both are scaled to unit size, the shaders only see their direction
+static float directionError(const glm::mat3 &a, const glm::mat3 &b) {
+    float lengthA = std::sqrt(glm::dot(a[0], a[0]) + glm::dot(a[1], a[1]) + glm::dot(a[2], a[2]));
+    float lengthB = std::sqrt(glm::dot(b[0], b[0]) + glm::dot(b[1], b[1]) + glm::dot(b[2], b[2]));
+    float error = 0.0f;
+    for (int c = 0; c < 3; c++)
+        error = std::max(error, glm::length(a[c] / lengthA - b[c] / lengthB));
+    return error;
+}
+
+void BenchmarkNormalMatrices(std::ostream &out, unsigned int count) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<glm::mat4> models(count);
+    for (unsigned int i = 0; i < count; i++) {
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 2.0f, 0.0f));
+        glm::vec3 scale = glm::vec3(1.5f) + glm::vec3(unit(rng), unit(rng), unit(rng));
+        if (i % 2 == 0)
+            scale = glm::vec3(scale.x);
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f);
+        m = glm::rotate(m, unit(rng) * 3.1415927f, axis);
+        models[i] = glm::scale(m, scale);
+    }
+
+    const int repeats = 20;
+    auto rate = [&](std::chrono::steady_clock::time_point start) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return (double) count * repeats / seconds / 1e6;
+    };
+
+    std::vector<glm::mat3> reference(count), single(count), batched(count);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (unsigned int i = 0; i < count; i++)
+            reference[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+    }
+    out << count << " transforms, half uniformly scaled, glm inverse transpose: " << rate(start) << " M matrices/s"
+        << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (unsigned int i = 0; i < count; i++)
+            single[i] = NormalMatrix(models[i]);
+    }
+    out << "  NormalMatrix, skipping uniform scales: " << rate(start) << " M matrices/s" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        NormalMatrices(models.data(), count, batched.data());
+    out << "  NormalMatrices, SSE: " << rate(start) << " M matrices/s" << std::endl;
+
+    float singleError = 0.0f, batchedError = 0.0f;
+    for (unsigned int i = 0; i < count; i++) {
+        singleError = std::max(singleError, directionError(single[i], reference[i]));
+        batchedError = std::max(batchedError, directionError(batched[i], reference[i]));
+    }
+    out << "  largest difference to glm: " << singleError << " single, " << batchedError << " batched" << std::endl;
+}
+
+void BenchmarkNormalMatrixShaders(std::ostream &out, unsigned int segments, int width, int height,
+                                  unsigned int frames) {
+    // a unit sphere from pole to pole, whose normals are its positions
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    for (unsigned int y = 0; y <= segments; y++) {
+        float theta = glm::pi<float>() * (float) y / (float) segments;
+        for (unsigned int x = 0; x <= segments; x++) {
+            float phi = 2.0f * glm::pi<float>() * (float) x / (float) segments;
+            glm::vec3 position(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            vertices.push_back(position);
+            vertices.push_back(position);
+        }
+    }
+    for (unsigned int y = 0; y < segments; y++) {
+        for (unsigned int x = 0; x < segments; x++) {
+            unsigned int a = y * (segments + 1) + x, b = a + segments + 1;
+            indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+
+    unsigned int VAO, VBO, EBO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void *) 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void *) sizeof(glm::vec3));
+
+    // an 8x8 grid of spheres in front of the camera, each stretched its own way so none has a uniform scale
+    const int GRID = 8;
+    std::vector<glm::mat4> models;
+    for (int row = 0; row < GRID; row++) {
+        for (int column = 0; column < GRID; column++) {
+            glm::vec3 position((float) column - 3.5f, (float) row - 3.5f, -12.0f);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, 0.3f * (float) (row * GRID + column), glm::vec3(0.3f, 1.0f, 0.2f));
+            models.push_back(glm::scale(model, glm::vec3(0.3f + 0.03f * (float) column, 0.45f,
+                                                         0.3f + 0.03f * (float) row)));
+        }
+    }
+    std::vector<glm::mat3> normals(models.size());
+    NormalMatrices(models.data(), models.size(), normals.data());
+
+    RenderTarget target = CreateRenderTarget(width, height, GL_RGBA8, 0, true);
+    Shader uniformShader("shaders/dense_mesh/shader.vs", "shaders/dense_mesh/shader.fs");
+    Shader inverseShader("shaders/dense_mesh_inverse/shader.vs", "shaders/dense_mesh/shader.fs");
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float) width / (float) height, 0.1f, 100.0f);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    size_t verticesPerFrame = (size_t) (segments + 1) * (segments + 1) * models.size();
+    out << "Dense meshes: " << models.size() << " spheres of " << indices.size() / 3 << " triangles, "
+        << frames << " frames at " << width << "x" << height << std::endl;
+    for (Shader *shader : {&uniformShader, &inverseShader}) {
+        shader->use();
+        shader->setMat4("view", glm::mat4(1.0f));
+        shader->setMat4("projection", projection);
+        int modelLocation = glGetUniformLocation(shader->ID, "model");
+        int normalLocation = glGetUniformLocation(shader->ID, "normalMatrix");
+
+        // one untimed frame, so compiling the program on first use stays out of the timing
+        for (unsigned int frame = 0; frame <= frames; frame++) {
+            if (frame == 1)
+                glBeginQuery(GL_TIME_ELAPSED, query);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (size_t i = 0; i < models.size(); i++) {
+                glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(models[i]));
+                if (normalLocation >= 0)
+                    glUniformMatrix3fv(normalLocation, 1, GL_FALSE, glm::value_ptr(normals[i]));
+                glDrawElements(GL_TRIANGLES, (GLsizei) indices.size(), GL_UNSIGNED_INT, 0);
+            }
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        double milliseconds = (double) nanoseconds / 1e6 / std::max(1u, frames);
+        out << (shader == &uniformShader ? "  normalMatrix uniform: " : "  per-vertex inverse: ") << milliseconds
+            << " ms a frame, " << (double) verticesPerFrame / milliseconds / 1e3 << " M vertices/s" << std::endl;
+    }
+
+    glDeleteQueries(1, &query);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    DestroyRenderTarget(target);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <glm/glm.hpp>
+
+// Normal matrices for object transforms: the inverse transpose of the upper 3x3, which keeps normals perpendicular
+// to surfaces under non-uniform scale. Computed once per object on the CPU and handed to the shaders as the
+// normalMatrix uniform next to model, instead of inverting a matrix for every vertex.
+//
+// Every shader normalizes the interpolated normal, so a normal matrix only has to be right up to a positive factor
+
+// true if the upper 3x3 is a rotation times a uniform scale, whose normal matrix is the upper 3x3 itself up to that
+// factor
+bool IsUniformScale(const glm::mat4 &model);
+
+// one object: skips the inverse when the transform is rigid or uniformly scaled
+glm::mat3 NormalMatrix(const glm::mat4 &model);
+
+// count objects, four at a time with SSE from the cofactors: for columns a, b, c the inverse transpose is
+// (b x c, c x a, a x b) / det. Every lane does the full computation, testing lanes for uniform scale first would cost
+// about as much as it saves
+void NormalMatrices(const glm::mat4 *models, size_t count, glm::mat3 *normals);
+
+// Computes the normal matrices of count random transforms, half of them uniformly scaled, with glm's inverse
+// transpose, NormalMatrix and NormalMatrices, and prints the rates and the largest difference to glm up to the factor
+// the shaders normalize away
+void BenchmarkNormalMatrices(std::ostream &out, unsigned int count);
+
+// With a context current, draws a grid of stretched spheres of segments x segments quads each into an offscreen
+// target for frames frames, once with the normalMatrix uniform and once with the per-vertex transpose(inverse()) the
+// shaders used before, and prints the GPU time and vertex rate of both. llvmpipe can hoist the inverse of a uniform
+// out of its vertex loop and then shows about the same rate either way; the difference is for drivers that evaluate
+// it per vertex
+void BenchmarkNormalMatrixShaders(std::ostream &out, unsigned int segments, int width, int height,
+                                  unsigned int frames);
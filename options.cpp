@@ -0,0 +1,80 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "options.hpp"
+
+bool ParseOptions(int argc, char **argv, RendererOptions &options, HeadlessOptions &headless) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--headless") {
+            headless.enabled = true;
+        } else if (argument == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &headless.width, &headless.height) != 2 || headless.width <= 0 ||
+                headless.height <= 0) {
+                std::cout << "ERROR::HEADLESS::INVALID_SIZE " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (argument == "--frames" && hasValue) {
+            headless.frames = (unsigned int) std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--fps" && hasValue) {
+            headless.framesPerSecond = std::max(1.0, std::atof(argv[++i]));
+        } else if (argument == "--camera-path" && hasValue) {
+            headless.cameraPath = argv[++i];
+        } else if (argument == "--output" && hasValue) {
+            headless.outputDirectory = argv[++i];
+        } else if (argument == "--format" && hasValue) {
+            if (!ParseCaptureFormat(argv[++i], headless.format)) {
+                std::cout << "ERROR::HEADLESS::UNKNOWN_FORMAT " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (argument == "--dynamic-resolution" && hasValue) {
+            headless.dynamicResolutionMilliseconds = (float) std::atof(argv[++i]);
+        } else if (argument == "--min-scale" && hasValue) {
+            headless.minScale = (float) std::atof(argv[++i]);
+        } else if (argument == "--max-scale" && hasValue) {
+            headless.maxScale = (float) std::atof(argv[++i]);
+        } else if (argument == "--deferred") {
+            options.deferred = true;
+        } else if (argument == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (argument == "--direct-draws") {
+            options.directDraws = true;
+        } else if (argument == "--raw-clips") {
+            options.rawClips = true;
+        } else if (argument == "--transparency" && hasValue) {
+            if (!ParseTransparencyMode(argv[++i], options.transparency)) {
+                std::cout << "ERROR::OPTIONS::UNKNOWN_TRANSPARENCY " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (argument == "--transparent" && hasValue) {
+            options.transparentCount = (unsigned int) std::max(0, std::atoi(argv[++i]));
+        } else if (argument == "--grass" && hasValue) {
+            options.grassCount = (unsigned int) std::max(0, std::atoi(argv[++i]));
+        } else if (argument == "--environment" && hasValue) {
+            options.environment = argv[++i];
+        } else if (argument == "--world" && hasValue) {
+            options.world = argv[++i];
+        } else if (argument == "--dense-mesh" && hasValue) {
+            options.denseMeshSegments = (unsigned int) std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--characters" && i + 2 < argc) {
+            options.characterModel = argv[++i];
+            options.characterCount = (unsigned int) std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cout << "ERROR::OPTIONS::UNKNOWN_ARGUMENT " << argument << std::endl;
+            return false;
+        }
+    }
+
+#ifndef HEADLESS
+    if (headless.enabled) {
+        std::cout << "ERROR::HEADLESS::NOT_BUILT_WITH_HEADLESS" << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "headless.hpp"
+#include "transparency.hpp"
+
+// Command line of the renderer, windowed or headless:
+//   learn_opengl [--deferred] [--depth-prepass] [--transparency sorted|wboit] [--transparent N] [--grass N]
+//                [--world file] [--direct-draws] [--characters file N] [--raw-clips] [--environment file]
+//                [--dense-mesh N] [headless options, see headless.hpp]
+// --characters file N places N animated instances of a skinned model on the plane. Their clips are compressed on
+// load and the sizes and errors printed; --raw-clips plays the imported keys instead.
+// --environment file lights the scene with an equirectangular .hdr image instead of the procedural sky. Either is
+// baked once into the cache directory and read back from there afterwards.
+// --direct-draws draws the opaque passes model by model instead of replaying command lists, to compare the two.
+// --world streams a scene file around the camera. Headless runs without a camera path fly across it diagonally,
+// which makes the run a benchmark of streaming hitches.
+// --dense-mesh N renders nothing but a grid of spheres of N x N quads, with the normalMatrix uniform and with the
+// per-vertex inverse the shaders used before, prints the vertex rate of both and exits. Best run headless.
+// The benchmarks and writing an example world are a separate executable, see benchmarks.cpp
+struct RendererOptions {
+    bool deferred = false;
+    bool depthPrepass = false;
+    bool directDraws = false;
+    bool rawClips = false;
+    // how the transparent windows are drawn and how many of them, growing the count compares the two modes
+    TransparencyMode transparency = TransparencyMode::SORTED;
+    unsigned int transparentCount = 32;
+    // grass clumps over the plane, millions are fine since culling and drawing stay on the GPU
+    unsigned int grassCount = 131072;
+    std::string characterModel;
+    unsigned int characterCount = 0;
+    std::string environment;
+    std::string world;
+    unsigned int denseMeshSegments = 0;
+};
+
+// fills both from the command line, returns false on an unknown or malformed argument
+bool ParseOptions(int argc, char **argv, RendererOptions &options, HeadlessOptions &headless);
@@ -0,0 +1,191 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "postprocess.hpp"
+
+const unsigned int MAX_KERNEL_TAPS = 8;
+
+SeparableKernel LinearSampledGaussian(int radius, float sigma) {
+    // one tap for the center and one for every pair of texels after it, anything past that would be cut off after
+    // the weights were normalized over it and darken the image
+    radius = std::min(radius, 2 * (int) (MAX_KERNEL_TAPS - 1));
+    std::vector<float> discrete(radius + 1);
+    float sum = 0.0f;
+    for (int i = 0; i <= radius; i++) {
+        discrete[i] = std::exp(-(float) (i * i) / (2.0f * sigma * sigma));
+        // everything but the center is used twice, once on each side
+        sum += i == 0 ? discrete[i] : 2.0f * discrete[i];
+    }
+    for (float &weight : discrete)
+        weight /= sum;
+
+    SeparableKernel kernel;
+    kernel.offsets.push_back(0.0f);
+    kernel.weights.push_back(discrete[0]);
+
+    // sampling at the weighted average of two texel centers makes the bilinear filter return
+    // (w1 * t1 + w2 * t2) / (w1 + w2), which scaled by (w1 + w2) is exactly the two discrete taps
+    for (int i = 1; i <= radius; i += 2) {
+        float w1 = discrete[i];
+        float w2 = i + 1 <= radius ? discrete[i + 1] : 0.0f;
+        kernel.weights.push_back(w1 + w2);
+        kernel.offsets.push_back(((float) i * w1 + (float) (i + 1) * w2) / (w1 + w2));
+    }
+
+    return kernel;
+}
+
+PostProcessStack::PostProcessStack(RenderTargetPool &pool, GpuProfiler &profiler)
+        : pool(pool), profiler(profiler), copyShader("shaders/copy/shader.vs", "shaders/copy/shader.fs"),
+          upscaleShader("shaders/upscale/shader.vs", "shaders/upscale/shader.fs"), sharpness(0.2f) {
+}
+
+unsigned int PostProcessStack::AddPass(const std::string &name, Shader *shader, float scale, bool enabled) {
+    PostPass pass;
+    pass.name = name;
+    pass.shader = shader;
+    pass.scale = scale;
+    pass.enabled = enabled;
+
+    passes.push_back(pass);
+    return (unsigned int) passes.size() - 1;
+}
+
+unsigned int PostProcessStack::AddSeparablePass(const std::string &name, Shader *shader, const SeparableKernel &kernel,
+                                                float scale, bool enabled) {
+    unsigned int index = AddPass(name, shader, scale, enabled);
+    passes[index].separable = true;
+    passes[index].kernel = kernel;
+    return index;
+}
+
+void PostProcessStack::Toggle(unsigned int index) {
+    if (index < passes.size())
+        passes[index].enabled = !passes[index].enabled;
+}
+
+RenderTarget *PostProcessStack::acquire(int width, int height) {
+    return pool.Acquire({width, height, GL_RGBA16F, 1, false});
+}
+
+void PostProcessStack::draw(PostPass &pass, unsigned int source, int sourceWidth, int sourceHeight,
+                            glm::vec2 direction, unsigned int FBO, int width, int height) {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, width, height);
+
+    pass.shader->use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    pass.shader->setInt("sampler", 0);
+    pass.shader->setVec2("texelSize", glm::vec2(1.0f / (float) sourceWidth, 1.0f / (float) sourceHeight));
+
+    if (pass.separable) {
+        pass.shader->setVec2("direction", direction);
+        pass.shader->setInt("kernelTaps", (int) pass.kernel.offsets.size());
+        for (unsigned int i = 0; i < pass.kernel.offsets.size(); i++) {
+            std::string index = "[" + std::to_string(i) + "]";
+            pass.shader->setFloat("kernelOffsets" + index, pass.kernel.offsets[i]);
+            pass.shader->setFloat("kernelWeights" + index, pass.kernel.weights[i]);
+        }
+    }
+
+    quad.Draw();
+}
+
+void PostProcessStack::Execute(unsigned int inputTexture, int width, int height,
+                               unsigned int outputFBO, int outputWidth, int outputHeight) {
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    int last = -1;
+    for (unsigned int i = 0; i < passes.size(); i++) {
+        if (passes[i].enabled)
+            last = (int) i;
+    }
+
+    unsigned int source = inputTexture;
+    int sourceWidth = width, sourceHeight = height;
+    RenderTarget *held = nullptr;
+    bool presented = false;
+
+    for (int i = 0; i <= last; i++) {
+        PostPass &pass = passes[i];
+        if (!pass.enabled)
+            continue;
+
+        int passWidth = std::max(1, (int) ((float) width * pass.scale));
+        int passHeight = std::max(1, (int) ((float) height * pass.scale));
+        // a full resolution last pass writes straight into the output instead of going through a copy
+        bool toOutput = i == last && passWidth == outputWidth && passHeight == outputHeight;
+
+        RenderTarget *target = toOutput ? nullptr : acquire(passWidth, passHeight);
+        unsigned int targetFBO = toOutput ? outputFBO : target->FBO;
+
+        profiler.Begin("post/" + pass.name);
+
+        if (pass.separable) {
+            RenderTarget *intermediate = acquire(passWidth, passHeight);
+            draw(pass, source, sourceWidth, sourceHeight, glm::vec2(1.0f, 0.0f),
+                 intermediate->FBO, passWidth, passHeight);
+            draw(pass, intermediate->color, passWidth, passHeight, glm::vec2(0.0f, 1.0f),
+                 targetFBO, passWidth, passHeight);
+            pool.Release(intermediate);
+        } else {
+            draw(pass, source, sourceWidth, sourceHeight, glm::vec2(0.0f), targetFBO, passWidth, passHeight);
+        }
+
+        profiler.End();
+
+        if (held)
+            pool.Release(held);
+        held = target;
+        presented = toOutput;
+
+        if (target) {
+            source = target->color;
+            sourceWidth = passWidth;
+            sourceHeight = passHeight;
+        }
+    }
+
+    if (!presented) {
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glViewport(0, 0, outputWidth, outputHeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source);
+
+        // rendered below the output resolution, the bilinear stretch gets some of its lost detail back
+        if (sourceWidth < outputWidth || sourceHeight < outputHeight) {
+            GpuScope scope(profiler, "post/upscale");
+            upscaleShader.use();
+            upscaleShader.setInt("sampler", 0);
+            upscaleShader.setVec2("texelSize", glm::vec2(1.0f / (float) sourceWidth, 1.0f / (float) sourceHeight));
+            upscaleShader.setFloat("sharpness", sharpness);
+            quad.Draw();
+        } else {
+            copyShader.use();
+            copyShader.setInt("sampler", 0);
+            quad.Draw();
+        }
+    }
+
+    if (held)
+        pool.Release(held);
+
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+}
+
+void PostProcessStack::Report() const {
+    std::ios::fmtflags flags = std::cout.flags();
+    for (unsigned int i = 0; i < passes.size(); i++) {
+        const PostPass &pass = passes[i];
+        std::cout << "[" << i + 1 << "] " << std::left << std::setw(12) << pass.name
+                  << (pass.enabled ? " on " : " off") << "  scale " << pass.scale << "  "
+                  << std::fixed << std::setprecision(3) << profiler.AverageMilliseconds("post/" + pass.name) << " ms"
+                  << std::endl;
+    }
+    std::cout.flags(flags);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "shader.hpp"
+#include "render_target_pool.hpp"
+#include "gpu_profiler.hpp"
+#include "screen_quad.hpp"
+
+// Weights of a symmetric 1D kernel, rearranged so that every tap past the center reads two neighbouring texels with a
+// single bilinear fetch. offsets are in texels, tap 0 is the center
+struct SeparableKernel {
+    std::vector<float> offsets;
+    std::vector<float> weights;
+};
+
+// Builds a normalized gaussian of the given radius, merging texel pairs (1,2), (3,4)... into single taps
+SeparableKernel LinearSampledGaussian(int radius, float sigma);
+
+// One step of the post processing chain. The shader samples the previous step from "sampler" at unit 0 and gets the
+// texel size of its input in "texelSize"
+struct PostPass {
+    std::string name;
+    Shader *shader;
+    // output resolution relative to the final output, e.g. 0.5 or 0.25
+    float scale = 1.0f;
+    bool enabled = true;
+    // separable passes run twice, horizontally then vertically, with the kernel uniforms set
+    bool separable = false;
+    SeparableKernel kernel;
+};
+
+// An ordered list of fullscreen passes run over ping-pong render targets taken from the pool. Every pass is timed as
+// its own profiler scope, named "post/<pass name>"
+class PostProcessStack {
+public:
+    PostProcessStack(RenderTargetPool &pool, GpuProfiler &profiler);
+
+    PostProcessStack(const PostProcessStack &) = delete;
+    PostProcessStack &operator=(const PostProcessStack &) = delete;
+
+    // appends a pass to the end of the chain, returns its index
+    unsigned int AddPass(const std::string &name, Shader *shader, float scale = 1.0f, bool enabled = true);
+    unsigned int AddSeparablePass(const std::string &name, Shader *shader, const SeparableKernel &kernel,
+                                  float scale = 1.0f, bool enabled = true);
+
+    void Toggle(unsigned int index);
+
+    // how much an upscale to the output sharpens, 0 for plain bilinear
+    void SetUpscaleSharpness(float amount) { sharpness = amount; }
+
+    // runs the enabled passes over the input texture and writes the result to the output framebuffer, upscaling and
+    // sharpening it if the output is larger. Pass scales are relative to the input size
+    void Execute(unsigned int inputTexture, int width, int height,
+                 unsigned int outputFBO, int outputWidth, int outputHeight);
+
+    // prints every pass with its state and average GPU time
+    void Report() const;
+
+private:
+    std::vector<PostPass> passes;
+    RenderTargetPool &pool;
+    GpuProfiler &profiler;
+
+    Shader copyShader, upscaleShader;
+    float sharpness;
+    ScreenQuad quad;
+
+    RenderTarget *acquire(int width, int height);
+
+    void draw(PostPass &pass, unsigned int source, int sourceWidth, int sourceHeight, glm::vec2 direction,
+              unsigned int FBO, int width, int height);
+};
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "render_graph.hpp"
+
+const RenderTarget &RenderGraphContext::Target(unsigned int resource) const {
+    const RenderGraph::Resource &r = graph.resources[resource];
+    if (r.imported)
+        return r.target;
+    return *graph.physicals[r.physical].target;
+}
+
+unsigned int RenderGraph::CreateTexture(const std::string &name, const RenderTargetDesc &desc) {
+    resources.push_back({name, desc, false, false, RenderTarget(), -1, -1, -1});
+    return (unsigned int) resources.size() - 1;
+}
+
+unsigned int RenderGraph::ImportTexture(const std::string &name, const RenderTarget &target) {
+    RenderTargetDesc desc = {target.width, target.height, target.format, target.samples, target.depth != 0};
+    resources.push_back({name, desc, true, false, target, -1, -1, -1});
+    return (unsigned int) resources.size() - 1;
+}
+
+void RenderGraph::AddPass(const std::string &name, const std::function<void(RenderGraphBuilder &)> &setup,
+                          const std::function<void(const RenderGraphContext &)> &execute) {
+    RenderGraphBuilder builder;
+    setup(builder);
+    passes.push_back({name, builder.reads, builder.writes, execute, false});
+    compiled = false;
+}
+
+void RenderGraph::MarkOutput(unsigned int resource) {
+    resources[resource].output = true;
+}
+
+bool RenderGraph::Compile() {
+    size_t passCount = passes.size();
+
+    // writers of every resource, in declaration order
+    std::vector<std::vector<unsigned int>> writers(resources.size());
+    for (unsigned int p = 0; p < passCount; p++) {
+        for (unsigned int w : passes[p].writes)
+            writers[w].push_back(p);
+    }
+
+    // a reader depends on the writers of what it reads. When a pass both reads and writes a resource (blending on
+    // top of it, say) it only depends on the writers declared before it, and writers of the same resource keep their
+    // declaration order
+    std::vector<std::vector<unsigned int>> dependencies(passCount);
+    for (unsigned int p = 0; p < passCount; p++) {
+        for (unsigned int r : passes[p].reads) {
+            bool alsoWrites = std::find(passes[p].writes.begin(), passes[p].writes.end(), r) != passes[p].writes.end();
+            for (unsigned int w : writers[r]) {
+                if (w != p && (!alsoWrites || w < p))
+                    dependencies[p].push_back(w);
+            }
+        }
+        for (unsigned int r : passes[p].writes) {
+            for (unsigned int w : writers[r]) {
+                if (w < p)
+                    dependencies[p].push_back(w);
+            }
+        }
+    }
+
+    // walk back from the outputs, every pass something kept depends on is kept too
+    for (Pass &pass : passes)
+        pass.culled = true;
+    std::vector<unsigned int> stack;
+    for (unsigned int p = 0; p < passCount; p++) {
+        for (unsigned int w : passes[p].writes) {
+            if (resources[w].output)
+                stack.push_back(p);
+        }
+    }
+    while (!stack.empty()) {
+        unsigned int p = stack.back();
+        stack.pop_back();
+        if (!passes[p].culled)
+            continue;
+        passes[p].culled = false;
+        for (unsigned int d : dependencies[p])
+            stack.push_back(d);
+    }
+
+    // Kahn's algorithm, preferring the earliest declared pass among the ready ones
+    std::vector<unsigned int> remaining(passCount, 0);
+    std::vector<std::vector<unsigned int>> dependents(passCount);
+    for (unsigned int p = 0; p < passCount; p++) {
+        if (passes[p].culled)
+            continue;
+        for (unsigned int d : dependencies[p]) {
+            remaining[p]++;
+            dependents[d].push_back(p);
+        }
+    }
+
+    order.clear();
+    std::vector<unsigned int> ready;
+    for (unsigned int p = 0; p < passCount; p++) {
+        if (!passes[p].culled && remaining[p] == 0)
+            ready.push_back(p);
+    }
+    while (!ready.empty()) {
+        auto next = std::min_element(ready.begin(), ready.end());
+        unsigned int p = *next;
+        ready.erase(next);
+        order.push_back(p);
+        for (unsigned int d : dependents[p]) {
+            if (--remaining[d] == 0)
+                ready.push_back(d);
+        }
+    }
+
+    bool acyclic = true;
+    size_t kept = std::count_if(passes.begin(), passes.end(), [](const Pass &pass) { return !pass.culled; });
+    if (order.size() != kept) {
+        std::cout << "ERROR::RENDER_GRAPH::CYCLE" << std::endl;
+        acyclic = false;
+        order.clear();
+        for (unsigned int p = 0; p < passCount; p++) {
+            if (!passes[p].culled)
+                order.push_back(p);
+        }
+    }
+
+    // lifetimes as positions in the execution order
+    for (Resource &resource : resources) {
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+        resource.physical = -1;
+    }
+    for (int i = 0; i < (int) order.size(); i++) {
+        const Pass &pass = passes[order[i]];
+        for (const std::vector<unsigned int> *list : {&pass.reads, &pass.writes}) {
+            for (unsigned int r : *list) {
+                if (resources[r].firstUse < 0)
+                    resources[r].firstUse = i;
+                resources[r].lastUse = i;
+            }
+        }
+    }
+
+    // greedy interval assignment: in order of first use, reuse a physical target with the same description whose
+    // last user ran strictly before this texture's first one
+    std::vector<unsigned int> transient;
+    for (unsigned int r = 0; r < resources.size(); r++) {
+        if (!resources[r].imported && resources[r].firstUse >= 0)
+            transient.push_back(r);
+    }
+    std::sort(transient.begin(), transient.end(), [&](unsigned int a, unsigned int b) {
+        return resources[a].firstUse < resources[b].firstUse;
+    });
+
+    physicals.clear();
+    for (unsigned int r : transient) {
+        Resource &resource = resources[r];
+        for (unsigned int p = 0; p < physicals.size(); p++) {
+            if (physicals[p].desc == resource.desc && physicals[p].lastUse < resource.firstUse) {
+                resource.physical = (int) p;
+                break;
+            }
+        }
+        if (resource.physical < 0) {
+            physicals.push_back({resource.desc, -1, nullptr});
+            resource.physical = (int) physicals.size() - 1;
+        }
+        physicals[resource.physical].lastUse = resource.lastUse;
+    }
+
+    compiled = true;
+    return acyclic;
+}
+
+void RenderGraph::Execute(RenderTargetPool &pool, GpuProfiler *profiler) {
+    if (!compiled)
+        Compile();
+
+    // first and last position each physical target is used at
+    std::vector<int> firstUse(physicals.size(), -1), lastUse(physicals.size(), -1);
+    for (const Resource &resource : resources) {
+        if (resource.physical < 0)
+            continue;
+        int &first = firstUse[resource.physical];
+        first = first < 0 ? resource.firstUse : std::min(first, resource.firstUse);
+        lastUse[resource.physical] = std::max(lastUse[resource.physical], resource.lastUse);
+    }
+
+    RenderGraphContext context(*this);
+    for (int i = 0; i < (int) order.size(); i++) {
+        for (unsigned int p = 0; p < physicals.size(); p++) {
+            if (firstUse[p] == i)
+                physicals[p].target = pool.Acquire(physicals[p].desc);
+        }
+
+        if (profiler)
+            profiler->Begin(passes[order[i]].name);
+        passes[order[i]].execute(context);
+        if (profiler)
+            profiler->End();
+
+        // handing the target back right away lets passes later in the frame, or outside the graph, reuse it
+        for (unsigned int p = 0; p < physicals.size(); p++) {
+            if (lastUse[p] == i) {
+                pool.Release(physicals[p].target);
+                physicals[p].target = nullptr;
+            }
+        }
+    }
+}
+
+size_t RenderGraph::VirtualBytes() const {
+    size_t bytes = 0;
+    for (const Resource &resource : resources) {
+        if (!resource.imported && resource.physical >= 0)
+            bytes += RenderTargetBytes(resource.desc);
+    }
+    return bytes;
+}
+
+size_t RenderGraph::PhysicalBytes() const {
+    size_t bytes = 0;
+    for (const Physical &physical : physicals)
+        bytes += RenderTargetBytes(physical.desc);
+    return bytes;
+}
+
+std::string RenderGraph::Dump() const {
+    std::ostringstream out;
+    auto names = [&](const std::vector<unsigned int> &list) {
+        std::string joined;
+        for (unsigned int r : list)
+            joined += (joined.empty() ? "" : ", ") + resources[r].name;
+        return joined.empty() ? std::string("-") : joined;
+    };
+
+    size_t culled = std::count_if(passes.begin(), passes.end(), [](const Pass &pass) { return pass.culled; });
+    out << "render graph: " << order.size() << " passes, " << culled << " culled, " << resources.size()
+        << " textures\n";
+
+    out << "passes:\n";
+    for (int i = 0; i < (int) order.size(); i++) {
+        const Pass &pass = passes[order[i]];
+        out << "  " << std::setw(2) << i << " " << std::left << std::setw(20) << pass.name << std::right
+            << " reads [" << names(pass.reads) << "] writes [" << names(pass.writes) << "]\n";
+    }
+    for (const Pass &pass : passes) {
+        if (pass.culled)
+            out << "  -- " << std::left << std::setw(20) << pass.name << std::right << " culled\n";
+    }
+
+    out << "textures:\n";
+    for (const Resource &resource : resources) {
+        out << "  " << std::left << std::setw(16) << resource.name << std::right << " "
+            << resource.desc.width << "x" << resource.desc.height << " " << FormatName(resource.desc.format);
+        if (resource.desc.samples > 1)
+            out << " x" << resource.desc.samples;
+        if (resource.desc.withDepth)
+            out << " +depth";
+
+        if (resource.imported)
+            out << "  imported";
+        else if (resource.physical < 0)
+            out << "  unused";
+        else
+            out << "  lifetime [" << resource.firstUse << ", " << resource.lastUse << "] -> physical "
+                << resource.physical;
+        if (resource.output)
+            out << "  output";
+        out << "\n";
+    }
+
+    double virtualMB = (double) VirtualBytes() / (1024.0 * 1024.0);
+    double physicalMB = (double) PhysicalBytes() / (1024.0 * 1024.0);
+    out << std::fixed << std::setprecision(2) << "memory: " << virtualMB << " MB declared, " << physicalMB
+        << " MB allocated, " << virtualMB - physicalMB << " MB saved by aliasing\n";
+
+    return out.str();
+}
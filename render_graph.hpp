@@ -0,0 +1,95 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "render_target_pool.hpp"
+#include "gpu_profiler.hpp"
+
+class RenderGraph;
+
+// Handed to a pass when it runs, resolves the graph's resource handles to actual targets
+class RenderGraphContext {
+public:
+    explicit RenderGraphContext(const RenderGraph &graph) : graph(graph) {}
+
+    const RenderTarget &Target(unsigned int resource) const;
+
+private:
+    const RenderGraph &graph;
+};
+
+// Declared by a pass during setup: which resources it reads and which it writes
+class RenderGraphBuilder {
+public:
+    void Read(unsigned int resource) { reads.push_back(resource); }
+    void Write(unsigned int resource) { writes.push_back(resource); }
+
+private:
+    friend class RenderGraph;
+    std::vector<unsigned int> reads, writes;
+};
+
+// A frame described as passes and the textures flowing between them. Compile culls the passes whose results never
+// reach an output, orders the rest by their dependencies and assigns transient textures with disjoint lifetimes to the
+// same physical target. Compile and Dump don't touch OpenGL, only Execute does
+class RenderGraph {
+public:
+    // a texture that only exists inside the frame, allocated from the pool while passes use it
+    unsigned int CreateTexture(const std::string &name, const RenderTargetDesc &desc);
+
+    // a texture that lives outside the graph, like the backbuffer or the shadow map. Never culled against or aliased
+    unsigned int ImportTexture(const std::string &name, const RenderTarget &target);
+
+    void AddPass(const std::string &name, const std::function<void(RenderGraphBuilder &)> &setup,
+                 const std::function<void(const RenderGraphContext &)> &execute);
+
+    // passes contributing to an output are kept, everything else is culled
+    void MarkOutput(unsigned int resource);
+
+    // returns false if the dependencies contain a cycle, in which case passes run in declaration order
+    bool Compile();
+
+    // runs the compiled passes, each one as its own profiler scope when a profiler is given
+    void Execute(RenderTargetPool &pool, GpuProfiler *profiler = nullptr);
+
+    // the compiled order, culled passes, texture lifetimes, aliasing and memory usage as text
+    std::string Dump() const;
+
+    // sum of every transient texture's size against what the aliased physical targets take
+    size_t VirtualBytes() const;
+    size_t PhysicalBytes() const;
+
+private:
+    friend class RenderGraphContext;
+
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        bool output;
+        RenderTarget target;
+        // compiled: index into physical, and the first/last position in the execution order using it
+        int physical;
+        int firstUse, lastUse;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<unsigned int> reads, writes;
+        std::function<void(const RenderGraphContext &)> execute;
+        bool culled;
+    };
+
+    struct Physical {
+        RenderTargetDesc desc;
+        int lastUse;
+        RenderTarget *target;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<unsigned int> order;
+    std::vector<Physical> physicals;
+    bool compiled = false;
+};
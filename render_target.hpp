@@ -0,0 +1,18 @@
+#pragma once
+
+// An offscreen framebuffer with one color attachment and an optional depth attachment. Single sampled targets
+// store color in a texture so later passes can sample it, multisampled ones use a renderbuffer that has to be
+// resolved with a blit first
+struct RenderTarget {
+    unsigned int FBO = 0;
+    unsigned int color = 0;
+    unsigned int depth = 0;
+
+    int width = 0, height = 0;
+    int samples = 0;
+    unsigned int format = 0;
+};
+
+RenderTarget CreateRenderTarget(int width, int height, unsigned int format, int samples, bool withDepth);
+
+void DestroyRenderTarget(RenderTarget &target);
@@ -0,0 +1,135 @@
+#include <glad/glad.h>
+#include <algorithm>
+
+#include "render_target_pool.hpp"
+
+size_t bytesPerPixel(unsigned int format) {
+    switch (format) {
+        case GL_RGBA32F:
+            return 16;
+        case GL_RGBA16F:
+            return 8;
+        case GL_RG16F:
+        case GL_R32F:
+        case GL_RGBA8:
+            return 4;
+        case GL_R16F:
+            return 2;
+        case GL_R8:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
+size_t RenderTargetBytes(const RenderTargetDesc &desc) {
+    size_t pixels = (size_t) desc.width * desc.height * std::max(1, desc.samples);
+    // depth is a packed 24 bit depth + 8 bit stencil renderbuffer
+    return pixels * (bytesPerPixel(desc.format) + (desc.withDepth ? 4 : 0));
+}
+
+const char *FormatName(unsigned int format) {
+    switch (format) {
+        case GL_RGBA32F:
+            return "RGBA32F";
+        case GL_RGBA16F:
+            return "RGBA16F";
+        case GL_RG16F:
+            return "RG16F";
+        case GL_R32F:
+            return "R32F";
+        case GL_RGBA8:
+            return "RGBA8";
+        case GL_R16F:
+            return "R16F";
+        case GL_R8:
+            return "R8";
+        default:
+            return "?";
+    }
+}
+
+RenderTargetPool::RenderTargetPool(unsigned int evictAfterFrames, unsigned int settleFrames)
+        : evictAfterFrames(evictAfterFrames), settleFrames(settleFrames), frame(0), evicted(0), renderWidth(0),
+          renderHeight(0), renderScale(1.0f), pendingWidth(0), pendingHeight(0), framesSinceResize(0) {
+}
+
+RenderTargetPool::~RenderTargetPool() {
+    for (auto &entry : entries)
+        DestroyRenderTarget(entry->target);
+}
+
+void RenderTargetPool::SetWindowSize(int width, int height) {
+    // minimized windows report 0x0, keep rendering at the last real size
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (width != pendingWidth || height != pendingHeight) {
+        pendingWidth = width;
+        pendingHeight = height;
+        framesSinceResize = 0;
+    }
+
+    if (renderWidth == 0) {
+        renderWidth = width;
+        renderHeight = height;
+    }
+}
+
+void RenderTargetPool::BeginFrame() {
+    frame++;
+
+    for (auto &entry : entries)
+        entry->inUse = false;
+
+    if ((pendingWidth != renderWidth || pendingHeight != renderHeight) && ++framesSinceResize >= settleFrames) {
+        renderWidth = pendingWidth;
+        renderHeight = pendingHeight;
+    }
+
+    // targets of the old size stop being requested after a resize, so they age out here together
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](std::unique_ptr<Entry> &entry) {
+        if (frame - entry->lastUsed <= evictAfterFrames)
+            return false;
+        DestroyRenderTarget(entry->target);
+        evicted++;
+        return true;
+    }), entries.end());
+}
+
+RenderTarget *RenderTargetPool::Acquire(const RenderTargetDesc &desc) {
+    for (auto &entry : entries) {
+        if (!entry->inUse && entry->desc == desc) {
+            entry->inUse = true;
+            entry->lastUsed = frame;
+            return &entry->target;
+        }
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->desc = desc;
+    entry->target = CreateRenderTarget(desc.width, desc.height, desc.format, desc.samples, desc.withDepth);
+    entry->inUse = true;
+    entry->lastUsed = frame;
+    entries.push_back(std::move(entry));
+    return &entries.back()->target;
+}
+
+void RenderTargetPool::Release(RenderTarget *target) {
+    for (auto &entry : entries) {
+        if (&entry->target == target)
+            entry->inUse = false;
+    }
+}
+
+size_t RenderTargetPool::BytesAllocated() const {
+    size_t bytes = 0;
+    for (const auto &entry : entries)
+        bytes += RenderTargetBytes(entry->desc);
+    return bytes;
+}
+
+void RenderTargetPool::Report(std::ostream &out) const {
+    out << "Render target pool: " << entries.size() << " targets using " << BytesAllocated() / (1024 * 1024)
+        << " MB at " << RenderWidth() << "x" << RenderHeight() << ", " << evicted << " evicted" << std::endl;
+}
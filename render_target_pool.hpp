@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "render_target.hpp"
+
+struct RenderTargetDesc {
+    int width, height;
+    unsigned int format;
+    int samples;
+    bool withDepth;
+
+    bool operator==(const RenderTargetDesc &other) const {
+        return width == other.width && height == other.height && format == other.format &&
+               samples == other.samples && withDepth == other.withDepth;
+    }
+};
+
+// approximate video memory taken by a target with this description
+size_t RenderTargetBytes(const RenderTargetDesc &desc);
+
+// short printable name of a color format, e.g. "RGBA16F"
+const char *FormatName(unsigned int format);
+
+// Hands out transient render targets matched on (format, size, samples, depth). Everything acquired during a frame
+// goes back to the pool at the next BeginFrame at the latest, and targets nobody asked for in a while are deleted.
+//
+// The pool also owns the resolution offscreen rendering happens at. Window resizes only change it once the window
+// size stopped changing for a few frames, so dragging the window border doesn't reallocate every target each frame;
+// in the meantime the old targets keep being used and get stretched to the window when presenting
+class RenderTargetPool {
+public:
+    explicit RenderTargetPool(unsigned int evictAfterFrames = 8, unsigned int settleFrames = 10);
+    ~RenderTargetPool();
+
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    RenderTargetPool &operator=(const RenderTargetPool &) = delete;
+
+    // records the window size, the render size follows once it has settled
+    void SetWindowSize(int width, int height);
+
+    // returns last frame's targets to the pool, applies a settled resize and evicts idle targets
+    void BeginFrame();
+
+    RenderTarget *Acquire(const RenderTargetDesc &desc);
+    void Release(RenderTarget *target);
+
+    // fraction of the settled window size to render at, for dynamic resolution. Unlike window resizes it applies
+    // right away, whoever sets it is expected to change it rarely
+    void SetRenderScale(float scale) { renderScale = scale; }
+
+    int RenderWidth() const { return std::max(1, (int) ((float) renderWidth * renderScale + 0.5f)); }
+    int RenderHeight() const { return std::max(1, (int) ((float) renderHeight * renderScale + 0.5f)); }
+
+    // the settled window size, what the render size is at a scale of one
+    int FullWidth() const { return renderWidth; }
+    int FullHeight() const { return renderHeight; }
+
+    size_t TargetCount() const { return entries.size(); }
+    size_t BytesAllocated() const;
+
+    // targets held, their memory and how many went idle and were deleted since the start
+    void Report(std::ostream &out) const;
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        RenderTarget target;
+        bool inUse;
+        unsigned long lastUsed;
+    };
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    unsigned int evictAfterFrames, settleFrames;
+    unsigned long frame;
+    unsigned long evicted;
+
+    int renderWidth, renderHeight;
+    float renderScale;
+    int pendingWidth, pendingHeight;
+    unsigned int framesSinceResize;
+};
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "scene.hpp"
+#include "job_system.hpp"
+
+// Below this many chunks a system is cheaper to run than it is to hand out as jobs
+const size_t PARALLEL_CHUNK_THRESHOLD = 64;
+
+struct ComponentInfo {
+    size_t size;
+    void (*construct)(void *);
+};
+
+template <typename T>
+static void constructDefault(void *component) {
+    new (component) T();
+}
+
+// the transform systems read the parts as plain arrays of glm types
+static_assert(sizeof(Position) == sizeof(glm::vec3) && sizeof(Scale) == sizeof(glm::vec3) &&
+              sizeof(Rotation) == sizeof(glm::quat), "transform parts have to be their bare glm type");
+
+// indexed like ComponentOf
+static const ComponentInfo COMPONENTS[COMPONENT_COUNT] = {
+        {sizeof(Position), constructDefault<Position>},
+        {sizeof(Rotation), constructDefault<Rotation>},
+        {sizeof(Scale), constructDefault<Scale>},
+        {sizeof(glm::mat4), constructDefault<glm::mat4>},
+        {sizeof(Renderable), constructDefault<Renderable>},
+        {sizeof(Bounds), constructDefault<Bounds>},
+        {sizeof(Visibility), constructDefault<Visibility>},
+        {sizeof(Light), constructDefault<Light>},
+        {sizeof(LightMotion), constructDefault<LightMotion>},
+};
+
+Scene::Archetype &Scene::archetype(ComponentMask mask) {
+    for (std::unique_ptr<Archetype> &existing : archetypes) {
+        if (existing->mask == mask)
+            return *existing;
+    }
+
+    // the entity indices come first, then one array per component, each starting on 16 bytes. Capacity is kept a
+    // multiple of four so the arrays stay aligned and SSE kernels can run over whole blocks
+    auto layout = [mask](unsigned int capacity, size_t offsets[COMPONENT_COUNT]) {
+        size_t offset = capacity * sizeof(uint32_t);
+        for (unsigned int i = 0; i < COMPONENT_COUNT; i++) {
+            offsets[i] = 0;
+            if (!(mask & (1u << i)))
+                continue;
+            offset = (offset + 15) & ~(size_t) 15;
+            offsets[i] = offset;
+            offset += capacity * COMPONENTS[i].size;
+        }
+        return offset;
+    };
+
+    auto created = std::make_unique<Archetype>();
+    created->mask = mask;
+    size_t bytesPerEntity = sizeof(uint32_t);
+    for (unsigned int i = 0; i < COMPONENT_COUNT; i++)
+        bytesPerEntity += (mask & (1u << i)) ? COMPONENTS[i].size : 0;
+    created->capacity = std::max(4u, (unsigned int) (CHUNK_BYTES / bytesPerEntity) & ~3u);
+    while (created->capacity > 4 && layout(created->capacity, created->offsets) > CHUNK_BYTES)
+        created->capacity -= 4;
+    created->bytes = layout(created->capacity, created->offsets);
+
+    archetypes.push_back(std::move(created));
+    return *archetypes.back();
+}
+
+Entity Scene::Create(ComponentMask components) {
+    Archetype &type = archetype(components);
+    if (type.chunks.empty() || type.chunks.back()->count == type.capacity) {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->archetype = &type;
+        chunk->data.reset(new uint8_t[type.bytes]);
+        type.chunks.push_back(std::move(chunk));
+    }
+    Chunk &chunk = *type.chunks.back();
+    unsigned int row = chunk.count++;
+
+    Entity entity;
+    if (freeIndices.empty()) {
+        entity.index = (uint32_t) records.size();
+        records.emplace_back();
+    } else {
+        entity.index = freeIndices.back();
+        freeIndices.pop_back();
+    }
+    Record &record = records[entity.index];
+    record.chunk = &chunk;
+    record.row = row;
+    entity.generation = record.generation;
+
+    chunk.Entities()[row] = entity.index;
+    chunk.transformVersion++;
+    for (unsigned int i = 0; i < COMPONENT_COUNT; i++) {
+        if (components & (1u << i))
+            COMPONENTS[i].construct(chunk.data.get() + type.offsets[i] + row * COMPONENTS[i].size);
+    }
+    count++;
+    return entity;
+}
+
+bool Scene::Alive(Entity entity) const {
+    return entity.index < records.size() && records[entity.index].chunk &&
+           records[entity.index].generation == entity.generation;
+}
+
+void Scene::Destroy(Entity entity) {
+    if (!Alive(entity))
+        return;
+
+    Record &record = records[entity.index];
+    Chunk &chunk = *record.chunk;
+    Archetype &type = *chunk.archetype;
+    Chunk &last = *type.chunks.back();
+    unsigned int lastRow = last.count - 1;
+
+    // the archetype's last entity fills the hole
+    if (&last != &chunk || lastRow != record.row) {
+        uint32_t moved = last.Entities()[lastRow];
+        chunk.Entities()[record.row] = moved;
+        for (unsigned int i = 0; i < COMPONENT_COUNT; i++) {
+            if (!(type.mask & (1u << i)))
+                continue;
+            size_t size = COMPONENTS[i].size;
+            std::memcpy(chunk.data.get() + type.offsets[i] + record.row * size,
+                        last.data.get() + type.offsets[i] + lastRow * size, size);
+        }
+        records[moved].chunk = &chunk;
+        records[moved].row = record.row;
+        // its matrix and bounds may be ones the last chunk was still due to update
+        chunk.transformVersion++;
+    }
+
+    last.count--;
+    if (last.count == 0)
+        type.chunks.pop_back();
+
+    record.chunk = nullptr;
+    record.generation++;
+    freeIndices.push_back(entity.index);
+    count--;
+}
+
+void Scene::SetTransform(Entity entity, const Transform &transform) {
+    Record &record = records[entity.index];
+    record.chunk->Components<Position>()[record.row].value = transform.position;
+    record.chunk->Components<Rotation>()[record.row].value = transform.rotation;
+    record.chunk->Components<Scale>()[record.row].value = transform.scale;
+    record.chunk->transformVersion++;
+}
+
+void Scene::SetPosition(Entity entity, const glm::vec3 &position) {
+    Record &record = records[entity.index];
+    record.chunk->Components<Position>()[record.row].value = position;
+    record.chunk->transformVersion++;
+}
+
+void Scene::SetRotation(Entity entity, const glm::quat &rotation) {
+    Record &record = records[entity.index];
+    record.chunk->Components<Rotation>()[record.row].value = rotation;
+    record.chunk->transformVersion++;
+}
+
+void Scene::SetScale(Entity entity, const glm::vec3 &scale) {
+    Record &record = records[entity.index];
+    record.chunk->Components<Scale>()[record.row].value = scale;
+    record.chunk->transformVersion++;
+}
+
+void Scene::Clear() {
+    archetypes.clear();
+    records.clear();
+    freeIndices.clear();
+    count = 0;
+}
+
+void Scene::Query(ComponentMask components, std::vector<Chunk *> &chunks) const {
+    chunks.clear();
+    for (const std::unique_ptr<Archetype> &type : archetypes) {
+        if ((type->mask & components) != components)
+            continue;
+        for (const std::unique_ptr<Chunk> &chunk : type->chunks)
+            chunks.push_back(chunk.get());
+    }
+}
+
+void Scene::forRanges(size_t count, unsigned int threads, const std::function<void(size_t, size_t)> &f) {
+    JobSystem::Instance().ParallelFor(count, 4, threads, PARALLEL_CHUNK_THRESHOLD, f);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clusters.hpp"
+#include "model.hpp"
+#include "transform.hpp"
+
+// What an entity can have, one bit per component type. The set of components of an entity is its archetype
+typedef uint32_t ComponentMask;
+
+const unsigned int COMPONENT_COUNT = 9;
+
+enum ComponentBit : ComponentMask {
+    COMPONENT_POSITION = 1 << 0,      // Position
+    COMPONENT_ROTATION = 1 << 1,      // Rotation
+    COMPONENT_SCALE = 1 << 2,         // Scale
+    COMPONENT_WORLD_MATRIX = 1 << 3,  // glm::mat4, written by UpdateTransforms
+    COMPONENT_RENDERABLE = 1 << 4,    // Renderable
+    COMPONENT_BOUNDS = 1 << 5,        // Bounds, the world half written by UpdateBounds
+    COMPONENT_VISIBILITY = 1 << 6,    // Visibility, written by CullScene
+    COMPONENT_LIGHT = 1 << 7,         // Light
+    COMPONENT_LIGHT_MOTION = 1 << 8,  // LightMotion
+
+    COMPONENT_TRANSFORM = COMPONENT_POSITION | COMPONENT_ROTATION | COMPONENT_SCALE
+};
+
+enum RenderFlag : uint32_t {
+    RENDER_TRANSPARENT = 1 << 0,
+    RENDER_ALPHA_TESTED = 1 << 1,
+    RENDER_CASTS_SHADOW = 1 << 2,
+    // casts a shadow that only changes when the caster is moved by hand
+    RENDER_STATIC = 1 << 3
+};
+
+// the parts of a Transform, each a component of its own so UpdateTransforms reads one packed array per part. Set
+// through the Scene, which marks the chunk for UpdateTransforms
+struct Position {
+    glm::vec3 value = glm::vec3(0.0f);
+};
+
+struct Rotation {
+    glm::quat value = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+};
+
+struct Scale {
+    glm::vec3 value = glm::vec3(1.0f);
+};
+
+struct Renderable {
+    Model *model = nullptr;
+    uint32_t flags = 0;
+};
+
+// axis aligned boxes as center and half extent, in the model's space and in the world
+struct Bounds {
+    glm::vec3 localCenter = glm::vec3(0.0f), localExtent = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f), extent = glm::vec3(0.0f);
+};
+
+struct Visibility {
+    uint8_t visible = 1;
+};
+
+// bobs a light up and down around its base height
+struct LightMotion {
+    float baseHeight = 0.0f;
+    float amplitude = 0.0f;
+    float phase = 0.0f;
+};
+
+// the index of the component type T is stored as
+template <typename T>
+struct ComponentOf;
+template <> struct ComponentOf<Position> { static const unsigned int index = 0; };
+template <> struct ComponentOf<Rotation> { static const unsigned int index = 1; };
+template <> struct ComponentOf<Scale> { static const unsigned int index = 2; };
+template <> struct ComponentOf<glm::mat4> { static const unsigned int index = 3; };
+template <> struct ComponentOf<Renderable> { static const unsigned int index = 4; };
+template <> struct ComponentOf<Bounds> { static const unsigned int index = 5; };
+template <> struct ComponentOf<Visibility> { static const unsigned int index = 6; };
+template <> struct ComponentOf<Light> { static const unsigned int index = 7; };
+template <> struct ComponentOf<LightMotion> { static const unsigned int index = 8; };
+
+struct Entity {
+    uint32_t index = UINT32_MAX;
+    // bumped whenever the index is reused, so handles to destroyed entities can be told apart
+    uint32_t generation = 0;
+};
+
+// Entity component store. The entities of one archetype are packed into fixed size chunks, and inside a chunk every
+// component has its own array, so a system reading two components walks two dense arrays per chunk no matter what
+// else the entities carry. Destroying an entity moves the archetype's last one into the hole, keeping the chunks
+// packed. Components are plain data that is copied with memcpy
+class Scene {
+public:
+    static const size_t CHUNK_BYTES = 16 * 1024;
+
+    struct Archetype;
+
+    struct Chunk {
+        Archetype *archetype = nullptr;
+        std::unique_ptr<uint8_t[]> data;
+        unsigned int count = 0;
+        // bumped whenever a transform in the chunk changes or an entity arrives in it. The systems remember the
+        // version they last brought their output up to and skip chunks that are still at it
+        uint32_t transformVersion = 1;
+        uint32_t matrixVersion = 0, boundsVersion = 0;
+
+        // the array of component T, count long. The archetype must have T
+        template <typename T>
+        T *Components() const {
+            return reinterpret_cast<T *>(data.get() + archetype->offsets[ComponentOf<T>::index]);
+        }
+        // index of the entity in each row
+        uint32_t *Entities() const { return reinterpret_cast<uint32_t *>(data.get()); }
+    };
+
+    struct Archetype {
+        ComponentMask mask;
+        unsigned int capacity;
+        // of one chunk, at most CHUNK_BYTES unless a single block of four entities doesn't fit
+        size_t bytes;
+        size_t offsets[COMPONENT_COUNT];
+        std::vector<std::unique_ptr<Chunk>> chunks;
+    };
+
+    Scene() = default;
+
+    Scene(const Scene &) = delete;
+    Scene &operator=(const Scene &) = delete;
+
+    // a new entity with default constructed components
+    Entity Create(ComponentMask components);
+    void Destroy(Entity entity);
+    bool Alive(Entity entity) const;
+    void Clear();
+    size_t Count() const { return count; }
+
+    template <typename T>
+    T &Get(Entity entity) {
+        const Record &record = records[entity.index];
+        return record.chunk->Components<T>()[record.row];
+    }
+
+    // the transform of an entity with COMPONENT_TRANSFORM. Writing it through Get would leave the world matrix and
+    // the bounds stale, these mark the chunk for UpdateTransforms
+    void SetTransform(Entity entity, const Transform &transform);
+    void SetPosition(Entity entity, const glm::vec3 &position);
+    void SetRotation(Entity entity, const glm::quat &rotation);
+    void SetScale(Entity entity, const glm::vec3 &scale);
+
+    // the chunks of every archetype with all of components, in the order the archetypes were first created
+    void Query(ComponentMask components, std::vector<Chunk *> &chunks) const;
+
+    // calls f(chunk) for every chunk with all of components. With threads 0 the calling thread handles small scenes
+    // alone and large ones are split into jobs, 1 keeps everything on the calling thread and anything else always
+    // splits; f must only write to the chunk it is given
+    template <typename F>
+    void ForEachChunk(ComponentMask components, F f, unsigned int threads = 0) {
+        std::vector<Chunk *> chunks;
+        Query(components, chunks);
+        forRanges(chunks.size(), threads, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+                f(*chunks[i]);
+        });
+    }
+
+private:
+    struct Record {
+        Chunk *chunk = nullptr;
+        unsigned int row = 0;
+        uint32_t generation = 0;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::vector<Record> records;
+    std::vector<uint32_t> freeIndices;
+    size_t count = 0;
+
+    Archetype &archetype(ComponentMask mask);
+    static void forRanges(size_t count, unsigned int threads, const std::function<void(size_t, size_t)> &f);
+};
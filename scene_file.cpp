@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "scene_file.hpp"
+#include "binary_io.hpp"
+
+const char SCENE_FILE_MAGIC[4] = {'L', 'O', 'G', 'W'};
+const uint32_t SCENE_FILE_VERSION = 1;
+
+static_assert(sizeof(SceneFileEntity) == 12 * sizeof(uint32_t), "entities are stored as they are in memory");
+
+bool WriteSceneFile(const std::string &path, float cellSize, const std::vector<std::string> &models,
+                    const std::vector<SceneFileEntity> &entities) {
+    // ordered by z then x, so neighbouring cells of a row are next to each other in the file
+    std::map<std::pair<int32_t, int32_t>, std::vector<const SceneFileEntity *>> cells;
+    for (const SceneFileEntity &entity : entities) {
+        int32_t x = (int32_t) std::floor(entity.transform.position.x / cellSize);
+        int32_t z = (int32_t) std::floor(entity.transform.position.z / cellSize);
+        cells[{z, x}].push_back(&entity);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+
+    file.write(SCENE_FILE_MAGIC, 4);
+    WriteValue(file, SCENE_FILE_VERSION);
+    WriteValue(file, cellSize);
+    WriteValue(file, (uint32_t) models.size());
+    WriteValue(file, (uint32_t) cells.size());
+    for (const std::string &model : models) {
+        WriteValue(file, (uint32_t) model.size());
+        file.write(model.data(), (std::streamsize) model.size());
+    }
+
+    uint64_t offset = (uint64_t) file.tellp() + cells.size() * (3 * sizeof(uint32_t) + sizeof(uint64_t));
+    for (const auto &cell : cells) {
+        WriteValue(file, cell.first.second);
+        WriteValue(file, cell.first.first);
+        WriteValue(file, (uint32_t) cell.second.size());
+        WriteValue(file, offset);
+        offset += cell.second.size() * sizeof(SceneFileEntity);
+    }
+    for (const auto &cell : cells) {
+        for (const SceneFileEntity *entity : cell.second)
+            WriteValue(file, *entity);
+    }
+
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool WriteExampleWorld(const std::string &path, unsigned int count) {
+    // about one cube per sixteen square units
+    float half = std::sqrt((float) count) * 2.0f;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<SceneFileEntity> entities(count);
+    for (SceneFileEntity &entity : entities) {
+        entity.model = 0;
+        entity.flags = 0;
+        float scale = 0.2f + unit(rng) * 0.6f;
+        entity.transform.position = glm::vec3((unit(rng) * 2.0f - 1.0f) * half, scale - 1.0f,
+                                              (unit(rng) * 2.0f - 1.0f) * half);
+        entity.transform.rotation = glm::angleAxis(unit(rng) * 3.1415927f, glm::vec3(0.0f, 1.0f, 0.0f));
+        entity.transform.scale = glm::vec3(scale);
+    }
+    return WriteSceneFile(path, 16.0f, {"models/cube/cube.obj"}, entities);
+}
+
+bool SceneFile::Open(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0, modelCount = 0, cellCount = 0;
+    if (!file || !file.read(magic, 4) || std::memcmp(magic, SCENE_FILE_MAGIC, 4) != 0 || !ReadValue(file, version) ||
+        version != SCENE_FILE_VERSION || !ReadValue(file, cellSize) || !ReadValue(file, modelCount) || !ReadValue(file, cellCount)) {
+        std::cout << "ERROR::SCENE_FILE::NOT_A_SCENE_FILE " << path << std::endl;
+        return false;
+    }
+
+    this->path = path;
+    models.resize(modelCount);
+    for (std::string &model : models) {
+        uint32_t length = 0;
+        ReadValue(file, length);
+        model.resize(length);
+        file.read(&model[0], length);
+    }
+
+    cells.resize(cellCount);
+    for (SceneFileCell &cell : cells) {
+        ReadValue(file, cell.x);
+        ReadValue(file, cell.z);
+        ReadValue(file, cell.count);
+        ReadValue(file, cell.offset);
+    }
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < cells.size(); i++) {
+        glm::vec2 low = glm::vec2((float) cells[i].x, (float) cells[i].z) * cellSize;
+        areaMin = i == 0 ? low : glm::min(areaMin, low);
+        areaMax = i == 0 ? low + cellSize : glm::max(areaMax, low + cellSize);
+    }
+    return true;
+}
+
+bool SceneFile::ReadCell(unsigned int cell, std::vector<SceneFileEntity> &entities) const {
+    std::ifstream file(path, std::ios::binary);
+    entities.resize(cells[cell].count);
+    file.seekg((std::streamoff) cells[cell].offset);
+    if (!file || !file.read((char *) entities.data(), (std::streamsize) (entities.size() * sizeof(SceneFileEntity)))) {
+        std::cout << "ERROR::SCENE_FILE::CANNOT_READ_CELL " << cells[cell].x << " " << cells[cell].z << std::endl;
+        entities.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "transform.hpp"
+
+// A world on disk, split into square cells on the xz plane so it can be read a cell at a time:
+//   header    "LOGW", version, cell size, model count, cell count
+//   models    the paths of the models, each a length followed by the characters
+//   cells     x and z index, entity count and the byte offset of the cell's entities
+//   entities  model index, render flags and the ten floats of a Transform, cell after cell
+// Numbers are stored in the byte order of the machine that wrote the file
+struct SceneFileEntity {
+    uint32_t model;
+    uint32_t flags;
+    Transform transform;
+};
+
+struct SceneFileCell {
+    int32_t x, z;
+    uint32_t count;
+    uint64_t offset;
+};
+
+// sorts entities into cells by their position and writes them to path
+bool WriteSceneFile(const std::string &path, float cellSize, const std::vector<std::string> &models,
+                    const std::vector<SceneFileEntity> &entities);
+
+// count cubes scattered over a square on the plane that grows with the count, for trying out streaming
+bool WriteExampleWorld(const std::string &path, unsigned int count);
+
+// The header and cell table of a scene file, kept in memory. Cells are read on demand
+class SceneFile {
+public:
+    bool Open(const std::string &path);
+
+    float CellSize() const { return cellSize; }
+    const std::vector<std::string> &Models() const { return models; }
+    const std::vector<SceneFileCell> &Cells() const { return cells; }
+
+    // corners of the area the cells cover on the xz plane
+    glm::vec2 Min() const { return areaMin; }
+    glm::vec2 Max() const { return areaMax; }
+
+    // reads the entities of one cell through a stream of its own, so any number of threads can read at once
+    bool ReadCell(unsigned int cell, std::vector<SceneFileEntity> &entities) const;
+
+private:
+    std::string path;
+    float cellSize = 0.0f;
+    std::vector<std::string> models;
+    std::vector<SceneFileCell> cells;
+    glm::vec2 areaMin = glm::vec2(0.0f), areaMax = glm::vec2(0.0f);
+};
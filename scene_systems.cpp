@@ -0,0 +1,190 @@
+#include <glad/glad.h>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene_systems.hpp"
+#include "camera.hpp"
+#include "cpu_profiler.hpp"
+#include "job_system.hpp"
+
+Entity CreateRenderable(Scene &scene, Model *model, uint32_t flags, const Transform &transform) {
+    Entity entity = scene.Create(COMPONENT_TRANSFORM | COMPONENT_WORLD_MATRIX | COMPONENT_RENDERABLE |
+                                 COMPONENT_BOUNDS | COMPONENT_VISIBILITY);
+    scene.SetTransform(entity, transform);
+    scene.Get<Renderable>(entity) = {model, flags};
+    Bounds &bounds = scene.Get<Bounds>(entity);
+    if (model) {
+        bounds.localCenter = (model->boundsMin + model->boundsMax) * 0.5f;
+        bounds.localExtent = (model->boundsMax - model->boundsMin) * 0.5f;
+    }
+    return entity;
+}
+
+Entity CreateLight(Scene &scene, const Light &light, float amplitude, float phase) {
+    Entity entity = scene.Create(COMPONENT_LIGHT | COMPONENT_LIGHT_MOTION);
+    scene.Get<Light>(entity) = light;
+    scene.Get<LightMotion>(entity) = {light.position.y, amplitude, phase};
+    return entity;
+}
+
+void AnimateLights(Scene &scene, float time, unsigned int threads) {
+    PROFILE_SCOPE("AnimateLights");
+    scene.ForEachChunk(COMPONENT_LIGHT | COMPONENT_LIGHT_MOTION, [time](Scene::Chunk &chunk) {
+        Light *lights = chunk.Components<Light>();
+        const LightMotion *motions = chunk.Components<LightMotion>();
+        for (unsigned int i = 0; i < chunk.count; i++)
+            lights[i].position.y = motions[i].baseHeight + motions[i].amplitude * std::sin(time + motions[i].phase);
+    }, threads);
+}
+
+void UpdateTransforms(Scene &scene, unsigned int threads) {
+    PROFILE_SCOPE("UpdateTransforms");
+    scene.ForEachChunk(COMPONENT_TRANSFORM | COMPONENT_WORLD_MATRIX, [](Scene::Chunk &chunk) {
+        if (chunk.matrixVersion == chunk.transformVersion)
+            return;
+        ComposeTransforms(&chunk.Components<Position>()->value, &chunk.Components<Rotation>()->value,
+                          &chunk.Components<Scale>()->value, chunk.count, chunk.Components<glm::mat4>());
+        chunk.matrixVersion = chunk.transformVersion;
+    }, threads);
+}
+
+void UpdateBounds(Scene &scene, unsigned int threads) {
+    PROFILE_SCOPE("UpdateBounds");
+    scene.ForEachChunk(COMPONENT_WORLD_MATRIX | COMPONENT_BOUNDS, [](Scene::Chunk &chunk) {
+        if (chunk.boundsVersion == chunk.matrixVersion)
+            return;
+        chunk.boundsVersion = chunk.matrixVersion;
+        const glm::mat4 *matrices = chunk.Components<glm::mat4>();
+        Bounds *bounds = chunk.Components<Bounds>();
+        for (unsigned int i = 0; i < chunk.count; i++) {
+            // Arvo: the extent along each world axis is the local extent against the absolute rotation and scale
+            const glm::mat4 &m = matrices[i];
+            Bounds &b = bounds[i];
+            b.center = glm::vec3(m * glm::vec4(b.localCenter, 1.0f));
+            b.extent = glm::abs(glm::vec3(m[0])) * b.localExtent.x + glm::abs(glm::vec3(m[1])) * b.localExtent.y +
+                       glm::abs(glm::vec3(m[2])) * b.localExtent.z;
+        }
+    }, threads);
+}
+
+void CullScene(Scene &scene, const glm::mat4 &viewProjection, unsigned int threads) {
+    PROFILE_SCOPE("CullScene");
+    glm::vec4 planes[6];
+    FrustumPlanes(viewProjection, planes);
+    glm::vec3 absNormals[6];
+    for (int p = 0; p < 6; p++)
+        absNormals[p] = glm::abs(glm::vec3(planes[p]));
+
+    scene.ForEachChunk(COMPONENT_BOUNDS | COMPONENT_VISIBILITY, [&](Scene::Chunk &chunk) {
+        const Bounds *bounds = chunk.Components<Bounds>();
+        Visibility *visibility = chunk.Components<Visibility>();
+        for (unsigned int i = 0; i < chunk.count; i++) {
+            // outside as soon as the box lies wholly behind one plane
+            bool visible = true;
+            for (int p = 0; p < 6; p++) {
+                float distance = glm::dot(glm::vec3(planes[p]), bounds[i].center) + planes[p].w;
+                visible = visible && distance + glm::dot(absNormals[p], bounds[i].extent) >= 0.0f;
+            }
+            visibility[i].visible = visible;
+        }
+    }, threads);
+}
+
+void SubmitScene(Scene &scene, SceneFrame &frame) {
+    PROFILE_SCOPE("SubmitScene");
+    frame.opaque.clear();
+    frame.transparent.clear();
+    frame.casters.clear();
+    frame.lights.clear();
+
+    scene.ForEachChunk(COMPONENT_RENDERABLE | COMPONENT_WORLD_MATRIX | COMPONENT_VISIBILITY, [&](Scene::Chunk &chunk) {
+        const Renderable *renderables = chunk.Components<Renderable>();
+        const glm::mat4 *matrices = chunk.Components<glm::mat4>();
+        const Visibility *visibility = chunk.Components<Visibility>();
+        for (unsigned int i = 0; i < chunk.count; i++) {
+            const Renderable &renderable = renderables[i];
+            if (renderable.flags & RENDER_CASTS_SHADOW)
+                frame.casters.push_back({renderable.model, matrices[i], (renderable.flags & RENDER_STATIC) != 0});
+            if (!visibility[i].visible)
+                continue;
+            if (renderable.flags & RENDER_TRANSPARENT)
+                frame.transparent.push_back({renderable.model, matrices[i]});
+            else
+                frame.opaque.push_back({renderable.model, matrices[i], (renderable.flags & RENDER_ALPHA_TESTED) != 0});
+        }
+    }, 1);
+
+    scene.ForEachChunk(COMPONENT_LIGHT, [&](Scene::Chunk &chunk) {
+        const Light *lights = chunk.Components<Light>();
+        frame.lights.insert(frame.lights.end(), lights, lights + chunk.count);
+    }, 1);
+}
+
+void BenchmarkScene(std::ostream &out, unsigned int maxCount) {
+    const int frames = 20;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 40.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f) * view;
+
+    unsigned int hardware = JobSystem::Instance().Threads();
+    out << "Scene systems, milliseconds per frame (animate lights, transforms, bounds, cull, submit), an eighth of the "
+        << "renderables moving:" << std::endl;
+    for (unsigned int count = std::max(1u, maxCount / 64); ; count = std::min(count * 4, maxCount)) {
+        Scene scene;
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<Entity> moving;
+        for (unsigned int i = 0; i < count; i++) {
+            Transform transform;
+            transform.position = glm::vec3(unit(rng) * 200.0f, unit(rng) * 20.0f, unit(rng) * 200.0f);
+            transform.rotation = glm::angleAxis(unit(rng) * 3.1415927f, glm::vec3(0.0f, 1.0f, 0.0f));
+            transform.scale = glm::vec3(1.0f + unit(rng) * 0.5f);
+            uint32_t flags = i % 8 == 0 ? RENDER_TRANSPARENT : RENDER_CASTS_SHADOW;
+            Entity entity = CreateRenderable(scene, nullptr, flags, transform);
+            scene.Get<Bounds>(entity).localExtent = glm::vec3(0.5f);
+            // the first ones created, so they share chunks and the rest stay untouched
+            if (i < count / 8)
+                moving.push_back(entity);
+        }
+        for (unsigned int i = 0; i < count / 16; i++) {
+            Light light = {glm::vec3(unit(rng) * 200.0f, 0.0f, unit(rng) * 200.0f), 5.0f, glm::vec3(1.0f), 1.0f,
+                           glm::vec3(0.0f, -1.0f, 0.0f), -1.0f};
+            CreateLight(scene, light, 1.0f, unit(rng) * 3.1415927f);
+        }
+
+        SceneFrame frame;
+        for (unsigned int threads : {1u, hardware}) {
+            double milliseconds[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+            auto time = [&](int system, auto run) {
+                auto start = std::chrono::steady_clock::now();
+                run();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                milliseconds[system] += elapsed.count() / frames;
+            };
+            for (int f = 0; f < frames; f++) {
+                for (Entity entity : moving)
+                    scene.SetRotation(entity, glm::angleAxis((float) f * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)));
+                time(0, [&]() { AnimateLights(scene, (float) f / 60.0f, threads); });
+                time(1, [&]() { UpdateTransforms(scene, threads); });
+                time(2, [&]() { UpdateBounds(scene, threads); });
+                time(3, [&]() { CullScene(scene, viewProjection, threads); });
+                time(4, [&]() { SubmitScene(scene, frame); });
+            }
+
+            double total = 0.0;
+            out << "  " << count << " renderables, " << threads << " thread" << (threads > 1 ? "s" : "") << ":";
+            for (double value : milliseconds) {
+                out << " " << value;
+                total += value;
+            }
+            out << ", total " << total << " ms, " << total * 1e6 / count << " ns per renderable, "
+                << frame.opaque.size() + frame.transparent.size() << " visible" << std::endl;
+            if (threads == hardware)
+                break;
+        }
+
+        if (count == maxCount)
+            break;
+    }
+}
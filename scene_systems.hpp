@@ -0,0 +1,46 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "depth_prepass.hpp"
+#include "scene.hpp"
+#include "shadows.hpp"
+#include "transparency.hpp"
+
+// The systems that run over the scene every frame, in the order declared. Each one walks the chunks having the
+// components it needs and touches only those arrays. With threads 0 large scenes are split into jobs
+
+// a drawable entity with its local bounds taken from model
+Entity CreateRenderable(Scene &scene, Model *model, uint32_t flags, const Transform &transform);
+
+// a light bobbing around its position with the given amplitude and phase
+Entity CreateLight(Scene &scene, const Light &light, float amplitude, float phase);
+
+// moves the lights with a LightMotion
+void AnimateLights(Scene &scene, float time, unsigned int threads = 0);
+
+// world matrices from the transforms, four at a time with ComposeTransforms, in the chunks whose transforms changed
+void UpdateTransforms(Scene &scene, unsigned int threads = 0);
+
+// world space bounds from the local ones and the world matrices, in the chunks UpdateTransforms changed
+void UpdateBounds(Scene &scene, unsigned int threads = 0);
+
+// visibility of everything with bounds against the frustum of viewProjection
+void CullScene(Scene &scene, const glm::mat4 &viewProjection, unsigned int threads = 0);
+
+// what a frame draws, collected by SubmitScene
+struct SceneFrame {
+    std::vector<OpaqueDraw> opaque;
+    std::vector<TransparentDraw> transparent;
+    // every caster, visible or not, the cascades reach past the view
+    std::vector<ShadowCaster> casters;
+    std::vector<Light> lights;
+};
+
+// the visible renderables, the shadow casters and the lights. Runs on the calling thread, it only appends
+void SubmitScene(Scene &scene, SceneFrame &frame);
+
+// Runs the systems over scenes of growing size up to maxCount renderables, plus a light per sixteen of them, on one
+// and on every thread, and prints the milliseconds each system takes per frame
+void BenchmarkScene(std::ostream &out, unsigned int maxCount);
@@ -0,0 +1,17 @@
+#pragma once
+
+// A quad covering the whole viewport, laid out like the post processing vertex shader expects: vec2 position at
+// location 0 and vec2 texture coordinates at location 1
+class ScreenQuad {
+public:
+    ScreenQuad();
+    ~ScreenQuad();
+
+    ScreenQuad(const ScreenQuad &) = delete;
+    ScreenQuad &operator=(const ScreenQuad &) = delete;
+
+    void Draw() const;
+
+private:
+    unsigned int VAO, VBO;
+};
@@ -4,73 +4,88 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.hpp"
+#include "cpu_profiler.hpp"
 
-Shader::Shader(const std::string &vertexPath, const std::string &fragmentPath) {
-    std::string vertexSource, fragmentSource;
-    std::ifstream vertexFS, fragmentFS;
-
-    vertexFS.exceptions(std::fstream::failbit | std::fstream::badbit);
-    fragmentFS.exceptions(std::fstream::failbit | std::fstream::badbit);
+std::string readSource(const std::string &path) {
+    std::ifstream file;
+    file.exceptions(std::fstream::failbit | std::fstream::badbit);
 
     try {
-        vertexFS.open(vertexPath);
-        fragmentFS.open(fragmentPath);
-
-        std::stringstream vertexSS, fragmentSS;
-        vertexSS << vertexFS.rdbuf();
-        fragmentSS << fragmentFS.rdbuf();
-
-        vertexFS.close();
-        fragmentFS.close();
-
-        vertexSource = vertexSS.str();
-        fragmentSource = fragmentSS.str();
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
     } catch (const std::ifstream::failure &e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return std::string();
     }
+}
+
+unsigned int compileStage(GLenum type, const std::string &path, const char *stage) {
+    std::string source = readSource(path);
+    const char *sourcePtr = source.c_str();
 
-    const char *vertexSourcePtr = vertexSource.c_str();
-    const char *fragmentSourcePtr = fragmentSource.c_str();
+    unsigned int id = glCreateShader(type);
+    glShaderSource(id, 1, &sourcePtr, NULL);
+    glCompileShader(id);
 
-    unsigned int vertexID, fragmentID;
     int success;
     char infoLog[512];
-
-    vertexID = glCreateShader(GL_VERTEX_SHADER);
-    fragmentID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    glShaderSource(vertexID, 1, &vertexSourcePtr, NULL);
-    glShaderSource(fragmentID, 1, &fragmentSourcePtr, NULL);
-
-    glCompileShader(vertexID);
-    glGetShaderiv(vertexID, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(id, GL_COMPILE_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(vertexID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glGetShaderInfoLog(id, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << infoLog << std::endl;
     }
+    return id;
+}
 
-    glCompileShader(fragmentID);
-    glGetShaderiv(fragmentID, GL_COMPILE_STATUS, &success);
+void linkProgram(unsigned int program) {
+    int success;
+    char infoLog[512];
+
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(fragmentID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+}
+
+Shader::Shader(const std::string &vertexPath, const std::string &fragmentPath) {
+    PROFILE_SCOPE("Shader::Shader");
+    unsigned int vertexID = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX");
+    unsigned int fragmentID = compileStage(GL_FRAGMENT_SHADER, fragmentPath, "FRAGMENT");
 
     ID = glCreateProgram();
     glAttachShader(ID, vertexID);
     glAttachShader(ID, fragmentID);
-
-    glLinkProgram(ID);
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
+    linkProgram(ID);
 
     glDeleteShader(vertexID);
     glDeleteShader(fragmentID);
 }
 
+Shader::Shader(const std::string &vertexPath, const std::string &geometryPath,
+               const std::vector<std::string> &feedbackVaryings) {
+    PROFILE_SCOPE("Shader::Shader");
+    unsigned int vertexID = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX");
+    unsigned int geometryID = compileStage(GL_GEOMETRY_SHADER, geometryPath, "GEOMETRY");
+
+    ID = glCreateProgram();
+    glAttachShader(ID, vertexID);
+    glAttachShader(ID, geometryID);
+
+    // the captured outputs have to be named before linking
+    std::vector<const char *> names;
+    for (const std::string &varying : feedbackVaryings)
+        names.push_back(varying.c_str());
+    glTransformFeedbackVaryings(ID, (GLsizei) names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+    linkProgram(ID);
+
+    glDeleteShader(vertexID);
+    glDeleteShader(geometryID);
+}
+
 Shader::~Shader() {
     glDeleteProgram(ID);
 }
@@ -91,10 +106,26 @@ void Shader::setFloat(const std::string &name, float value) const {
     glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 }
 
+void Shader::setMat3(const std::string &name, glm::mat3 value) const {
+    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+}
+
 void Shader::setMat4(const std::string &name, glm::mat4 value) const {
     glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
 }
 
+void Shader::setVec2(const std::string &name, glm::vec2 value) const {
+    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+}
+
 void Shader::setVec3(const std::string &name, glm::vec3 value) const {
     glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
 }
+
+void Shader::setVec4(const std::string &name, glm::vec4 value) const {
+    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+}
+
+void Shader::setIVec3(const std::string &name, glm::ivec3 value) const {
+    glUniform3iv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Shader {
@@ -7,6 +9,11 @@ public:
     unsigned int ID;
 
     Shader(const std::string &vertexPath, const std::string &fragmentPath);
+
+    // a transform feedback program: no fragment stage, the named outputs of the geometry shader are written
+    // interleaved into the bound feedback buffer
+    Shader(const std::string &vertexPath, const std::string &geometryPath,
+           const std::vector<std::string> &feedbackVaryings);
     ~Shader();
 
     void use() const;
@@ -14,6 +21,10 @@ public:
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
+    void setMat3(const std::string &name, glm::mat3 value) const;
     void setMat4(const std::string &name, glm::mat4 value) const;
+    void setVec2(const std::string &name, glm::vec2 value) const;
     void setVec3(const std::string &name, glm::vec3 value) const;
+    void setVec4(const std::string &name, glm::vec4 value) const;
+    void setIVec3(const std::string &name, glm::ivec3 value) const;
 };
@@ -0,0 +1,30 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+uniform sampler2D sampler;
+uniform vec2 texelSize;
+
+// Linear sampled kernel, see LinearSampledGaussian. Tap 0 is the center, every other tap is mirrored around it and
+// lands between two texels so that one bilinear fetch reads both
+#define MAX_TAPS 8
+uniform int   kernelTaps;
+uniform float kernelOffsets[MAX_TAPS];
+uniform float kernelWeights[MAX_TAPS];
+
+// (1, 0) for the horizontal half, (0, 1) for the vertical one
+uniform vec2 direction;
+
+void main() {
+    vec2 axisStep = direction * texelSize;
+
+    vec3 color = texture(sampler, TexCoords).rgb * kernelWeights[0];
+    for (int i = 1; i < kernelTaps; i++) {
+        vec2 offset = axisStep * kernelOffsets[i];
+        color += texture(sampler, TexCoords + offset).rgb * kernelWeights[i];
+        color += texture(sampler, TexCoords - offset).rgb * kernelWeights[i];
+    }
+
+    FragColor = vec4(color, 1.0);
+}
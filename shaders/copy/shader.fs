@@ -0,0 +1,10 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+uniform sampler2D sampler;
+
+void main() {
+    FragColor = vec4(texture(sampler, TexCoords).rgb, 1.0);
+}
@@ -0,0 +1,207 @@
+#version 330 core
+
+// G-buffer, see GBuffer
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+uniform float shininess;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+uniform DirLight dirLight;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, float specularIntensity, float shadow);
+
+// Cascaded shadow map for the directional light, see CascadedShadowMap
+#define MAX_CASCADES 4
+uniform sampler2DArrayShadow shadowMap;
+uniform int   cascadeCount;
+uniform float cascadeSplits[MAX_CASCADES];
+uniform float cascadeTexelSizes[MAX_CASCADES];
+uniform mat4  lightSpaceMatrices[MAX_CASCADES];
+
+float CalcShadow(vec3 fragPos, vec3 normal, float viewDepth);
+
+// Clustered lights, see ClusterGrid. Three texels per light: (position, radius), (color, cosInner), (direction, cosOuter)
+uniform samplerBuffer lightData;
+// (offset, count) into clusterIndices for every cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+
+uniform ivec3 clusterDims;
+uniform vec2  clusterTileSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+vec3 CalcLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, float specularIntensity);
+
+// Image based lighting, see EnvironmentLighting. Irradiance as nine SH coefficients with the cosine lobe and basis
+// constants folded in, radiance prefiltered for GGX roughness along the mips, and the split sum scale and bias of F0
+uniform vec3 irradianceSH[9];
+uniform samplerCube prefilteredEnvironment;
+uniform float prefilteredLevels;
+uniform sampler2D brdfLUT;
+
+vec3 CalcEnvironment(vec3 normal, vec3 viewDir, vec3 albedo, vec3 f0, float shininess);
+
+uniform vec3 viewPos;
+
+in vec2 TexCoords;
+
+// the part of the G-buffer the geometry pass drew into, it stays at full size while the render scale changes
+uniform vec2 gBufferScale;
+
+out vec4 FragColor;
+
+vec3 DecodeNormal(vec2 f) {
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main() {
+    vec2 gBufferCoords = TexCoords * gBufferScale;
+    float depth = texture(gDepth, gBufferCoords).r;
+    // nothing was drawn here, leave the clear color
+    if (depth == 1.0) {
+        discard;
+    }
+    // keep the depth so that forward passes drawn afterwards are occluded correctly
+    gl_FragDepth = depth;
+
+    // back from window space to view space, then to world space where the lights live
+    vec4 viewSpace = inverseProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    viewSpace /= viewSpace.w;
+    vec3 fragPos = vec3(inverseView * viewSpace);
+
+    vec4 albedoSpec = texture(gAlbedoSpec, gBufferCoords);
+    vec3 norm       = DecodeNormal(texture(gNormal, gBufferCoords).xy);
+    vec3 viewDir    = normalize(viewPos - fragPos);
+
+    vec3 result = vec3(0.0);
+
+    float shadow = CalcShadow(fragPos, norm, -viewSpace.z);
+    result += CalcDirLight(dirLight, norm, viewDir, albedoSpec.rgb, albedoSpec.a, shadow);
+
+    // find the cluster this fragment falls in and only go through the lights binned into it
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusterTileSize);
+    int slice = int(max(log(-viewSpace.z) * clusterSliceScale + clusterSliceBias, 0.0));
+    ivec3 cluster = min(ivec3(tile, slice), clusterDims - 1);
+    int clusterIndex = (cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x;
+
+    uvec2 range = texelFetch(clusterGrid, clusterIndex).xy;
+    for (uint i = 0u; i < range.y; i++) {
+        int lightIndex = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        result += CalcLight(lightIndex, norm, fragPos, viewDir, albedoSpec.rgb, albedoSpec.a);
+    }
+
+    FragColor = vec4(result, 1.0);
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, float specularIntensity, float shadow) {
+    // Goes outwards
+    vec3 lightDir = normalize(-light.direction);
+
+    // Diffuse
+    float diff = max(dot(normal, lightDir), 0);
+
+    // Specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(reflectDir, viewDir), 0), shininess);
+
+    vec3 diffuse = diff * light.diffuse * albedo;
+    vec3 specular = spec * light.specular * vec3(specularIntensity);
+    vec3 ambient = light.ambient * CalcEnvironment(normal, viewDir, albedo, vec3(max(specularIntensity, 0.04)),
+                                                   shininess);
+
+    return (diffuse + specular) * shadow + ambient;
+}
+
+float CalcShadow(vec3 fragPos, vec3 normal, float viewDepth) {
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth >= cascadeSplits[cascade]) {
+        cascade++;
+    }
+    // past the shadow distance
+    if (cascade == cascadeCount) {
+        return 1.0;
+    }
+
+    // push the lookup out along the normal by about a texel to avoid acne on surfaces facing away from the light
+    vec3 offsetPos = fragPos + normal * cascadeTexelSizes[cascade] * 1.5;
+    vec3 coords = vec3(lightSpaceMatrices[cascade] * vec4(offsetPos, 1.0)) * 0.5 + 0.5;
+    coords.z = min(coords.z, 1.0);
+
+    // four hardware filtered taps, 3x3 texels of PCF in total
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, -0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2( 0.5, -0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5,  0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2( 0.5,  0.5) * texel, cascade, coords.z));
+    return lit * 0.25;
+}
+
+vec3 CalcLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, float specularIntensity) {
+    vec4 positionRadius = texelFetch(lightData, index * 3);
+    vec4 colorInner     = texelFetch(lightData, index * 3 + 1);
+    vec4 directionOuter = texelFetch(lightData, index * 3 + 2);
+
+    vec3 toLight = positionRadius.xyz - fragPos;
+    float dist = length(toLight);
+    if (dist > positionRadius.w) {
+        return vec3(0.0);
+    }
+
+    // Goes outwards
+    vec3 lightDir = toLight / dist;
+
+    // Diffuse
+    float diff = max(dot(normal, lightDir), 0);
+
+    // Specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(reflectDir, viewDir), 0), shininess);
+
+    // Attenuation, windowed so that it reaches zero exactly at the radius the light was binned with
+    float falloff = clamp(1.0 - pow(dist / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = falloff * falloff / (dist * dist + 1.0);
+
+    // Spot cone, point lights have cosOuter = -1 which always passes
+    float theta = dot(normalize(-directionOuter.xyz), lightDir);
+    float epsilon = max(colorInner.w - directionOuter.w, 0.0001);
+    float strength = directionOuter.w <= -1.0 ? 1.0 : clamp((theta - directionOuter.w) / epsilon, 0.0, 1.0);
+
+    vec3 diffuse = diff * colorInner.rgb * albedo;
+    vec3 specular = spec * colorInner.rgb * vec3(specularIntensity);
+
+    return (diffuse + specular) * attenuation * strength;
+}
+
+vec3 CalcEnvironment(vec3 normal, vec3 viewDir, vec3 albedo, vec3 f0, float shininess) {
+    vec3 n = normal;
+    vec3 irradiance = irradianceSH[0]
+                    + irradianceSH[1] * n.y + irradianceSH[2] * n.z + irradianceSH[3] * n.x
+                    + irradianceSH[4] * (n.x * n.y) + irradianceSH[5] * (n.y * n.z)
+                    + irradianceSH[6] * (3.0 * n.z * n.z - 1.0) + irradianceSH[7] * (n.x * n.z)
+                    + irradianceSH[8] * (n.x * n.x - n.y * n.y);
+
+    // the GGX roughness matching a Blinn-Phong exponent
+    float roughness = sqrt(sqrt(2.0 / (shininess + 2.0)));
+    float NdotV = max(dot(normal, viewDir), 0.0);
+    vec3 radiance = textureLod(prefilteredEnvironment, reflect(-viewDir, normal), roughness * prefilteredLevels).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+
+    return albedo * max(irradiance, 0.0) + radiance * (f0 * brdf.x + brdf.y);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec3 Normal;
+
+out vec4 FragColor;
+
+void main() {
+    float diffuse = max(dot(normalize(Normal), normalize(vec3(0.3, 1.0, 0.5))), 0.0);
+    FragColor = vec4(vec3(0.1 + 0.9 * diffuse), 1.0);
+}
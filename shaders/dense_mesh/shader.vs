@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// inverse transpose of the upper 3x3 of model, computed once per object on the CPU
+uniform mat3 normalMatrix;
+
+out vec3 Normal;
+
+void main() {
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Normal = normalMatrix * aNormal;
+}
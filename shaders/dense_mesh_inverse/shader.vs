@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 Normal;
+
+// the normal matrix the way every shader used to get it, inverted again for each vertex
+void main() {
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Normal = transpose(inverse(mat3(model))) * aNormal;
+}
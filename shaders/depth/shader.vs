@@ -6,6 +6,8 @@ layout (location = 2) in vec2 aTexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// inverse transpose of the upper 3x3 of model, computed once per object on the CPU
+uniform mat3 normalMatrix;
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -15,6 +17,6 @@ void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 
     FragPos   = vec3(model * vec4(aPos, 1.0));
-    Normal    = transpose(inverse(mat3(model))) * aNormal;
+    Normal    = normalMatrix * aNormal;
     TexCoords = aTexCoords;
 }
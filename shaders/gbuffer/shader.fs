@@ -0,0 +1,31 @@
+#version 330 core
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+};
+uniform Material material;
+
+in vec2 TexCoords;
+in vec3 Normal;
+
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec2 gNormal;
+
+vec2 OctWrap(vec2 v) {
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Projects the unit normal onto an octahedron and unfolds it onto a square, two channels instead of three
+vec2 EncodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    // the target is unsigned normalized
+    return n.xy * 0.5 + 0.5;
+}
+
+void main() {
+    gAlbedoSpec.rgb = texture(material.texture_diffuse1, TexCoords).rgb;
+    gAlbedoSpec.a   = texture(material.texture_specular1, TexCoords).r;
+    gNormal         = EncodeNormal(normalize(Normal));
+}
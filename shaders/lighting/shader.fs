@@ -17,48 +17,46 @@ struct DirLight {
 };
 uniform DirLight dirLight;
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow);
 
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-
-    float cutOff;
-    float outerCutOff;
+// Cascaded shadow map for the directional light, see CascadedShadowMap
+#define MAX_CASCADES 4
+uniform sampler2DArrayShadow shadowMap;
+uniform int   cascadeCount;
+uniform float cascadeSplits[MAX_CASCADES];
+uniform float cascadeTexelSizes[MAX_CASCADES];
+uniform mat4  lightSpaceMatrices[MAX_CASCADES];
 
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform SpotLight spotLight;
+float CalcShadow(vec3 fragPos, vec3 normal, float viewDepth);
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+// Clustered lights, see ClusterGrid. Three texels per light: (position, radius), (color, cosInner), (direction, cosOuter)
+uniform samplerBuffer lightData;
+// (offset, count) into clusterIndices for every cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
 
-struct PointLight {
-    vec3 position;
+uniform ivec3 clusterDims;
+uniform vec2  clusterTileSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
 
-    float constant;
-    float linear;
-    float quadratic;
+vec3 CalcLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir);
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-#define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+// Image based lighting, see EnvironmentLighting. Irradiance as nine SH coefficients with the cosine lobe and basis
+// constants folded in, radiance prefiltered for GGX roughness along the mips, and the split sum scale and bias of F0
+uniform vec3 irradianceSH[9];
+uniform samplerCube prefilteredEnvironment;
+uniform float prefilteredLevels;
+uniform sampler2D brdfLUT;
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcEnvironment(vec3 normal, vec3 viewDir, vec3 albedo, vec3 f0, float shininess);
 
 uniform vec3 viewPos;
 
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
+in float ViewDepth;
 
 out vec4 FragColor;
 
@@ -68,16 +66,25 @@ void main() {
 
     vec3 result = vec3(0.0);
 
-    result += CalcDirLight(dirLight, norm, viewDir);
-    // result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+    float shadow = CalcShadow(FragPos, norm, ViewDepth);
+    result += CalcDirLight(dirLight, norm, viewDir, shadow);
+
+    // find the cluster this fragment falls in and only go through the lights binned into it
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusterTileSize);
+    int slice = int(max(log(ViewDepth) * clusterSliceScale + clusterSliceBias, 0.0));
+    ivec3 cluster = min(ivec3(tile, slice), clusterDims - 1);
+    int clusterIndex = (cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x;
 
-    // for(int i=0;i<NR_POINT_LIGHTS;i++)
-    //     result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    uvec2 range = texelFetch(clusterGrid, clusterIndex).xy;
+    for (uint i = 0u; i < range.y; i++) {
+        int lightIndex = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        result += CalcLight(lightIndex, norm, FragPos, viewDir);
+    }
 
     FragColor = vec4(result, 1.0);
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir) {
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow) {
     // Goes outwards
     vec3 lightDir = normalize(-light.direction);
 
@@ -90,47 +97,52 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir) {
 
     vec3 diffuse = diff * light.diffuse * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = spec * light.specular * vec3(texture(material.texture_specular1, TexCoords));
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    // the specular map as reflectance, never below that of a dielectric
+    vec3 f0 = max(vec3(texture(material.texture_specular1, TexCoords)), vec3(0.04));
+    vec3 ambient = light.ambient * CalcEnvironment(normal, viewDir, vec3(texture(material.texture_diffuse1, TexCoords)),
+                                                   f0, material.shininess);
 
-    return diffuse + specular + ambient;
+    return (diffuse + specular) * shadow + ambient;
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
-    // Goes outwards
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    // Diffuse
-    float diff = max(dot(normal, lightDir), 0);
-
-    // Specular
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(reflectDir, viewDir), 0), material.shininess);
-
-    vec3 diffuse = diff * light.diffuse * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = spec * light.specular * vec3(texture(material.texture_specular1, TexCoords));
-    vec3 ambient = light.ambient;
-
-    float theta = dot(normalize(-light.direction), lightDir);
-    float epsilon = light.cutOff - light.outerCutOff;
-    float strength = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-
-    float dist = length(light.position - fragPos);
-    float attenuation = 1 / (light.constant + light.linear * dist + light.quadratic * (dist * dist));
-
-    diffuse *= strength;
-    specular *= strength;
-    ambient *= strength;
+float CalcShadow(vec3 fragPos, vec3 normal, float viewDepth) {
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth >= cascadeSplits[cascade]) {
+        cascade++;
+    }
+    // past the shadow distance
+    if (cascade == cascadeCount) {
+        return 1.0;
+    }
+
+    // push the lookup out along the normal by about a texel to avoid acne on surfaces facing away from the light
+    vec3 offsetPos = fragPos + normal * cascadeTexelSizes[cascade] * 1.5;
+    vec3 coords = vec3(lightSpaceMatrices[cascade] * vec4(offsetPos, 1.0)) * 0.5 + 0.5;
+    coords.z = min(coords.z, 1.0);
+
+    // four hardware filtered taps, 3x3 texels of PCF in total
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5, -0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2( 0.5, -0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2(-0.5,  0.5) * texel, cascade, coords.z));
+    lit += texture(shadowMap, vec4(coords.xy + vec2( 0.5,  0.5) * texel, cascade, coords.z));
+    return lit * 0.25;
+}
 
-    diffuse *= attenuation;
-    specular *= attenuation;
-    ambient *= attenuation;
+vec3 CalcLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir) {
+    vec4 positionRadius = texelFetch(lightData, index * 3);
+    vec4 colorInner     = texelFetch(lightData, index * 3 + 1);
+    vec4 directionOuter = texelFetch(lightData, index * 3 + 2);
 
-    return diffuse + specular + ambient;
-}
+    vec3 toLight = positionRadius.xyz - fragPos;
+    float dist = length(toLight);
+    if (dist > positionRadius.w) {
+        return vec3(0.0);
+    }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     // Goes outwards
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = toLight / dist;
 
     // Diffuse
     float diff = max(dot(normal, lightDir), 0);
@@ -139,17 +151,34 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(reflectDir, viewDir), 0), material.shininess);
 
-    // Attenuation
-    float dist = length(light.position - fragPos);
-    float attenuation = 1 / (light.constant + light.linear * dist + light.quadratic * (dist * dist));
+    // Attenuation, windowed so that it reaches zero exactly at the radius the light was binned with
+    float falloff = clamp(1.0 - pow(dist / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = falloff * falloff / (dist * dist + 1.0);
 
-    vec3 diffuse = diff * light.diffuse * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = spec * light.specular * vec3(texture(material.texture_specular1, TexCoords));
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    // Spot cone, point lights have cosOuter = -1 which always passes
+    float theta = dot(normalize(-directionOuter.xyz), lightDir);
+    float epsilon = max(colorInner.w - directionOuter.w, 0.0001);
+    float strength = directionOuter.w <= -1.0 ? 1.0 : clamp((theta - directionOuter.w) / epsilon, 0.0, 1.0);
 
-    diffuse *= attenuation;
-    specular *= attenuation;
-    ambient *= attenuation;
+    vec3 diffuse = diff * colorInner.rgb * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 specular = spec * colorInner.rgb * vec3(texture(material.texture_specular1, TexCoords));
+
+    return (diffuse + specular) * attenuation * strength;
+}
 
-    return diffuse + specular + ambient;
+vec3 CalcEnvironment(vec3 normal, vec3 viewDir, vec3 albedo, vec3 f0, float shininess) {
+    vec3 n = normal;
+    vec3 irradiance = irradianceSH[0]
+                    + irradianceSH[1] * n.y + irradianceSH[2] * n.z + irradianceSH[3] * n.x
+                    + irradianceSH[4] * (n.x * n.y) + irradianceSH[5] * (n.y * n.z)
+                    + irradianceSH[6] * (3.0 * n.z * n.z - 1.0) + irradianceSH[7] * (n.x * n.z)
+                    + irradianceSH[8] * (n.x * n.x - n.y * n.y);
+
+    // the GGX roughness matching a Blinn-Phong exponent
+    float roughness = sqrt(sqrt(2.0 / (shininess + 2.0)));
+    float NdotV = max(dot(normal, viewDir), 0.0);
+    vec3 radiance = textureLod(prefilteredEnvironment, reflect(-viewDir, normal), roughness * prefilteredLevels).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+
+    return albedo * max(irradiance, 0.0) + radiance * (f0 * brdf.x + brdf.y);
 }
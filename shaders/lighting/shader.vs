@@ -2,19 +2,48 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 4) in uvec4 aBoneIds;
+layout (location = 5) in vec4 aBoneWeights;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// inverse transpose of the upper 3x3 of model, computed once per object on the CPU
+uniform mat3 normalMatrix;
+// skinned meshes blend up to four bone matrices, fetched from a buffer texture holding the palettes of every
+// character, four texels a matrix. firstBone is where the palette of the one being drawn starts
+uniform bool skinned;
+uniform samplerBuffer bones;
+uniform int firstBone;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out float ViewDepth;
+
+// the depth pre-pass computes the same position, shading tests against it with GL_EQUAL
+invariant gl_Position;
+
+mat4 Bone(uint bone) {
+    int texel = (firstBone + int(bone)) * 4;
+    return mat4(texelFetch(bones, texel), texelFetch(bones, texel + 1), texelFetch(bones, texel + 2),
+                texelFetch(bones, texel + 3));
+}
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 position = vec4(aPos, 1.0);
+    vec3 normal = aNormal;
+    if (skinned) {
+        mat4 skin = Bone(aBoneIds.x) * aBoneWeights.x + Bone(aBoneIds.y) * aBoneWeights.y +
+                    Bone(aBoneIds.z) * aBoneWeights.z + Bone(aBoneIds.w) * aBoneWeights.w;
+        position = skin * position;
+        normal = mat3(skin) * normal;
+    }
+
+    gl_Position = projection * view * model * position;
 
-    FragPos   = vec3(model * vec4(aPos, 1.0));
-    Normal    = transpose(inverse(mat3(model))) * aNormal;
+    FragPos   = vec3(model * position);
+    Normal    = normalMatrix * normal;
     TexCoords = aTexCoords;
+    ViewDepth = -(view * model * position).z;
 }
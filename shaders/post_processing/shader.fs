@@ -4,20 +4,19 @@ in vec2 TexCoords;
 out vec4 FragColor;
 
 uniform sampler2D sampler;
-
-const float offset = 1.0 / 300.0;
+uniform vec2 texelSize;
 
 void main() {
     vec2 offsets[9] = vec2[](
-        vec2(-offset,  offset), // top-left
-        vec2( 0.0f,    offset), // top-center
-        vec2( offset,  offset), // top-right
-        vec2(-offset,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( offset,  0.0f),   // center-right
-        vec2(-offset, -offset), // bottom-left
-        vec2( 0.0f,   -offset), // bottom-center
-        vec2( offset, -offset)  // bottom-right
+        vec2(-texelSize.x,  texelSize.y), // top-left
+        vec2( 0.0f,         texelSize.y), // top-center
+        vec2( texelSize.x,  texelSize.y), // top-right
+        vec2(-texelSize.x,  0.0f),        // center-left
+        vec2( 0.0f,         0.0f),        // center-center
+        vec2( texelSize.x,  0.0f),        // center-right
+        vec2(-texelSize.x, -texelSize.y), // bottom-left
+        vec2( 0.0f,        -texelSize.y), // bottom-center
+        vec2( texelSize.x, -texelSize.y)  // bottom-right
     );
 
     float kernel[9] = float[](
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// shading tests against this depth with GL_EQUAL, both have to compute it bit for bit the same
+invariant gl_Position;
+
+void main() {
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
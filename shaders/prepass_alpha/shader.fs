@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+uniform Material material;
+
+void main() {
+    if (texture(material.texture_diffuse1, TexCoords).a < 0.1) {
+        discard;
+    }
+}
@@ -0,0 +1,25 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+uniform sampler2D sampler;
+// size of one texel of the low resolution source
+uniform vec2 texelSize;
+// 0 is a plain bilinear upscale
+uniform float sharpness;
+
+void main() {
+    vec3 center = texture(sampler, TexCoords).rgb;
+    vec3 north = texture(sampler, TexCoords + vec2(0.0, texelSize.y)).rgb;
+    vec3 south = texture(sampler, TexCoords - vec2(0.0, texelSize.y)).rgb;
+    vec3 east = texture(sampler, TexCoords + vec2(texelSize.x, 0.0)).rgb;
+    vec3 west = texture(sampler, TexCoords - vec2(texelSize.x, 0.0)).rgb;
+
+    // unsharp mask against the cross, clamped to the neighborhood so edges don't ring
+    vec3 sharpened = center + sharpness * (4.0 * center - north - south - east - west);
+    vec3 lower = min(center, min(min(north, south), min(east, west)));
+    vec3 upper = max(center, max(max(north, south), max(east, west)));
+
+    FragColor = vec4(clamp(sharpened, lower, upper), 1.0);
+}
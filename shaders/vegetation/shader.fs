@@ -0,0 +1,25 @@
+#version 330 core
+
+in vec3 Normal;
+in vec2 TexCoords;
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+uniform Material material;
+
+uniform vec3 sunDirection;
+
+out vec4 FragColor;
+
+void main() {
+    vec4 color = texture(material.texture_diffuse1, TexCoords);
+
+    // alpha sharpened to a ramp about a pixel wide, so alpha to coverage turns it into an antialiased edge rather
+    // than a blurry dithered one
+    float alpha = (color.a - 0.5) / max(fwidth(color.a), 1e-4) + 0.5;
+
+    // the cards are lit from either side
+    float diffuse = abs(dot(normalize(Normal), normalize(-sunDirection)));
+    FragColor = vec4(color.rgb * (0.35 + 0.65 * diffuse), clamp(alpha, 0.0, 1.0));
+}
@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// position of the clump's base in xyz, scale in w
+layout (location = 3) in vec4 aInstance;
+
+uniform mat4 view;
+uniform mat4 projection;
+// added to every clump's own random rotation, the crossed copy of near clumps is drawn a quarter turn off
+uniform float yawOffset;
+// lowest point of the model, which stays put while the rest sways
+uniform float baseHeight;
+uniform float time;
+
+out vec3 Normal;
+out vec2 TexCoords;
+
+float hash(vec2 p) {
+    return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+void main() {
+    float yaw = hash(aInstance.xz + vec2(17.0, 31.0)) * 6.2831853 + yawOffset;
+    mat3 rotation = mat3(cos(yaw), 0.0, -sin(yaw),
+                         0.0,      1.0, 0.0,
+                         sin(yaw), 0.0, cos(yaw));
+
+    vec3 position = rotation * (aPos - vec3(0.0, baseHeight, 0.0)) * aInstance.w;
+    position.xz += sin(time * 1.7 + aInstance.x * 0.6 + aInstance.z * 0.4) * 0.15 * position.y;
+
+    gl_Position = projection * view * vec4(aInstance.xyz + position, 1.0);
+    Normal = rotation * aNormal;
+    TexCoords = aTexCoords;
+}
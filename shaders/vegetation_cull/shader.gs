@@ -0,0 +1,53 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+// position of the clump's base in xyz, scale in w
+in vec4 Instance[];
+
+// captured by transform feedback
+out vec4 Culled;
+
+// world space frustum planes, normals pointing inwards
+uniform vec4 planes[6];
+uniform vec3 eye;
+// bounding sphere of the model at scale 1, relative to the base
+uniform vec3 center;
+uniform float radius;
+// distance range of the level of detail being culled for
+uniform float nearDistance;
+uniform float farDistance;
+// far clumps thin out from lodDistance, where all are kept, to a quarter at maxDistance
+uniform float lodDistance;
+uniform float maxDistance;
+
+float hash(vec2 p) {
+    return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+void main() {
+    vec4 instance = Instance[0];
+    vec3 sphere = instance.xyz + center * instance.w;
+    float sphereRadius = radius * instance.w;
+
+    float distance = length(sphere - eye);
+    if (distance < nearDistance || distance >= farDistance) {
+        return;
+    }
+
+    for (int i = 0; i < 6; i++) {
+        if (dot(planes[i].xyz, sphere) + planes[i].w < -sphereRadius) {
+            return;
+        }
+    }
+
+    // the same clumps always survive, so thinning doesn't shimmer as the camera moves
+    float keep = 1.0 - 0.75 * clamp((distance - lodDistance) / (maxDistance - lodDistance), 0.0, 1.0);
+    if (hash(instance.xz) > keep) {
+        return;
+    }
+
+    Culled = instance;
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,8 @@
+#version 330 core
+layout (location = 0) in vec4 aInstance;
+
+out vec4 Instance;
+
+void main() {
+    Instance = aInstance;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 TexCoords;
+in float ViewDepth;
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+uniform Material material;
+
+// rgb: premultiplied color times weight, a: alpha for the revealage product
+layout (location = 0) out vec4 Accumulation;
+// alpha times weight
+layout (location = 1) out float Weight;
+
+void main() {
+    vec4 color = texture(material.texture_diffuse1, TexCoords);
+    if (color.a < 0.01) {
+        discard;
+    }
+
+    // depth weight from McGuire and Bavoil (equation 7), near surfaces dominate the average. Clamped so the sums of
+    // a few hundred layers still fit in half floats
+    float weight = clamp(10.0 / (1e-5 + pow(ViewDepth / 5.0, 2.0) + pow(ViewDepth / 200.0, 6.0)), 1e-2, 3e3);
+    weight *= color.a;
+
+    Accumulation = vec4(color.rgb * weight, color.a);
+    Weight = weight;
+}
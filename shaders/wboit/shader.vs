@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 TexCoords;
+out float ViewDepth;
+
+void main() {
+    vec4 viewPosition = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * viewPosition;
+
+    TexCoords = aTexCoords;
+    ViewDepth = -viewPosition.z;
+}
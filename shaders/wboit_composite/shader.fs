@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2DMS accumulation;
+uniform sampler2DMS weights;
+uniform int samples;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    // the samples are averaged here, the scene target resolves everything else later
+    vec4 sum = vec4(0.0);
+    float weight = 0.0;
+    for (int i = 0; i < samples; i++) {
+        sum += texelFetch(accumulation, texel, i);
+        weight += texelFetch(weights, texel, i).r;
+    }
+    float revealage = sum.a / float(samples);
+    if (revealage >= 1.0) {
+        discard;
+    }
+
+    FragColor = vec4(sum.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
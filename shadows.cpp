@@ -0,0 +1,198 @@
+#include <glad/glad.h>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shadows.hpp"
+#include "cpu_profiler.hpp"
+
+// Blend between logarithmic (1) and uniform (0) split distances
+const float SPLIT_LAMBDA = 0.75f;
+// Extra radius every layer is rendered with, so that small camera movements don't force a redraw
+const float CASCADE_MARGIN = 0.2f;
+
+glm::vec3 lightUp(glm::vec3 direction) {
+    return std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+CascadedShadowMap::CascadedShadowMap(unsigned int resolution, unsigned int cascadeCount, float shadowDistance)
+        : resolution(resolution), cascadeCount(std::min(cascadeCount, MAX_CASCADES)), shadowDistance(shadowDistance),
+          lightDirection(0.0f), staticDirty(true), frame(0), layersRendered(0), castersRendered(0) {
+    for (Cascade &cascade : cascades)
+        cascade = {0.0f, glm::vec3(0.0f), 0.0f, glm::mat4(1.0f), false, false};
+
+    glGenTextures(1, &depthArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, this->cascadeCount, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    // hardware depth comparison, with linear filtering this gives 2x2 PCF per fetch
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &depthArray);
+}
+
+void CascadedShadowMap::MarkStaticDirty() {
+    staticDirty = true;
+}
+
+void CascadedShadowMap::fit(Cascade &cascade, glm::vec3 center, float radius) const {
+    // round the radius up so that the texel size only changes when the slice itself does
+    float covered = std::ceil(radius * (1.0f + CASCADE_MARGIN) * 16.0f) / 16.0f;
+    float texel = 2.0f * covered / (float) resolution;
+
+    // snap the center to whole texels in light space, so that consecutive layers rasterize casters identically and
+    // the shadow edges don't shimmer when a layer is redrawn
+    glm::mat3 lightRotation = glm::mat3(glm::lookAt(glm::vec3(0.0f), lightDirection, lightUp(lightDirection)));
+    glm::vec3 lightCenter = lightRotation * center;
+    lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+    lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+    center = glm::transpose(lightRotation) * lightCenter;
+
+    // casters between the light and the near plane are clamped onto it by GL_DEPTH_CLAMP while rendering
+    glm::mat4 lightView = glm::lookAt(center - lightDirection * covered, center, lightUp(lightDirection));
+    glm::mat4 lightProjection = glm::ortho(-covered, covered, -covered, covered, 0.0f, 2.0f * covered);
+
+    cascade.center = center;
+    cascade.radius = covered;
+    cascade.lightSpace = lightProjection * lightView;
+    cascade.valid = true;
+}
+
+bool CascadedShadowMap::overlaps(const Cascade &cascade, const ShadowCaster &caster) const {
+    glm::mat4 toLight = cascade.lightSpace * caster.transform;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 local((corner & 1) ? caster.model->boundsMax.x : caster.model->boundsMin.x,
+                        (corner & 2) ? caster.model->boundsMax.y : caster.model->boundsMin.y,
+                        (corner & 4) ? caster.model->boundsMax.z : caster.model->boundsMin.z);
+        glm::vec3 p = glm::vec3(toLight * glm::vec4(local, 1.0f));
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    // nothing is culled towards the light, those casters still shadow the cascade
+    return hi.x >= -1.0f && lo.x <= 1.0f && hi.y >= -1.0f && lo.y <= 1.0f && lo.z <= 1.0f;
+}
+
+void CascadedShadowMap::Update(const glm::mat4 &view, float fovy, float ratio, float near, glm::vec3 lightDirection,
+                               const std::vector<ShadowCaster> &casters, Shader &depthShader) {
+    PROFILE_SCOPE("CascadedShadowMap::Update");
+    frame++;
+    layersRendered = 0;
+    castersRendered = 0;
+
+    lightDirection = glm::normalize(lightDirection);
+    bool lightChanged = glm::length(lightDirection - this->lightDirection) > 1e-4f;
+    this->lightDirection = lightDirection;
+
+    bool anyDynamic = false;
+    for (const ShadowCaster &caster : casters)
+        anyDynamic |= !caster.isStatic;
+
+    float tanHalfY = std::tan(glm::radians(fovy) * 0.5f);
+    float tanHalfX = tanHalfY * ratio;
+    // squared half diagonal of the frustum cross section at unit depth
+    float diagonal2 = tanHalfX * tanHalfX + tanHalfY * tanHalfY;
+    glm::mat4 inverseView = glm::inverse(view);
+
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, resolution, resolution);
+    depthShader.use();
+
+    float sliceNear = near;
+    for (unsigned int i = 0; i < cascadeCount; i++) {
+        Cascade &cascade = cascades[i];
+
+        float p = (float) (i + 1) / (float) cascadeCount;
+        float logSplit = near * std::pow(shadowDistance / near, p);
+        float uniformSplit = near + (shadowDistance - near) * p;
+        float sliceFar = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+        cascade.splitFar = sliceFar;
+
+        // smallest sphere around the frustum slice, it only depends on the projection so it doesn't change size as
+        // the camera rotates
+        float centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + diagonal2), sliceFar);
+        float radius = std::sqrt(std::max(sliceNear * sliceNear * diagonal2 + (centerDepth - sliceNear) * (centerDepth - sliceNear),
+                                          sliceFar * sliceFar * diagonal2 + (sliceFar - centerDepth) * (sliceFar - centerDepth)));
+        glm::vec3 center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+        sliceNear = sliceFar;
+
+        bool refit = !cascade.valid || lightChanged || glm::distance(center, cascade.center) + radius > cascade.radius;
+        if (refit)
+            fit(cascade, center, radius);
+
+        // farther cascades pick up moving casters less often, staggered so they don't all land on the same frame. A
+        // layer that drew one last time is redrawn even if nothing overlaps it now, to clear the shadow it left
+        bool dynamicDue = false;
+        if ((frame + i) % (1u << i) == 0) {
+            dynamicDue = cascade.hadDynamic;
+            for (size_t c = 0; c < casters.size() && anyDynamic && !dynamicDue; c++)
+                dynamicDue = !casters[c].isStatic && overlaps(cascade, casters[c]);
+        }
+
+        if (!refit && !staticDirty && !dynamicDue)
+            continue;
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, i);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.setMat4("lightSpaceMatrix", cascade.lightSpace);
+
+        cascade.hadDynamic = false;
+        for (const ShadowCaster &caster : casters) {
+            if (!overlaps(cascade, caster))
+                continue;
+            caster.model->DrawDepth(depthShader, caster.transform);
+            cascade.hadDynamic |= !caster.isStatic;
+            castersRendered++;
+        }
+        layersRendered++;
+    }
+
+    staticDirty = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    if (cullFace)
+        glEnable(GL_CULL_FACE);
+}
+
+void CascadedShadowMap::Bind(const Shader &shader, unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("shadowMap", (int) unit);
+
+    shader.setInt("cascadeCount", (int) cascadeCount);
+    for (unsigned int i = 0; i < cascadeCount; i++) {
+        std::string index = "[" + std::to_string(i) + "]";
+        shader.setFloat("cascadeSplits" + index, cascades[i].splitFar);
+        shader.setMat4("lightSpaceMatrices" + index, cascades[i].lightSpace);
+        shader.setFloat("cascadeTexelSizes" + index, 2.0f * cascades[i].radius / (float) resolution);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "shader.hpp"
+#include "model.hpp"
+
+const unsigned int MAX_CASCADES = 4;
+
+// Something drawn into the shadow map. Static casters are assumed not to move until MarkStaticDirty is called
+struct ShadowCaster {
+    Model *model;
+    glm::mat4 transform;
+    bool isStatic;
+};
+
+// Cascaded shadow maps for the directional light. Every cascade is rendered over a slightly larger region than its
+// slice of the view frustum needs, and the layer is reused for as long as the slice stays inside that region and no
+// static caster changed. Dynamic casters are redrawn every frame in the first cascade and at halving frequencies in
+// the farther ones
+class CascadedShadowMap {
+public:
+    CascadedShadowMap(unsigned int resolution = 2048, unsigned int cascadeCount = MAX_CASCADES,
+                      float shadowDistance = 30.0f);
+    ~CascadedShadowMap();
+
+    CascadedShadowMap(const CascadedShadowMap &) = delete;
+    CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+    // refits the cascades to the camera and re-renders the layers that went stale. Leaves the default framebuffer
+    // bound, the caller is expected to reset the viewport
+    void Update(const glm::mat4 &view, float fovy, float ratio, float near, glm::vec3 lightDirection,
+                const std::vector<ShadowCaster> &casters, Shader &depthShader);
+
+    // forces every cascade to be redrawn on the next update, call it after moving a static caster
+    void MarkStaticDirty();
+
+    // binds the shadow map array to the given texture unit and sets the cascade uniforms
+    void Bind(const Shader &shader, unsigned int unit) const;
+
+    // number of layers redrawn and casters drawn during the last update
+    unsigned int LayersRendered() const { return layersRendered; }
+    unsigned int CastersRendered() const { return castersRendered; }
+
+private:
+    struct Cascade {
+        // view depth at which this cascade ends
+        float splitFar;
+        // world space sphere the layer was rendered over and the matrix it was rendered with
+        glm::vec3 center;
+        float radius;
+        glm::mat4 lightSpace;
+        bool valid;
+        // whether the last redraw drew a dynamic caster, whose shadow stays in the layer until it is redrawn again
+        bool hadDynamic;
+    };
+
+    unsigned int resolution;
+    unsigned int cascadeCount;
+    float shadowDistance;
+
+    Cascade cascades[MAX_CASCADES];
+    glm::vec3 lightDirection;
+    bool staticDirty;
+    unsigned long frame;
+
+    unsigned int layersRendered, castersRendered;
+
+    unsigned int FBO, depthArray;
+
+    void fit(Cascade &cascade, glm::vec3 center, float radius) const;
+    bool overlaps(const Cascade &cascade, const ShadowCaster &caster) const;
+};
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "job_system.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+const unsigned int COUNT = 100000;
+
+// many tiny jobs from the owner, each one bumping a shared count
+static void tinyJobs(JobSystem &jobs) {
+    std::atomic<unsigned int> sum{0};
+    JobCounter counter;
+    for (unsigned int i = 0; i < COUNT; i++)
+        jobs.Run([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); }, &counter);
+    jobs.Wait(counter);
+    check(sum.load() == COUNT, "tiny jobs ran " + std::to_string(sum.load()) + " times for " + std::to_string(COUNT));
+}
+
+// nested parallel fors, waiting inside jobs, every index has to be visited exactly once
+static void nestedParallelFor(JobSystem &jobs) {
+    std::vector<std::atomic<unsigned char>> visits(COUNT);
+    for (std::atomic<unsigned char> &visit : visits)
+        visit.store(0);
+    jobs.ParallelFor(COUNT, 4096, [&](size_t first, size_t last) {
+        jobs.ParallelFor(last - first, 64, [&](size_t innerFirst, size_t innerLast) {
+            for (size_t i = first + innerFirst; i < first + innerLast; i++)
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+        });
+    });
+    size_t wrong = 0;
+    for (const std::atomic<unsigned char> &visit : visits)
+        wrong += visit.load() != 1;
+    check(wrong == 0, std::to_string(wrong) + " indices not visited exactly once by nested parallel fors");
+}
+
+// a chain of jobs each started after the previous one, they have to run in order
+static void dependencyChain(JobSystem &jobs) {
+    const unsigned int LENGTH = 1000;
+    std::vector<std::unique_ptr<JobCounter>> counters;
+    for (unsigned int i = 0; i < LENGTH; i++)
+        counters.push_back(std::make_unique<JobCounter>());
+    std::atomic<unsigned int> next{0};
+    std::atomic<unsigned int> outOfOrder{0};
+    for (unsigned int i = 0; i < LENGTH; i++) {
+        jobs.Run([&, i]() {
+            if (next.fetch_add(1) != i)
+                outOfOrder++;
+        }, counters[i].get(), i > 0 ? counters[i - 1].get() : nullptr);
+    }
+    jobs.Wait(*counters.back());
+    check(outOfOrder.load() == 0, std::to_string(outOfOrder.load()) + " jobs of a dependency chain ran out of order");
+}
+
+// jobs started from threads outside the system
+static void outsideThreads(JobSystem &jobs) {
+    std::atomic<unsigned int> sum{0};
+    std::vector<std::thread> outsiders;
+    for (int t = 0; t < 4; t++) {
+        outsiders.emplace_back([&]() {
+            JobCounter counter;
+            for (unsigned int i = 0; i < COUNT / 16; i++)
+                jobs.Run([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            jobs.Wait(counter);
+        });
+    }
+    for (std::thread &outsider : outsiders)
+        outsider.join();
+    check(sum.load() == COUNT / 16 * 4, "jobs from outside threads ran " + std::to_string(sum.load()) + " times");
+}
+
+int main() {
+    // at least four threads, so the deques see contention even on small machines
+    JobSystem jobs(std::max(4u, std::thread::hardware_concurrency()) - 1);
+
+    tinyJobs(jobs);
+    nestedParallelFor(jobs);
+    dependencyChain(jobs);
+    outsideThreads(jobs);
+
+    std::cout << "job system on " << jobs.Threads() << " threads: " << (failures ? "FAILED" : "ok") << std::endl;
+    jobs.Report(std::cout);
+    return failures ? 1 : 0;
+}
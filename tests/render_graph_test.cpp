@@ -0,0 +1,129 @@
+#include <glad/glad.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "render_graph.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// names of the passes in the "passes:" section of a dump, in execution order
+static std::vector<std::string> executionOrder(const std::string &dump) {
+    std::vector<std::string> names;
+    std::istringstream in(dump);
+    std::string line;
+    bool inPasses = false;
+    while (std::getline(in, line)) {
+        if (line == "passes:") {
+            inPasses = true;
+        } else if (inPasses && line.compare(0, 2, "  ") == 0 && line.size() > 5 && isdigit(line[3])) {
+            std::string name = line.substr(5, 20);
+            names.push_back(name.substr(0, name.find_last_not_of(' ') + 1));
+        } else if (line.compare(0, 2, "  ") != 0) {
+            inPasses = false;
+        }
+    }
+    return names;
+}
+
+// the line a texture is described on, empty if it isn't there
+static std::string textureLine(const std::string &dump, const std::string &name) {
+    std::istringstream in(dump);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, name.size() + 3, "  " + name + " ") == 0)
+            return line;
+    }
+    return "";
+}
+
+static bool contains(const std::string &text, const std::string &part) {
+    return text.find(part) != std::string::npos;
+}
+
+// A bloom chain declared out of order: the tonemap pass comes before what it reads, particles blend on top of the
+// scene after everything else is declared, and a debug view nobody reads has to go
+static void bloomChain() {
+    RenderTargetDesc full = {1280, 720, GL_RGBA16F, 1, true};
+    RenderTargetDesc half = {640, 360, GL_RGBA16F, 1, false};
+    RenderTarget window;
+    window.width = 1280;
+    window.height = 720;
+    window.format = GL_RGBA8;
+
+    RenderGraph graph;
+    unsigned int backbuffer = graph.ImportTexture("backbuffer", window);
+    unsigned int scene = graph.CreateTexture("scene", full);
+    unsigned int bright = graph.CreateTexture("bright", half);
+    unsigned int blurX = graph.CreateTexture("blur x", half);
+    unsigned int blurY = graph.CreateTexture("blur y", half);
+    unsigned int debug = graph.CreateTexture("debug", full);
+    graph.MarkOutput(backbuffer);
+
+    auto nothing = [](const RenderGraphContext &) {};
+    graph.AddPass("debug view", [&](RenderGraphBuilder &b) { b.Write(debug); }, nothing);
+    graph.AddPass("tonemap", [&](RenderGraphBuilder &b) { b.Read(scene); b.Read(blurY); b.Write(backbuffer); },
+                  nothing);
+    graph.AddPass("scene", [&](RenderGraphBuilder &b) { b.Write(scene); }, nothing);
+    graph.AddPass("bright pass", [&](RenderGraphBuilder &b) { b.Read(scene); b.Write(bright); }, nothing);
+    graph.AddPass("blur x", [&](RenderGraphBuilder &b) { b.Read(bright); b.Write(blurX); }, nothing);
+    graph.AddPass("blur y", [&](RenderGraphBuilder &b) { b.Read(blurX); b.Write(blurY); }, nothing);
+    graph.AddPass("particles", [&](RenderGraphBuilder &b) { b.Read(scene); b.Write(scene); }, nothing);
+
+    check(graph.Compile(), "bloom chain compiles without a cycle");
+    std::string dump = graph.Dump();
+
+    check(contains(dump, "render graph: 6 passes, 1 culled, 6 textures"), "bloom chain keeps six passes");
+    check(contains(dump, "-- debug view"), "debug view is culled");
+
+    std::vector<std::string> expected = {"scene", "particles", "bright pass", "blur x", "blur y", "tonemap"};
+    check(executionOrder(dump) == expected, "bloom chain runs in dependency order");
+
+    // scene lives the whole frame, blur y starts after bright's last reader and takes its target, blur x overlaps
+    // both of them and needs its own
+    check(contains(textureLine(dump, "scene"), "lifetime [0, 5] -> physical 0"), "scene gets its own target");
+    check(contains(textureLine(dump, "bright"), "lifetime [2, 3] -> physical 1"), "bright lifetime");
+    check(contains(textureLine(dump, "blur x"), "lifetime [3, 4] -> physical 2"), "blur x doesn't alias");
+    check(contains(textureLine(dump, "blur y"), "lifetime [4, 5] -> physical 1"), "blur y aliases bright");
+    check(contains(textureLine(dump, "debug"), "unused"), "debug texture is never allocated");
+    check(contains(textureLine(dump, "backbuffer"), "imported") &&
+          contains(textureLine(dump, "backbuffer"), "output"), "backbuffer is an imported output");
+
+    check(graph.VirtualBytes() == RenderTargetBytes(full) + 3 * RenderTargetBytes(half), "declared memory");
+    check(graph.PhysicalBytes() == RenderTargetBytes(full) + 2 * RenderTargetBytes(half), "aliased memory");
+
+    if (failures)
+        std::cout << dump;
+}
+
+// two passes feeding each other can't be ordered, Compile says so and falls back to declaration order
+static void cycle() {
+    RenderTargetDesc desc = {64, 64, GL_RGBA8, 1, false};
+    RenderGraph graph;
+    unsigned int a = graph.CreateTexture("a", desc);
+    unsigned int b = graph.CreateTexture("b", desc);
+    graph.MarkOutput(a);
+
+    auto nothing = [](const RenderGraphContext &) {};
+    graph.AddPass("first", [&](RenderGraphBuilder &builder) { builder.Read(b); builder.Write(a); }, nothing);
+    graph.AddPass("second", [&](RenderGraphBuilder &builder) { builder.Read(a); builder.Write(b); }, nothing);
+
+    check(!graph.Compile(), "a cycle is reported");
+    std::vector<std::string> expected = {"first", "second"};
+    check(executionOrder(graph.Dump()) == expected, "a cycle runs in declaration order");
+}
+
+int main() {
+    bloomChain();
+    cycle();
+
+    std::cout << "render graph: " << (failures ? "FAILED" : "ok") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <xmmintrin.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "transform.hpp"
+#include "job_system.hpp"
+
+// translation * rotation * scale of four objects, one object per lane, stored into out[0 .. lanes)
+static inline void composeFour(__m128 x, __m128 y, __m128 z, __m128 w, __m128 sx, __m128 sy, __m128 sz, __m128 px,
+                               __m128 py, __m128 pz, glm::mat4 *const out[4], size_t lanes) {
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    // columns of the rotation matrix, each scaled by its axis
+    __m128 columns[4][4];
+    columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    columns[0][3] = zero;
+    columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    columns[1][3] = zero;
+    columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+    columns[2][3] = zero;
+    columns[3][0] = px;
+    columns[3][1] = py;
+    columns[3][2] = pz;
+    columns[3][3] = one;
+
+    // transposed, each register holds one column of one lane's matrix, ready to store as is
+    for (int column = 0; column < 4; column++) {
+        __m128 *c = columns[column];
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+        for (size_t lane = 0; lane < lanes; lane++)
+            _mm_storeu_ps(&(*out[lane])[column][0], c[lane]);
+    }
+}
+
+static_assert(sizeof(Transform) == 10 * sizeof(float), "Transform has to be ten packed floats");
+
+void ComposeTransforms(const Transform *transforms, size_t count, glm::mat4 *matrices) {
+    for (size_t first = 0; first < count; first += 4) {
+        size_t lanes = std::min<size_t>(4, count - first);
+        // a short last block is padded with identities, loads must not run past the array
+        Transform padded[4];
+        const Transform *block = transforms + first;
+        if (lanes < 4) {
+            std::copy(block, block + lanes, padded);
+            block = padded;
+        }
+
+        // a Transform is ten floats, so loads at the position, the rotation and the rotation's w each pick up one
+        // part whole and transposing four of them gives the per component registers
+        __m128 p[4], r[4], s[4];
+        for (int lane = 0; lane < 4; lane++) {
+            p[lane] = _mm_loadu_ps(&block[lane].position.x);
+            r[lane] = _mm_loadu_ps(&block[lane].rotation.x);
+            s[lane] = _mm_loadu_ps(&block[lane].rotation.w);
+        }
+        _MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+        _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+        _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+
+        glm::mat4 *out[4];
+        for (size_t lane = 0; lane < 4; lane++)
+            out[lane] = &matrices[first + std::min<size_t>(lane, lanes - 1)];
+        composeFour(r[0], r[1], r[2], r[3], s[1], s[2], s[3], p[0], p[1], p[2], out, lanes);
+    }
+}
+
+// four packed vec3 in three registers, (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3), to one register per component
+static inline void deinterleave(const glm::vec3 *v, __m128 &x, __m128 &y, __m128 &z) {
+    __m128 a = _mm_loadu_ps(&v[0].x), b = _mm_loadu_ps(&v[1].y), c = _mm_loadu_ps(&v[2].z);
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                       _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+void ComposeTransforms(const glm::vec3 *positions, const glm::quat *rotations, const glm::vec3 *scales, size_t count,
+                       glm::mat4 *matrices) {
+    for (size_t first = 0; first < count; first += 4) {
+        size_t lanes = std::min<size_t>(4, count - first);
+        // a short last block is padded with identities, loads must not run past the arrays
+        glm::vec3 paddedPositions[4] = {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)};
+        glm::quat paddedRotations[4];
+        glm::vec3 paddedScales[4] = {glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f)};
+        const glm::vec3 *position = positions + first, *scale = scales + first;
+        const glm::quat *rotation = rotations + first;
+        if (lanes < 4) {
+            for (size_t lane = 0; lane < 4; lane++)
+                paddedRotations[lane] = lane < lanes ? rotation[lane] : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            std::copy(position, position + lanes, paddedPositions);
+            std::copy(scale, scale + lanes, paddedScales);
+            position = paddedPositions;
+            rotation = paddedRotations;
+            scale = paddedScales;
+        }
+
+        __m128 p[3], r[4], s[3];
+        deinterleave(position, p[0], p[1], p[2]);
+        deinterleave(scale, s[0], s[1], s[2]);
+        for (int lane = 0; lane < 4; lane++)
+            r[lane] = _mm_loadu_ps(&rotation[lane].x);
+        _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+
+        glm::mat4 *out[4];
+        for (size_t lane = 0; lane < 4; lane++)
+            out[lane] = &matrices[first + std::min<size_t>(lane, lanes - 1)];
+        composeFour(r[0], r[1], r[2], r[3], s[0], s[1], s[2], p[0], p[1], p[2], out, lanes);
+    }
+}
+
+void BenchmarkTransforms(std::ostream &out, unsigned int count) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<glm::vec3> positions(count), axes(count), scales(count);
+    std::vector<float> angles(count);
+    for (unsigned int i = 0; i < count; i++) {
+        positions[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f;
+        axes[i] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 2.0f, 0.0f));
+        angles[i] = unit(rng) * 3.1415927f;
+        scales[i] = glm::vec3(1.5f) + glm::vec3(unit(rng), unit(rng), unit(rng));
+    }
+
+    const int repeats = 20;
+    auto rate = [&](std::chrono::steady_clock::time_point start) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return (double) count * repeats / seconds / 1e6;
+    };
+
+    std::vector<glm::mat4> matrices(count);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (unsigned int i = 0; i < count; i++) {
+            glm::mat4 m = glm::translate(glm::mat4(1.0f), positions[i]);
+            m = glm::rotate(m, angles[i], axes[i]);
+            matrices[i] = glm::scale(m, scales[i]);
+        }
+    }
+    out << count << " transforms, glm translate/rotate/scale: " << rate(start) << " M matrices/s" << std::endl;
+
+    std::vector<Transform> transforms(count);
+    for (unsigned int i = 0; i < count; i++) {
+        transforms[i].position = positions[i];
+        transforms[i].rotation = glm::angleAxis(angles[i], axes[i]);
+        transforms[i].scale = scales[i];
+    }
+
+    std::vector<glm::mat4> composed(count);
+    unsigned int hardware = JobSystem::Instance().Threads();
+    for (unsigned int threads : {1u, hardware}) {
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            if (threads == 1) {
+                ComposeTransforms(transforms.data(), count, composed.data());
+            } else {
+                JobSystem::Instance().ParallelFor(count, 8192, [&](size_t first, size_t last) {
+                    ComposeTransforms(&transforms[first], last - first, &composed[first]);
+                });
+            }
+        }
+        out << "  SSE, " << threads << " thread" << (threads > 1 ? "s" : "") << ": " << rate(start)
+            << " M matrices/s" << std::endl;
+        if (threads == hardware)
+            break;
+    }
+
+    // the layout of the scene's chunks, one array per part
+    std::vector<glm::quat> rotations(count);
+    for (unsigned int i = 0; i < count; i++)
+        rotations[i] = transforms[i].rotation;
+    std::vector<glm::mat4> separate(count);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        ComposeTransforms(positions.data(), rotations.data(), scales.data(), count, separate.data());
+    out << "  SSE from separate arrays, 1 thread: " << rate(start) << " M matrices/s" << std::endl;
+
+    float error = 0.0f;
+    for (unsigned int i = 0; i < count; i++) {
+        for (int c = 0; c < 4; c++) {
+            error = std::max(error, glm::length(composed[i][c] - matrices[i][c]));
+            error = std::max(error, glm::length(separate[i][c] - matrices[i][c]));
+        }
+    }
+    out << "  largest difference to glm: " << error << std::endl;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Position, rotation and scale of one object. Ten floats in this order, which ComposeTransforms relies on
+struct Transform {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// translation * rotation * scale of count transforms, four at a time with SSE
+void ComposeTransforms(const Transform *transforms, size_t count, glm::mat4 *matrices);
+
+// the same from one array per part, as the scene's chunks keep them
+void ComposeTransforms(const glm::vec3 *positions, const glm::quat *rotations, const glm::vec3 *scales, size_t count,
+                       glm::mat4 *matrices);
+
+// Composes count random transforms through the glm translate/rotate/scale chain, through ComposeTransforms on one
+// and on every thread and from separate arrays, and prints matrices per second for each
+void BenchmarkTransforms(std::ostream &out, unsigned int count);
@@ -0,0 +1,230 @@
+#include <glad/glad.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "transparency.hpp"
+#include "cpu_profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "normal_matrix.hpp"
+
+const unsigned int SORT_WINDOW = 240;
+
+bool ParseTransparencyMode(const std::string &name, TransparencyMode &mode) {
+    if (name == "sorted")
+        mode = TransparencyMode::SORTED;
+    else if (name == "wboit")
+        mode = TransparencyMode::WEIGHTED_BLENDED;
+    else
+        return false;
+    return true;
+}
+
+uint32_t SortableFloat(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    // negative floats order backwards, so all their bits flip; positive ones just need the sign bit set
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+unsigned int RadixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch) {
+    size_t count = items.size();
+    if (count < 2)
+        return 0;
+    scratch.resize(count);
+
+    uint32_t histograms[4][256] = {};
+    for (const SortItem &item : items) {
+        histograms[0][item.key & 0xff]++;
+        histograms[1][(item.key >> 8) & 0xff]++;
+        histograms[2][(item.key >> 16) & 0xff]++;
+        histograms[3][item.key >> 24]++;
+    }
+
+    unsigned int passes = 0;
+    for (unsigned int digit = 0; digit < 4; digit++) {
+        unsigned int shift = digit * 8;
+        uint32_t *histogram = histograms[digit];
+        if (histogram[(items[0].key >> shift) & 0xff] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (unsigned int i = 0; i < 256; i++) {
+            offsets[i] = sum;
+            sum += histogram[i];
+        }
+        for (const SortItem &item : items)
+            scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+        items.swap(scratch);
+        passes++;
+    }
+    return passes;
+}
+
+TransparencyRenderer::TransparencyRenderer()
+        : mode(TransparencyMode::SORTED),
+          sortedShader("shaders/unlit/shader.vs", "shaders/unlit/shader.fs"),
+          accumulateShader("shaders/wboit/shader.vs", "shaders/wboit/shader.fs"),
+          compositeShader("shaders/wboit_composite/shader.vs", "shaders/wboit_composite/shader.fs"),
+          nextSample(0), lastPasses(0),
+          FBO(0), accumulation(0), weights(0), width(0), height(0), samples(0) {}
+
+TransparencyRenderer::~TransparencyRenderer() {
+    release();
+}
+
+void TransparencyRenderer::Draw(const RenderTarget &target, const glm::mat4 &view, const glm::mat4 &projection) {
+    if (draws.empty())
+        return;
+
+    glEnable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+
+    if (mode == TransparencyMode::SORTED) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+        glViewport(0, 0, target.width, target.height);
+        drawSorted(view, projection);
+    } else {
+        drawWeightedBlended(target, view, projection);
+    }
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+}
+
+void TransparencyRenderer::drawSorted(const glm::mat4 &view, const glm::mat4 &projection) {
+    {
+        PROFILE_SCOPE("TransparencyRenderer::sort");
+        auto start = std::chrono::steady_clock::now();
+
+        // farthest first: the distance is flipped so that the ascending sort puts it in front
+        items.resize(draws.size());
+        for (size_t i = 0; i < draws.size(); i++) {
+            const TransparentDraw &draw = draws[i];
+            glm::vec3 center = (draw.model->boundsMin + draw.model->boundsMax) * 0.5f;
+            float distance = -(view * draw.transform * glm::vec4(center, 1.0f)).z;
+            items[i] = {~SortableFloat(distance), (uint32_t) i};
+        }
+        lastPasses = RadixSort(items, scratch);
+
+        float elapsed = (float) std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        RecordSample(sortMilliseconds, nextSample, SORT_WINDOW, elapsed);
+    }
+
+    transforms.resize(draws.size());
+    for (size_t i = 0; i < draws.size(); i++)
+        transforms[i] = draws[i].transform;
+    normalMatrices.resize(draws.size());
+    NormalMatrices(transforms.data(), transforms.size(), normalMatrices.data());
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    sortedShader.use();
+    sortedShader.setMat4("projection", projection);
+    sortedShader.setMat4("view", view);
+    for (const SortItem &item : items) {
+        const TransparentDraw &draw = draws[item.index];
+        draw.model->Draw(sortedShader, draw.transform, normalMatrices[item.index]);
+    }
+}
+
+void TransparencyRenderer::drawWeightedBlended(const RenderTarget &target, const glm::mat4 &view,
+                                               const glm::mat4 &projection) {
+    if (target.width != width || target.height != height || target.samples != samples) {
+        release();
+        allocate(target.width, target.height, target.samples);
+    }
+
+    // the scene's depth is tested against but never written, the pool may hand out a different target every frame
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+    glViewport(0, 0, width, height);
+
+    float clearAccumulation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    float clearWeights[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+    glClearBufferfv(GL_COLOR, 1, clearWeights);
+
+    // GL 3.3 has no per attachment blending, so one function has to serve both targets: color adds up, alpha
+    // multiplies by one minus the fragment's alpha, which only the revealage in attachment 0 uses
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    accumulateShader.use();
+    accumulateShader.setMat4("projection", projection);
+    accumulateShader.setMat4("view", view);
+    for (const TransparentDraw &draw : draws) {
+        draw.model->Draw(accumulateShader, draw.transform);
+    }
+
+    // the average color goes over the scene, covering it by one minus the revealage
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    compositeShader.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, accumulation);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, weights);
+    glActiveTexture(GL_TEXTURE0);
+    compositeShader.setInt("accumulation", 0);
+    compositeShader.setInt("weights", 1);
+    compositeShader.setInt("samples", samples);
+    screenQuad.Draw();
+    glEnable(GL_DEPTH_TEST);
+}
+
+void TransparencyRenderer::allocate(int width, int height, int samples) {
+    this->width = width;
+    this->height = height;
+    this->samples = samples;
+
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+    // fixed sample locations, the depth renderbuffer attached next to them has them too
+    glGenTextures(1, &accumulation);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, accumulation);
+    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGBA16F, width, height, GL_TRUE);
+    glGenTextures(1, &weights);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, weights);
+    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_R16F, width, height, GL_TRUE);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, accumulation, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D_MULTISAMPLE, weights, 0);
+
+    unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, attachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::TRANSPARENCY::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void TransparencyRenderer::release() {
+    if (!FBO)
+        return;
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &accumulation);
+    glDeleteTextures(1, &weights);
+    FBO = accumulation = weights = 0;
+    width = height = samples = 0;
+}
+
+void TransparencyRenderer::Report(std::ostream &out) const {
+    out << "Transparency: " << (mode == TransparencyMode::SORTED ? "sorted" : "weighted blended") << ", "
+        << draws.size() << " draws" << std::endl;
+    if (mode == TransparencyMode::SORTED) {
+        out << "  radix sort " << average(sortMilliseconds) << " ms avg, " << percentile(sortMilliseconds, 0.99f)
+            << " ms p99, " << lastPasses << " of 4 passes" << std::endl;
+    } else if (FBO) {
+        // 8 bytes of accumulation and 2 of weight per sample
+        double megabytes = (double) width * height * samples * 10.0 / (1024.0 * 1024.0);
+        out << "  targets " << width << "x" << height << " x" << samples << " samples, " << megabytes << " MB"
+            << std::endl;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "model.hpp"
+#include "render_target.hpp"
+#include "screen_quad.hpp"
+#include "shader.hpp"
+
+enum class TransparencyMode {
+    SORTED,
+    WEIGHTED_BLENDED
+};
+
+// "sorted" or "wboit", returns false for anything else
+bool ParseTransparencyMode(const std::string &name, TransparencyMode &mode);
+
+// maps a float to an unsigned integer that orders the same way, negative values included
+uint32_t SortableFloat(float value);
+
+struct SortItem {
+    uint32_t key;
+    uint32_t index;
+};
+
+// Stable least significant digit radix sort on the keys, 8 bits per pass. The histograms of all four digits are
+// built in a single pass over the items, and passes where every key has the same digit are skipped, so keys spanning
+// a narrow range (depths of nearby objects share their exponent) take fewer passes. Returns the passes run
+unsigned int RadixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch);
+
+struct TransparentDraw {
+    Model *model;
+    glm::mat4 transform;
+};
+
+// Transparent surfaces drawn over the opaque scene, in one of two ways:
+//   SORTED            draws back to front with regular alpha blending, ordered per draw by the view depth of the
+//                     center of its bounds. Exact for surfaces that don't intersect, and the sort grows with the count
+//   WEIGHTED_BLENDED  McGuire and Bavoil's order independent approximation. Every fragment is added into a weighted
+//                     color sum and multiplied into a revealage product, in any order, then one fullscreen pass
+//                     composites the average over the scene. Nothing is sorted, weights favor the nearest surfaces
+class TransparencyRenderer {
+public:
+    TransparencyRenderer();
+    ~TransparencyRenderer();
+
+    TransparencyRenderer(const TransparencyRenderer &) = delete;
+    TransparencyRenderer &operator=(const TransparencyRenderer &) = delete;
+
+    void SetMode(TransparencyMode mode) { this->mode = mode; }
+    TransparencyMode Mode() const { return mode; }
+
+    // the draws of the frame, Clear starts over
+    void Clear() { draws.clear(); }
+    void Add(Model *model, const glm::mat4 &transform) { draws.push_back({model, transform}); }
+    size_t Count() const { return draws.size(); }
+
+    // blends everything added into target, a multisampled scene target whose depth holds the opaque geometry
+    void Draw(const RenderTarget &target, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // mode, draw count, CPU time spent sorting and the weighted blended targets
+    void Report(std::ostream &out) const;
+
+private:
+    TransparencyMode mode;
+    std::vector<TransparentDraw> draws;
+
+    Shader sortedShader, accumulateShader, compositeShader;
+    ScreenQuad screenQuad;
+
+    // reused from frame to frame
+    std::vector<SortItem> items, scratch;
+    std::vector<glm::mat4> transforms;
+    std::vector<glm::mat3> normalMatrices;
+    std::vector<float> sortMilliseconds;
+    size_t nextSample;
+    unsigned int lastPasses;
+
+    // weighted blended targets, multisampled like the scene so its depth buffer can be attached
+    //   0: RGBA16F  sum of premultiplied color times weight in rgb, revealage in a
+    //   1: R16F     sum of alpha times weight
+    unsigned int FBO;
+    unsigned int accumulation, weights;
+    int width, height, samples;
+
+    void drawSorted(const glm::mat4 &view, const glm::mat4 &projection);
+    void drawWeightedBlended(const RenderTarget &target, const glm::mat4 &view, const glm::mat4 &projection);
+    void allocate(int width, int height, int samples);
+    void release();
+};
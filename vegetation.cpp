@@ -0,0 +1,180 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "vegetation.hpp"
+#include "camera.hpp"
+#include "cpu_profiler.hpp"
+
+// the cull frustum is this much wider than the view, covering a couple of frames of camera turn
+const float CULL_MARGIN = 0.1f;
+
+Vegetation::Vegetation(Model &clump, unsigned int count, glm::vec2 regionMin, glm::vec2 regionMax, float groundHeight,
+                       float minScale, float maxScale)
+        : clump(clump), count(count), lodDistance(4.0f), maxDistance(30.0f),
+          cullShader("shaders/vegetation_cull/shader.vs", "shaders/vegetation_cull/shader.gs", {"Culled"}),
+          drawShader("shaders/vegetation/shader.vs", "shaders/vegetation/shader.fs"), visible{0, 0}, frame(0),
+          lateFrames(0) {
+    PROFILE_SCOPE("Vegetation::Vegetation");
+
+    // the array's first element stands for all six
+    cullLocations.planes = glGetUniformLocation(cullShader.ID, "planes");
+    cullLocations.eye = glGetUniformLocation(cullShader.ID, "eye");
+    cullLocations.center = glGetUniformLocation(cullShader.ID, "center");
+    cullLocations.radius = glGetUniformLocation(cullShader.ID, "radius");
+    cullLocations.lodDistance = glGetUniformLocation(cullShader.ID, "lodDistance");
+    cullLocations.maxDistance = glGetUniformLocation(cullShader.ID, "maxDistance");
+    cullLocations.nearDistance = glGetUniformLocation(cullShader.ID, "nearDistance");
+    cullLocations.farDistance = glGetUniformLocation(cullShader.ID, "farDistance");
+    drawLocations.view = glGetUniformLocation(drawShader.ID, "view");
+    drawLocations.projection = glGetUniformLocation(drawShader.ID, "projection");
+    drawLocations.baseHeight = glGetUniformLocation(drawShader.ID, "baseHeight");
+    drawLocations.time = glGetUniformLocation(drawShader.ID, "time");
+    drawLocations.sunDirection = glGetUniformLocation(drawShader.ID, "sunDirection");
+    drawLocations.yawOffset = glGetUniformLocation(drawShader.ID, "yawOffset");
+
+    // the clumps turn about their base, so the sphere is centered on the vertical axis through it
+    glm::vec3 extent = (clump.boundsMax - clump.boundsMin) * 0.5f;
+    glm::vec3 middle = (clump.boundsMax + clump.boundsMin) * 0.5f;
+    radius = glm::length(extent) + glm::length(glm::vec2(middle.x, middle.z));
+
+    // one clump per cell of a square grid, jittered inside the cell
+    std::vector<glm::vec4> instances(count);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    unsigned int side = 1;
+    while (side * side < count)
+        side++;
+    glm::vec2 cell = (regionMax - regionMin) / (float) side;
+    for (unsigned int i = 0; i < count; i++) {
+        glm::vec2 jitter(unit(rng), unit(rng));
+        glm::vec2 position = regionMin + cell * (glm::vec2((float) (i % side), (float) (i / side)) + jitter);
+        instances[i] = glm::vec4(position.x, groundHeight, position.y, minScale + (maxScale - minScale) * unit(rng));
+    }
+
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &cullVAO);
+    glBindVertexArray(cullVAO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *) 0);
+    glBindVertexArray(0);
+
+    for (unsigned int set = 0; set < SETS; set++) {
+        glGenBuffers(LODS, culledBuffers[set]);
+        glGenQueries(LODS, queries[set]);
+        for (unsigned int lod = 0; lod < LODS; lod++) {
+            glBindBuffer(GL_ARRAY_BUFFER, culledBuffers[set][lod]);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) count * sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+Vegetation::~Vegetation() {
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteVertexArrays(1, &cullVAO);
+    for (unsigned int set = 0; set < SETS; set++) {
+        glDeleteBuffers(LODS, culledBuffers[set]);
+        glDeleteQueries(LODS, queries[set]);
+    }
+}
+
+void Vegetation::SetDistances(float lodDistance, float maxDistance) {
+    this->lodDistance = lodDistance;
+    this->maxDistance = std::max(maxDistance, lodDistance + 0.01f);
+}
+
+void Vegetation::cull(unsigned int set, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye) {
+    glm::mat4 widened = glm::mat4(1.0f);
+    widened[0][0] = widened[1][1] = 1.0f / (1.0f + CULL_MARGIN);
+    glm::vec4 planes[6];
+    FrustumPlanes(widened * projection * view, planes);
+
+    cullShader.use();
+    glUniform4fv(cullLocations.planes, 6, glm::value_ptr(planes[0]));
+    glUniform3fv(cullLocations.eye, 1, glm::value_ptr(eye));
+    glUniform3f(cullLocations.center, 0.0f, (clump.boundsMax.y - clump.boundsMin.y) * 0.5f, 0.0f);
+    glUniform1f(cullLocations.radius, radius);
+    glUniform1f(cullLocations.lodDistance, lodDistance);
+    glUniform1f(cullLocations.maxDistance, maxDistance);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(cullVAO);
+    float ranges[LODS + 1] = {0.0f, lodDistance, maxDistance};
+    for (unsigned int lod = 0; lod < LODS; lod++) {
+        glUniform1f(cullLocations.nearDistance, ranges[lod]);
+        glUniform1f(cullLocations.farDistance, ranges[lod + 1]);
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, culledBuffers[set][lod]);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[set][lod]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    }
+    glBindVertexArray(0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void Vegetation::Draw(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye,
+                      const glm::vec3 &sunDirection, float time) {
+    if (count == 0)
+        return;
+
+    unsigned int current = frame % SETS;
+    cull(current, view, projection, eye);
+    frame++;
+
+    // the newest earlier culling whose counts are back. Queries finish in order, so the last one stands for the set,
+    // and only when even the oldest isn't back does reading it wait
+    int previous = -1;
+    for (unsigned int age = 1; age < SETS && age < frame; age++) {
+        previous = (int) ((current + SETS - age) % SETS);
+        unsigned int available;
+        glGetQueryObjectuiv(queries[previous][LODS - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+            break;
+        if (age == 1)
+            lateFrames++;
+    }
+    if (previous < 0)
+        return;
+    for (unsigned int lod = 0; lod < LODS; lod++)
+        glGetQueryObjectuiv(queries[previous][lod], GL_QUERY_RESULT, &visible[lod]);
+
+    glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    glDisable(GL_CULL_FACE);
+
+    drawShader.use();
+    glUniformMatrix4fv(drawLocations.view, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(drawLocations.projection, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(drawLocations.baseHeight, clump.boundsMin.y);
+    glUniform1f(drawLocations.time, time);
+    glUniform3fv(drawLocations.sunDirection, 1, glm::value_ptr(sunDirection));
+
+    // near clumps twice, crossed
+    for (unsigned int copy = 0; copy < 2 && visible[0] > 0; copy++) {
+        glUniform1f(drawLocations.yawOffset, copy * 1.5707963f);
+        clump.DrawInstanced(drawShader, culledBuffers[previous][0], visible[0]);
+    }
+    if (visible[1] > 0) {
+        glUniform1f(drawLocations.yawOffset, 0.0f);
+        clump.DrawInstanced(drawShader, culledBuffers[previous][1], visible[1]);
+    }
+
+    glEnable(GL_CULL_FACE);
+    glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+}
+
+void Vegetation::Report(std::ostream &out) const {
+    double megabytes = (double) count * sizeof(glm::vec4) * (1 + SETS * LODS) / (1024.0 * 1024.0);
+    out << "Vegetation: " << count << " clumps, " << visible[0] << " near (drawn crossed) and " << visible[1]
+        << " far visible, " << megabytes << " MB of instance buffers, " << lateFrames << " of " << frame
+        << " frames drew an older culling" << std::endl;
+}
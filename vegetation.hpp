@@ -0,0 +1,70 @@
+#pragma once
+
+#include <ostream>
+#include <glm/glm.hpp>
+#include "model.hpp"
+#include "shader.hpp"
+
+// Grass clumps scattered procedurally over a rectangle of ground, kept entirely in GPU buffers. Every frame a transform
+// feedback pass with the rasterizer off runs over all instances, and a geometry shader keeps the ones inside the view
+// frustum, writing them to one of two level of detail buffers by distance: near clumps are drawn as two crossed copies
+// of the model, far ones as a single copy and thinned out with distance. The survivors are drawn instanced with
+// alpha to coverage, which antialiases the cutout edges under MSAA where discard would leave them jagged.
+//
+// GL 3.3 can't draw straight from a transform feedback count, so the counts come back through queries. To not wait on
+// them the culled buffers form a ring of three: a frame draws the newest earlier culling whose counts are back,
+// normally the previous frame's. The cull frustum is widened by a margin so nothing pops in at the edges while the
+// camera turns
+class Vegetation {
+public:
+    // count clumps on a jittered grid between regionMin and regionMax (x, z) standing on groundHeight
+    Vegetation(Model &clump, unsigned int count, glm::vec2 regionMin, glm::vec2 regionMax, float groundHeight,
+               float minScale = 0.08f, float maxScale = 0.16f);
+    ~Vegetation();
+
+    Vegetation(const Vegetation &) = delete;
+    Vegetation &operator=(const Vegetation &) = delete;
+
+    // near clumps are crossed up to lodDistance, far ones are thinned out until maxDistance and culled beyond it
+    void SetDistances(float lodDistance, float maxDistance);
+
+    // culls for this frame and draws the previous frame's survivors into the bound framebuffer, which should be
+    // multisampled for the alpha to coverage to do anything
+    void Draw(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye, const glm::vec3 &sunDirection,
+              float time);
+
+    unsigned int Count() const { return count; }
+
+    // instances, visible near and far clumps, buffer memory
+    void Report(std::ostream &out) const;
+
+private:
+    static const unsigned int LODS = 2;
+    static const unsigned int SETS = 3;
+
+    Model &clump;
+    unsigned int count;
+    float radius;
+    float lodDistance, maxDistance;
+
+    Shader cullShader, drawShader;
+    // uniform locations, looked up once
+    struct {
+        int planes, eye, center, radius, lodDistance, maxDistance, nearDistance, farDistance;
+    } cullLocations;
+    struct {
+        int view, projection, baseHeight, time, sunDirection, yawOffset;
+    } drawLocations;
+
+    // every instance as (position, scale)
+    unsigned int instanceBuffer, cullVAO;
+    // survivors per set of the ring and level of detail, each sized for every instance
+    unsigned int culledBuffers[SETS][LODS];
+    unsigned int queries[SETS][LODS];
+    unsigned int visible[LODS];
+    unsigned long frame;
+    // frames that had to draw a culling older than the previous frame's
+    unsigned long lateFrames;
+
+    void cull(unsigned int set, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye);
+};
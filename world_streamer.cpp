@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+
+#include "world_streamer.hpp"
+#include "cpu_profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "scene_systems.hpp"
+
+WorldStreamer::WorldStreamer(Scene &scene, const SceneFile &file,
+                             const std::function<Model *(const std::string &)> &loadModel, unsigned int ioThreads)
+        : scene(scene), file(file), loadRadius(48.0f), unloadRadius(64.0f), maxCells(64), entitiesPerUpdate(2048),
+          cells(file.Cells().size()), residentEntities(0), peakEntities(0), staticCastersChanged(false),
+          cellsLoaded(0), cellsUnloaded(0), cellsCancelled(0), cellsAbandoned(0), camera(0.0f), stopping(false),
+          window(1024), nextRead(0), nextUpdate(0), worstUpdate(0.0f) {
+    for (const std::string &path : file.Models())
+        models.push_back(loadModel(path));
+    for (unsigned int i = 0; i < std::max(1u, ioThreads); i++)
+        readers.emplace_back(&WorldStreamer::readLoop, this);
+}
+
+WorldStreamer::~WorldStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &reader : readers)
+        reader.join();
+}
+
+void WorldStreamer::SetRadii(float load, float unload) {
+    loadRadius = load;
+    unloadRadius = std::max(load, unload);
+}
+
+void WorldStreamer::SetLimits(unsigned int maxCells, unsigned int entitiesPerUpdate) {
+    this->maxCells = std::max(1u, maxCells);
+    this->entitiesPerUpdate = std::max(1u, entitiesPerUpdate);
+}
+
+float WorldStreamer::distance(unsigned int cell, const glm::vec2 &position) const {
+    const SceneFileCell &info = file.Cells()[cell];
+    glm::vec2 low = glm::vec2((float) info.x, (float) info.z) * file.CellSize();
+    glm::vec2 nearest = glm::clamp(position, low, low + file.CellSize());
+    return glm::length(position - nearest);
+}
+
+void WorldStreamer::unload(Cell &cell) {
+    for (Entity entity : cell.entities)
+        scene.Destroy(entity);
+    residentEntities -= cell.entities.size();
+    staticCastersChanged |= cell.staticCasters;
+    if (cell.state == RESIDENT)
+        cellsUnloaded++;
+    else
+        cellsAbandoned++;
+
+    cell.entities = std::vector<Entity>();
+    cell.read = std::vector<SceneFileEntity>();
+    cell.instantiated = 0;
+    cell.staticCasters = false;
+    cell.state = UNLOADED;
+}
+
+void WorldStreamer::Update(const glm::vec3 &position) {
+    PROFILE_SCOPE("WorldStreamer::Update");
+    auto start = std::chrono::steady_clock::now();
+    glm::vec2 here(position.x, position.z);
+    staticCastersChanged = false;
+
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        camera = here;
+
+        unsigned int active = 0;
+        std::vector<std::pair<float, unsigned int>> candidates;
+        for (unsigned int i = 0; i < cells.size(); i++) {
+            Cell &cell = cells[i];
+            float d = distance(i, here);
+            bool far = d > unloadRadius;
+            if (cell.state == QUEUED && far) {
+                queue.erase(std::find(queue.begin(), queue.end(), i));
+                cell.state = UNLOADED;
+                cellsCancelled++;
+            } else if (cell.state == READING) {
+                cell.wanted = !far;
+            } else if ((cell.state == READ || cell.state == RESIDENT) && far) {
+                unload(cell);
+            }
+
+            if (cell.state != UNLOADED)
+                active++;
+            else if (d <= loadRadius)
+                candidates.push_back({d, i});
+        }
+
+        // nearest first, while there is room
+        std::sort(candidates.begin(), candidates.end());
+        for (size_t c = 0; c < candidates.size() && active < maxCells; c++, active++) {
+            cells[candidates[c].second].state = QUEUED;
+            queue.push_back(candidates[c].second);
+            queued = true;
+        }
+
+        instantiating.insert(instantiating.end(), arrived.begin(), arrived.end());
+        arrived.clear();
+    }
+    if (queued)
+        wake.notify_all();
+
+    // cells unloaded above drop out, the nearest ones are filled in first
+    instantiating.erase(std::remove_if(instantiating.begin(), instantiating.end(), [&](unsigned int i) {
+        return cells[i].state != READ;
+    }), instantiating.end());
+    std::sort(instantiating.begin(), instantiating.end(), [&](unsigned int a, unsigned int b) {
+        return distance(a, here) < distance(b, here);
+    });
+
+    unsigned int budget = entitiesPerUpdate;
+    while (!instantiating.empty() && budget > 0) {
+        Cell &cell = cells[instantiating.front()];
+        size_t end = std::min(cell.read.size(), cell.instantiated + budget);
+        size_t before = cell.entities.size();
+        for (size_t i = cell.instantiated; i < end; i++) {
+            const SceneFileEntity &entity = cell.read[i];
+            Model *model = entity.model < models.size() ? models[entity.model] : nullptr;
+            if (!model)
+                continue;
+            cell.entities.push_back(CreateRenderable(scene, model, entity.flags, entity.transform));
+            if ((entity.flags & (RENDER_CASTS_SHADOW | RENDER_STATIC)) == (RENDER_CASTS_SHADOW | RENDER_STATIC)) {
+                cell.staticCasters = true;
+                staticCastersChanged = true;
+            }
+        }
+        budget -= (unsigned int) (end - cell.instantiated);
+        residentEntities += cell.entities.size() - before;
+        cell.instantiated = end;
+
+        if (cell.instantiated == cell.read.size()) {
+            cell.read = std::vector<SceneFileEntity>();
+            cell.state = RESIDENT;
+            cellsLoaded++;
+            instantiating.erase(instantiating.begin());
+        }
+    }
+    peakEntities = std::max(peakEntities, residentEntities);
+
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RecordSample(updateMilliseconds, nextUpdate, window, milliseconds);
+    worstUpdate = std::max(worstUpdate, milliseconds);
+}
+
+void WorldStreamer::readLoop() {
+    PROFILE_THREAD("world streamer");
+    std::vector<SceneFileEntity> entities;
+    while (true) {
+        unsigned int index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+
+            // the camera may have moved since the cell was queued
+            auto nearest = std::min_element(queue.begin(), queue.end(), [&](unsigned int a, unsigned int b) {
+                return distance(a, camera) < distance(b, camera);
+            });
+            index = *nearest;
+            *nearest = queue.back();
+            queue.pop_back();
+            cells[index].state = READING;
+            cells[index].wanted = true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        file.ReadCell(index, entities);
+        float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        RecordSample(readMilliseconds, nextRead, window, milliseconds);
+        Cell &cell = cells[index];
+        if (cell.wanted) {
+            cell.read.swap(entities);
+            cell.state = READ;
+            arrived.push_back(index);
+        } else {
+            cell.state = UNLOADED;
+            cellsCancelled++;
+        }
+    }
+}
+
+void WorldStreamer::Report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned int resident = 0;
+    for (const Cell &cell : cells)
+        resident += cell.state == RESIDENT;
+
+    out << "World streaming: " << resident << " of " << cells.size() << " cells resident, " << residentEntities
+        << " entities (peak " << peakEntities << "), " << cellsLoaded << " cells loaded, " << cellsUnloaded
+        << " unloaded, " << cellsCancelled << " dropped before they were read, " << cellsAbandoned
+        << " before they were resident" << std::endl;
+    if (!readMilliseconds.empty()) {
+        out << "  cell reads: " << average(readMilliseconds) << " ms avg, " << percentile(readMilliseconds, 0.99f)
+            << " ms p99 over " << readMilliseconds.size() << " reads" << std::endl;
+    }
+    if (!updateMilliseconds.empty()) {
+        out << "  update on the render thread: " << average(updateMilliseconds) << " ms avg, "
+            << percentile(updateMilliseconds, 0.99f) << " ms p99, " << worstUpdate << " ms worst over "
+            << updateMilliseconds.size() << " frames" << std::endl;
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.hpp"
+#include "scene_file.hpp"
+
+// Keeps the cells of a scene file around the camera loaded into a Scene. Cells within the load radius are queued and
+// read by I/O threads, always the queued cell nearest the camera first, so the ground under the camera arrives before
+// the horizon when it moves faster than the disk. Read cells are turned into entities on the calling thread, at most a
+// budget of entities per Update so a burst of arrivals is spread over frames instead of one long one. Cells past the
+// unload radius are dropped again, queued or read ones included, and no more than maxCells are resident or in flight,
+// which bounds memory however large the world is
+class WorldStreamer {
+public:
+    // loadModel is called once per model the file references, on the calling thread
+    WorldStreamer(Scene &scene, const SceneFile &file, const std::function<Model *(const std::string &)> &loadModel,
+                  unsigned int ioThreads = 2);
+    ~WorldStreamer();
+
+    WorldStreamer(const WorldStreamer &) = delete;
+    WorldStreamer &operator=(const WorldStreamer &) = delete;
+
+    void SetRadii(float load, float unload);
+    void SetLimits(unsigned int maxCells, unsigned int entitiesPerUpdate);
+
+    // loads and unloads around position, call once a frame
+    void Update(const glm::vec3 &position);
+
+    size_t ResidentEntities() const { return residentEntities; }
+
+    // whether the last Update created or destroyed static shadow casters, which the shadow map only redraws when told
+    bool StaticCastersChanged() const { return staticCastersChanged; }
+
+    // cells loaded and dropped, resident entities, cell read times and the time Update took per frame
+    void Report(std::ostream &out) const;
+
+private:
+    enum CellState {
+        UNLOADED,
+        QUEUED,
+        READING,
+        READ,
+        RESIDENT
+    };
+
+    struct Cell {
+        CellState state = UNLOADED;
+        // while READING, cleared when the camera moved away and the result should be thrown out
+        bool wanted = false;
+        std::vector<SceneFileEntity> read;
+        size_t instantiated = 0;
+        std::vector<Entity> entities;
+        // any of the entities casts a static shadow
+        bool staticCasters = false;
+    };
+
+    Scene &scene;
+    const SceneFile &file;
+    std::vector<Model *> models;
+    float loadRadius, unloadRadius;
+    unsigned int maxCells, entitiesPerUpdate;
+
+    std::vector<Cell> cells;
+    // read cells waiting to become entities, only touched by the calling thread
+    std::vector<unsigned int> instantiating;
+    size_t residentEntities, peakEntities;
+    bool staticCastersChanged;
+    // cancelled: dropped before they were read, abandoned: dropped while being turned into entities
+    unsigned long cellsLoaded, cellsUnloaded, cellsCancelled, cellsAbandoned;
+
+    // cell states from QUEUED to READ, the queue, the read results and the camera position the I/O threads sort by
+    // are shared with them
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<unsigned int> queue;
+    std::vector<unsigned int> arrived;
+    glm::vec2 camera;
+    bool stopping;
+    std::vector<std::thread> readers;
+
+    unsigned int window;
+    std::vector<float> readMilliseconds, updateMilliseconds;
+    size_t nextRead, nextUpdate;
+    float worstUpdate;
+
+    float distance(unsigned int cell, const glm::vec2 &position) const;
+    void unload(Cell &cell);
+    void readLoop();
+};